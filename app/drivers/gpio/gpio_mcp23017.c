@@ -26,67 +26,113 @@
 LOG_MODULE_REGISTER(gpio_mcp23017);
 
 /**
- * @brief Read both port 0 and port 1 registers of certain register function.
+ * @brief Read every register into the register cache with one burst.
  *
- * Given the register in reg, read the pair of port 0 and port 1.
+ * The expander may keep its state across an MCU reset, so the cache is only
+ * trusted once it has been loaded from the chip.
  *
  * @param dev Device struct of the MCP23017.
- * @param reg Register to read (the PORTA of the pair of registers).
- * @param buf Buffer to read data into.
  *
  * @return 0 if successful, failed otherwise.
  */
-static int read_port_regs(const struct device *dev, uint8_t reg, uint16_t *buf) {
+static int sync_reg_cache(const struct device *dev) {
     const struct mcp23017_config *const config = dev->config;
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    uint8_t regs[REG_OLAT_PORTB + 1];
     int ret;
-    uint16_t port_data;
-
-    uint8_t addr = config->slave;
 
-    ret = i2c_burst_read(drv_data->i2c, addr, reg, (uint8_t *)&port_data, sizeof(port_data));
+    ret = i2c_burst_read(drv_data->i2c, config->slave, REG_IODIR_PORTA, regs, sizeof(regs));
     if (ret) {
-        LOG_DBG("i2c_write_read FAIL %d\n", ret);
+        LOG_DBG("i2c_burst_read FAIL %d\n", ret);
         return ret;
     }
 
-    *buf = sys_le16_to_cpu(port_data);
-
-    LOG_DBG("MCP23017: Read: REG[0x%X] = 0x%X, REG[0x%X] = 0x%X", reg, (*buf & 0xFF), (reg + 1),
-            (*buf >> 8));
+#define CACHED_PORT(reg) sys_get_le16(&regs[reg])
+    drv_data->reg_cache.iodir = CACHED_PORT(REG_IODIR_PORTA);
+    drv_data->reg_cache.ipol = CACHED_PORT(REG_IPOL_PORTA);
+    drv_data->reg_cache.gpinten = CACHED_PORT(REG_GPINTEN_PORTA);
+    drv_data->reg_cache.defval = CACHED_PORT(REG_DEFVAL_PORTA);
+    drv_data->reg_cache.intcon = CACHED_PORT(REG_INTCON_PORTA);
+    drv_data->reg_cache.iocon = regs[REG_IOCON];
+    drv_data->reg_cache.gppu = CACHED_PORT(REG_GPPU_PORTA);
+    drv_data->reg_cache.intf = CACHED_PORT(REG_INTF_PORTA);
+    drv_data->reg_cache.intcap = CACHED_PORT(REG_INTCAP_PORTA);
+    drv_data->reg_cache.gpio = CACHED_PORT(REG_GPIO_PORTA);
+    drv_data->reg_cache.olat = CACHED_PORT(REG_OLAT_PORTA);
+#undef CACHED_PORT
+
+    drv_data->reg_cache_valid = true;
 
     return 0;
 }
 
 /**
- * @brief Write both port 0 and port 1 registers of certain register function.
- *
- * Given the register in reg, write the pair of port 0 and port 1.
+ * @brief Queue a write of a register pair unless the cache shows it is unchanged.
  *
  * @param dev Device struct of the MCP23017.
+ * @param batch Batch to add the write to.
  * @param reg Register to write into (the PORTA of the pair of registers).
- * @param buf Buffer to write data from.
+ * @param cache Cached value of the register pair, updated once the batch is written.
+ * @param value Value to write.
+ */
+static void queue_port_write(const struct device *dev, struct mcp23017_write_batch *batch,
+                             uint8_t reg, uint16_t *cache, uint16_t value) {
+    struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+
+    if (drv_data->reg_cache_valid && *cache == value) {
+        return;
+    }
+
+    __ASSERT(batch->count < MCP23017_MAX_BATCHED_WRITES, "Too many batched writes");
+
+    struct mcp23017_pending_write *write = &batch->writes[batch->count++];
+    write->buf[0] = reg;
+    sys_put_le16(value, &write->buf[1]);
+    write->cache = cache;
+    write->value = value;
+}
+
+/**
+ * @brief Write all queued register pairs in a single I2C transaction.
+ *
+ * Writes are sent in the order they were queued, separated by repeated starts.
+ *
+ * @param dev Device struct of the MCP23017.
+ * @param batch Batch of queued writes.
  *
  * @return 0 if successful, failed otherwise.
  */
-static int write_port_regs(const struct device *dev, uint8_t reg, uint16_t value) {
+static int flush_port_writes(const struct device *dev, struct mcp23017_write_batch *batch) {
     const struct mcp23017_config *const config = dev->config;
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    struct i2c_msg msgs[MCP23017_MAX_BATCHED_WRITES];
     int ret;
-    uint16_t port_data;
 
-    LOG_DBG("MCP23017: Write: REG[0x%X] = 0x%X, REG[0x%X] = 0x%X", reg, (value & 0xFF), (reg + 1),
-            (value >> 8));
+    if (batch->count == 0) {
+        return 0;
+    }
 
-    port_data = sys_cpu_to_le16(value);
+    for (int i = 0; i < batch->count; i++) {
+        LOG_DBG("MCP23017: Write: REG[0x%X] = 0x%X, REG[0x%X] = 0x%X", batch->writes[i].buf[0],
+                batch->writes[i].buf[1], batch->writes[i].buf[0] + 1, batch->writes[i].buf[2]);
 
-    ret = i2c_burst_write(drv_data->i2c, config->slave, reg, (uint8_t *)&port_data,
-                          sizeof(port_data));
+        msgs[i].buf = batch->writes[i].buf;
+        msgs[i].len = sizeof(batch->writes[i].buf);
+        msgs[i].flags = I2C_MSG_WRITE | (i > 0 ? I2C_MSG_RESTART : 0);
+    }
+    msgs[batch->count - 1].flags |= I2C_MSG_STOP;
+
+    ret = i2c_transfer(drv_data->i2c, msgs, batch->count, config->slave);
     if (ret) {
-        LOG_DBG("i2c_write FAIL %d\n", ret);
+        LOG_DBG("i2c_transfer FAIL %d\n", ret);
         return ret;
     }
 
+    for (int i = 0; i < batch->count; i++) {
+        *batch->writes[i].cache = batch->writes[i].value;
+    }
+    batch->count = 0;
+
     return 0;
 }
 
@@ -94,51 +140,46 @@ static int write_port_regs(const struct device *dev, uint8_t reg, uint16_t value
  * @brief Setup the pin direction (input or output)
  *
  * @param dev Device struct of the MCP23017
+ * @param batch Batch to queue the register writes in
  * @param pin The pin number
  * @param flags Flags of pin or port
- *
- * @return 0 if successful, failed otherwise
  */
-static int setup_pin_dir(const struct device *dev, uint32_t pin, int flags) {
+static void setup_pin_dir(const struct device *dev, struct mcp23017_write_batch *batch,
+                          uint32_t pin, int flags) {
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
-    uint16_t *dir = &drv_data->reg_cache.iodir;
-    uint16_t *output = &drv_data->reg_cache.gpio;
-    int ret;
+    uint16_t dir = drv_data->reg_cache.iodir;
+    uint16_t output = drv_data->reg_cache.olat;
 
     if ((flags & GPIO_OUTPUT) != 0U) {
         if ((flags & GPIO_OUTPUT_INIT_HIGH) != 0U) {
-            *output |= BIT(pin);
+            output |= BIT(pin);
         } else if ((flags & GPIO_OUTPUT_INIT_LOW) != 0U) {
-            *output &= ~BIT(pin);
+            output &= ~BIT(pin);
         }
-        *dir &= ~BIT(pin);
+        dir &= ~BIT(pin);
     } else {
-        *dir |= BIT(pin);
-    }
-
-    ret = write_port_regs(dev, REG_GPIO_PORTA, *output);
-    if (ret != 0) {
-        return ret;
+        dir |= BIT(pin);
     }
 
-    ret = write_port_regs(dev, REG_IODIR_PORTA, *dir);
-
-    return ret;
+    /* Latch the output level before the pin starts driving it */
+    queue_port_write(dev, batch, REG_OLAT_PORTA, &drv_data->reg_cache.olat, output);
+    queue_port_write(dev, batch, REG_IODIR_PORTA, &drv_data->reg_cache.iodir, dir);
 }
 
 /**
  * @brief Setup the pin pull up/pull down status
  *
  * @param dev Device struct of the MCP23017
+ * @param batch Batch to queue the register writes in
  * @param pin The pin number
  * @param flags Flags of pin or port
  *
  * @return 0 if successful, failed otherwise
  */
-static int setup_pin_pullupdown(const struct device *dev, uint32_t pin, int flags) {
+static int setup_pin_pullupdown(const struct device *dev, struct mcp23017_write_batch *batch,
+                                uint32_t pin, int flags) {
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
     uint16_t port;
-    int ret;
 
     /* Setup pin pull up or pull down */
     port = drv_data->reg_cache.gppu;
@@ -150,19 +191,17 @@ static int setup_pin_pullupdown(const struct device *dev, uint32_t pin, int flag
 
     WRITE_BIT(port, pin, (flags & GPIO_PULL_UP) != 0U);
 
-    ret = write_port_regs(dev, REG_GPPU_PORTA, port);
-    if (ret == 0) {
-        drv_data->reg_cache.gppu = port;
-    }
+    queue_port_write(dev, batch, REG_GPPU_PORTA, &drv_data->reg_cache.gppu, port);
 
-    return ret;
+    return 0;
 }
 
 static int mcp23017_config(const struct device *dev, gpio_pin_t pin, gpio_flags_t flags) {
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    struct mcp23017_write_batch batch = {.count = 0};
     int ret;
 
-    /* Can't do SPI bus operations from an ISR */
+    /* Can't do I2C bus operations from an ISR */
     if (k_is_in_isr()) {
         return -EWOULDBLOCK;
     }
@@ -174,15 +213,21 @@ static int mcp23017_config(const struct device *dev, gpio_pin_t pin, gpio_flags_
         goto done;
     };
 
-    ret = setup_pin_dir(dev, pin, flags);
+    if (!drv_data->reg_cache_valid) {
+        sync_reg_cache(dev);
+    }
+
+    setup_pin_dir(dev, &batch, pin, flags);
+
+    ret = setup_pin_pullupdown(dev, &batch, pin, flags);
     if (ret) {
-        LOG_ERR("MCP23017: error setting pin direction (%d)", ret);
+        LOG_ERR("MCP23017: error setting pin pull up/down (%d)", ret);
         goto done;
     }
 
-    ret = setup_pin_pullupdown(dev, pin, flags);
+    ret = flush_port_writes(dev, &batch);
     if (ret) {
-        LOG_ERR("MCP23017: error setting pin pull up/down (%d)", ret);
+        LOG_ERR("MCP23017: error configuring pin (%d)", ret);
         goto done;
     }
 
@@ -192,48 +237,65 @@ done:
 }
 
 static int mcp23017_port_get_raw(const struct device *dev, uint32_t *value) {
+    const struct mcp23017_config *const config = dev->config;
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
-    uint16_t buf;
+    const uint8_t reg = REG_GPIO_PORTA;
+    uint8_t buf[2];
     int ret;
 
-    /* Can't do SPI bus operations from an ISR */
+    /* Can't do I2C bus operations from an ISR */
     if (k_is_in_isr()) {
         return -EWOULDBLOCK;
     }
 
     k_sem_take(&drv_data->lock, K_FOREVER);
 
-    ret = read_port_regs(dev, REG_GPIO_PORTA, &buf);
-    if (ret != 0) {
-        goto done;
+    /* GPIOA and GPIOB are sequential, so both ports come back in one 2-byte burst */
+    ret = i2c_write_read(drv_data->i2c, config->slave, &reg, sizeof(reg), buf, sizeof(buf));
+    if (ret == 0) {
+        drv_data->reg_cache.gpio = sys_get_le16(buf);
+        *value = drv_data->reg_cache.gpio;
     }
 
-    *value = buf;
-
-done:
     k_sem_give(&drv_data->lock);
     return ret;
 }
 
+/**
+ * @brief Write the output latch unless the cache shows it is unchanged.
+ *
+ * Must be called with the driver lock held.
+ *
+ * @param dev Device struct of the MCP23017.
+ * @param value New output latch value.
+ *
+ * @return 0 if successful, failed otherwise.
+ */
+static int update_output_latch(const struct device *dev, uint16_t value) {
+    struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    struct mcp23017_write_batch batch = {.count = 0};
+
+    queue_port_write(dev, &batch, REG_OLAT_PORTA, &drv_data->reg_cache.olat, value);
+
+    return flush_port_writes(dev, &batch);
+}
+
 static int mcp23017_port_set_masked_raw(const struct device *dev, uint32_t mask, uint32_t value) {
     struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
     uint16_t buf;
     int ret;
 
-    /* Can't do SPI bus operations from an ISR */
+    /* Can't do I2C bus operations from an ISR */
     if (k_is_in_isr()) {
         return -EWOULDBLOCK;
     }
 
     k_sem_take(&drv_data->lock, K_FOREVER);
 
-    buf = drv_data->reg_cache.gpio;
+    buf = drv_data->reg_cache.olat;
     buf = (buf & ~mask) | (mask & value);
 
-    ret = write_port_regs(dev, REG_GPIO_PORTA, buf);
-    if (ret == 0) {
-        drv_data->reg_cache.gpio = buf;
-    }
+    ret = update_output_latch(dev, buf);
 
     k_sem_give(&drv_data->lock);
 
@@ -253,20 +315,17 @@ static int mcp23017_port_toggle_bits(const struct device *dev, uint32_t mask) {
     uint16_t buf;
     int ret;
 
-    /* Can't do SPI bus operations from an ISR */
+    /* Can't do I2C bus operations from an ISR */
     if (k_is_in_isr()) {
         return -EWOULDBLOCK;
     }
 
     k_sem_take(&drv_data->lock, K_FOREVER);
 
-    buf = drv_data->reg_cache.gpio;
+    buf = drv_data->reg_cache.olat;
     buf ^= mask;
 
-    ret = write_port_regs(dev, REG_GPIO_PORTA, buf);
-    if (ret == 0) {
-        drv_data->reg_cache.gpio = buf;
-    }
+    ret = update_output_latch(dev, buf);
 
     k_sem_give(&drv_data->lock);
 
@@ -278,6 +337,95 @@ static int mcp23017_pin_interrupt_configure(const struct device *dev, gpio_pin_t
     return -ENOTSUP;
 }
 
+int mcp23017_port_read_and_set_masked_raw(const struct device *dev, uint16_t *inputs,
+                                          uint16_t mask, uint16_t value) {
+    const struct mcp23017_config *const config = dev->config;
+    struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    uint8_t read_reg = REG_GPIO_PORTA;
+    uint16_t port_data;
+    uint16_t buf;
+    int ret;
+
+    /* Can't do I2C bus operations from an ISR */
+    if (k_is_in_isr()) {
+        return -EWOULDBLOCK;
+    }
+
+    k_sem_take(&drv_data->lock, K_FOREVER);
+
+    buf = drv_data->reg_cache.olat;
+    buf = (buf & ~mask) | (mask & value);
+
+    uint8_t write_buf[3] = {REG_OLAT_PORTA, buf & 0xFF, buf >> 8};
+
+    struct i2c_msg msgs[] = {
+        {
+            .buf = &read_reg,
+            .len = sizeof(read_reg),
+            .flags = I2C_MSG_WRITE,
+        },
+        {
+            .buf = (uint8_t *)&port_data,
+            .len = sizeof(port_data),
+            .flags = I2C_MSG_RESTART | I2C_MSG_READ,
+        },
+        {
+            .buf = write_buf,
+            .len = sizeof(write_buf),
+            .flags = I2C_MSG_RESTART | I2C_MSG_WRITE | I2C_MSG_STOP,
+        },
+    };
+
+    ret = i2c_transfer(drv_data->i2c, msgs, ARRAY_SIZE(msgs), config->slave);
+    if (ret) {
+        LOG_DBG("i2c_transfer FAIL %d\n", ret);
+        goto done;
+    }
+
+    drv_data->reg_cache.olat = buf;
+    drv_data->reg_cache.gpio = sys_le16_to_cpu(port_data);
+    *inputs = drv_data->reg_cache.gpio;
+
+done:
+    k_sem_give(&drv_data->lock);
+    return ret;
+}
+
+int mcp23017_configure_change_interrupt(const struct device *dev, uint16_t mask) {
+    const struct mcp23017_config *const config = dev->config;
+    struct mcp23017_drv_data *const drv_data = (struct mcp23017_drv_data *const)dev->data;
+    struct mcp23017_write_batch batch = {.count = 0};
+    uint8_t iocon;
+    int ret;
+
+    /* Can't do I2C bus operations from an ISR */
+    if (k_is_in_isr()) {
+        return -EWOULDBLOCK;
+    }
+
+    k_sem_take(&drv_data->lock, K_FOREVER);
+
+    /* Either interrupt line reports changes on both ports */
+    iocon = drv_data->reg_cache.iocon | IOCON_MIRROR;
+    if (!drv_data->reg_cache_valid || iocon != drv_data->reg_cache.iocon) {
+        ret = i2c_reg_write_byte(drv_data->i2c, config->slave, REG_IOCON, iocon);
+        if (ret) {
+            goto done;
+        }
+        drv_data->reg_cache.iocon = iocon;
+    }
+
+    /* Compare against the previous pin value rather than DEFVAL */
+    queue_port_write(dev, &batch, REG_INTCON_PORTA, &drv_data->reg_cache.intcon, 0);
+    queue_port_write(dev, &batch, REG_GPINTEN_PORTA, &drv_data->reg_cache.gpinten, mask);
+
+    ret = flush_port_writes(dev, &batch);
+
+done:
+    k_sem_give(&drv_data->lock);
+    return ret;
+}
+
 static const struct gpio_driver_api api_table = {
     .pin_configure = mcp23017_config,
     .port_get_raw = mcp23017_port_get_raw,
@@ -306,6 +454,11 @@ static int mcp23017_init(const struct device *dev) {
 
     k_sem_init(&drv_data->lock, 1, 1);
 
+    /* Without a valid cache every write goes to the bus; retried on the next pin config */
+    if (sync_reg_cache(dev)) {
+        LOG_WRN("Unable to read MCP23017 registers, register cache disabled");
+    }
+
     return 0;
 }
 
@@ -31,6 +31,7 @@ extern "C" {
 #define REG_DEFVAL_PORTB 0x07
 #define REG_INTCON_PORTA 0x08
 #define REG_INTCON_PORTB 0x09
+#define REG_IOCON 0x0A
 #define REG_GPPU_PORTA 0x0C
 #define REG_GPPU_PORTB 0x0D
 #define REG_INTF_PORTA 0x0E
@@ -45,6 +46,28 @@ extern "C" {
 #define MCP23017_ADDR 0x40
 #define MCP23017_READBIT 0x01
 
+/* IOCON bits */
+#define IOCON_INTPOL BIT(1)
+#define IOCON_ODR BIT(2)
+#define IOCON_MIRROR BIT(6)
+
+/** Maximum number of register pair writes sent in one transaction */
+#define MCP23017_MAX_BATCHED_WRITES 3
+
+/** Register pair write waiting to be sent */
+struct mcp23017_pending_write {
+    /* Register address followed by the PORTA and PORTB values */
+    uint8_t buf[3];
+    uint16_t *cache;
+    uint16_t value;
+};
+
+/** Register pair writes to send in one transaction */
+struct mcp23017_write_batch {
+    struct mcp23017_pending_write writes[MCP23017_MAX_BATCHED_WRITES];
+    uint8_t count;
+};
+
 /** Configuration data */
 struct mcp23017_config {
     /* gpio_driver_data needs to be first */
@@ -77,8 +100,41 @@ struct mcp23017_drv_data {
         uint16_t gpio;
         uint16_t olat;
     } reg_cache;
+
+    /* Whether reg_cache mirrors the chip and unchanged writes may be skipped */
+    bool reg_cache_valid;
 };
 
+/**
+ * @brief Read both GPIO ports and update the output latch in one I2C transaction.
+ *
+ * The inputs are sampled before the new output value is written, which lets a
+ * matrix scanner read the inputs of the current strobe and drive the next
+ * strobe with a single bus transfer.
+ *
+ * @param dev Device struct of the MCP23017.
+ * @param inputs Buffer to store the raw GPIOA/GPIOB value into.
+ * @param mask Output pins to update.
+ * @param value Raw value to write to the pins in mask.
+ *
+ * @return 0 if successful, failed otherwise.
+ */
+int mcp23017_port_read_and_set_masked_raw(const struct device *dev, uint16_t *inputs,
+                                          uint16_t mask, uint16_t value);
+
+/**
+ * @brief Enable interrupt-on-change for a set of pins.
+ *
+ * INTA and INTB are mirrored so either line reports a change on any pin in mask.
+ * The interrupt is cleared by the next read of the GPIO registers.
+ *
+ * @param dev Device struct of the MCP23017.
+ * @param mask Pins to raise an interrupt on change. Zero disables all interrupts.
+ *
+ * @return 0 if successful, failed otherwise.
+ */
+int mcp23017_configure_change_interrupt(const struct device *dev, uint16_t mask);
+
 #ifdef __cplusplus
 }
 #endif
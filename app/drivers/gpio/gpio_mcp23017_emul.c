@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT microchip_mcp23017
+
+/**
+ * @file Emulator for the MCP23017 on an emulated I2C bus.
+ *
+ * Every transfer is logged, so tests can check which messages the driver sends. Inputs read as
+ * their pull-up sets them, so no key is ever pressed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <logging/log.h>
+
+#include "gpio_mcp23017.h"
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define MCP23017_EMUL_REG_COUNT (REG_OLAT_PORTB + 1)
+
+struct mcp23017_emul_data {
+    struct i2c_emul emul;
+    uint8_t regs[MCP23017_EMUL_REG_COUNT];
+    /* Register read or written next, advanced after every byte */
+    uint8_t pointer;
+};
+
+struct mcp23017_emul_cfg {
+    struct mcp23017_emul_data *data;
+    uint16_t addr;
+};
+
+static uint8_t mcp23017_emul_read_reg(struct mcp23017_emul_data *data, uint8_t reg) {
+    switch (reg) {
+    case REG_IOCON + 1:
+        /* Both ports share IOCON */
+        return data->regs[REG_IOCON];
+    case REG_GPIO_PORTA:
+    case REG_GPIO_PORTB: {
+        const uint8_t port = reg - REG_GPIO_PORTA;
+        const uint8_t inputs = data->regs[REG_IODIR_PORTA + port];
+
+        return (data->regs[REG_OLAT_PORTA + port] & ~inputs) |
+               (data->regs[REG_GPPU_PORTA + port] & inputs);
+    }
+    default:
+        return data->regs[reg];
+    }
+}
+
+static void mcp23017_emul_write_reg(struct mcp23017_emul_data *data, uint8_t reg, uint8_t value) {
+    switch (reg) {
+    case REG_IOCON + 1:
+        data->regs[REG_IOCON] = value;
+        break;
+    case REG_GPIO_PORTA:
+    case REG_GPIO_PORTB:
+        /* Writing GPIO writes the output latch */
+        data->regs[REG_OLAT_PORTA + reg - REG_GPIO_PORTA] = value;
+        break;
+    case REG_INTF_PORTA:
+    case REG_INTF_PORTB:
+    case REG_INTCAP_PORTA:
+    case REG_INTCAP_PORTB:
+        /* Read-only */
+        break;
+    default:
+        data->regs[reg] = value;
+        break;
+    }
+}
+
+static void mcp23017_emul_advance(struct mcp23017_emul_data *data) {
+    /* Sequential operation, as IOCON.SEQOP is never set */
+    data->pointer = (data->pointer + 1) % MCP23017_EMUL_REG_COUNT;
+}
+
+static int mcp23017_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs,
+                                  int addr) {
+    struct mcp23017_emul_data *data = CONTAINER_OF(emul, struct mcp23017_emul_data, emul);
+    char log[128];
+    size_t len = 0;
+
+#define LOG_APPEND(...)                                                                            \
+    if (len < sizeof(log)) {                                                                       \
+        len += snprintf(&log[len], sizeof(log) - len, __VA_ARGS__);                                \
+    }
+
+    for (int i = 0; i < num_msgs; i++) {
+        struct i2c_msg *msg = &msgs[i];
+        const bool read = (msg->flags & I2C_MSG_RW_MASK) == I2C_MSG_READ;
+
+        LOG_APPEND("%s%c", i > 0 ? " | " : "", read ? 'r' : 'w');
+
+        for (int j = 0; j < msg->len; j++) {
+            if (read) {
+                msg->buf[j] = mcp23017_emul_read_reg(data, data->pointer);
+                mcp23017_emul_advance(data);
+            } else if (j == 0) {
+                if (msg->buf[0] >= MCP23017_EMUL_REG_COUNT) {
+                    LOG_ERR("No MCP23017 register 0x%02x", msg->buf[0]);
+                    return -EIO;
+                }
+                data->pointer = msg->buf[0];
+            } else {
+                mcp23017_emul_write_reg(data, data->pointer, msg->buf[j]);
+                mcp23017_emul_advance(data);
+            }
+
+            LOG_APPEND(" %02x", msg->buf[j]);
+        }
+    }
+
+#undef LOG_APPEND
+
+    LOG_DBG("%s", log_strdup(log));
+
+    return 0;
+}
+
+static const struct i2c_emul_api mcp23017_emul_api = {
+    .transfer = mcp23017_emul_transfer,
+};
+
+static int mcp23017_emul_init(const struct emul *emul, const struct device *parent) {
+    const struct mcp23017_emul_cfg *cfg = emul->cfg;
+    struct mcp23017_emul_data *data = cfg->data;
+
+    /* Power-on reset values, every pin is an input */
+    memset(data->regs, 0, sizeof(data->regs));
+    data->regs[REG_IODIR_PORTA] = 0xFF;
+    data->regs[REG_IODIR_PORTB] = 0xFF;
+    data->pointer = 0;
+
+    data->emul.api = &mcp23017_emul_api;
+    data->emul.addr = cfg->addr;
+
+    return i2c_emul_register(parent, emul->dev_label, &data->emul);
+}
+
+#define MCP23017_EMUL(n)                                                                           \
+    static struct mcp23017_emul_data mcp23017_emul_data_##n;                                       \
+    static const struct mcp23017_emul_cfg mcp23017_emul_cfg_##n = {                                \
+        .data = &mcp23017_emul_data_##n,                                                           \
+        .addr = DT_INST_REG_ADDR(n),                                                               \
+    };                                                                                             \
+    EMUL_DEFINE(mcp23017_emul_init, DT_DRV_INST(n), &mcp23017_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(MCP23017_EMUL)
@@ -7,8 +7,11 @@
 #define DT_DRV_COMPAT zmk_kscan_composite
 
 #include <device.h>
+#include <kernel.h>
+#include <string.h>
 #include <drivers/kscan.h>
 #include <logging/log.h>
+#include <zmk/kscan.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #define MATRIX_NODE_ID DT_DRV_INST(0)
@@ -29,56 +32,137 @@ struct kscan_composite_child_config {
 const struct kscan_composite_child_config kscan_composite_children[] = {
     DT_FOREACH_CHILD(MATRIX_NODE_ID, CHILD_CONFIG)};
 
+#define CHILD_COUNT ARRAY_SIZE(kscan_composite_children)
+
 struct kscan_composite_config {};
 
+/** A state change from a child, already translated to composite coordinates. */
+struct kscan_composite_event {
+    uint32_t row;
+    uint32_t column;
+    bool pressed;
+    /** Uptime when the child reported the change, not when the batch was flushed. */
+    int64_t timestamp;
+};
+
 struct kscan_composite_data {
     kscan_callback_t callback;
 
     const struct device *dev;
+
+    /** Child devices, resolved once when configured. */
+    const struct device *children[CHILD_COUNT];
+
+    /**
+     * Changes reported by all children during the current scan cycle, in the order they were
+     * reported. Sorting them by position would reorder keys pressed in different scans.
+     */
+    struct kscan_composite_event batch[CONFIG_ZMK_KSCAN_COMPOSITE_BATCH_SIZE];
+    uint8_t batch_len;
+    struct k_spinlock lock;
+
+    /** Flushes the batch once every child scanning this cycle has reported. */
+    struct k_delayed_work flush_work;
 };
 
+static struct kscan_composite_data kscan_composite_data;
+
 static int kscan_composite_enable_callback(const struct device *dev) {
-    for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
-        const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
+    struct kscan_composite_data *data = dev->data;
 
-        const struct device *dev = device_get_binding(cfg->label);
-        if (!dev) {
-            LOG_WRN("Failed to load child kscan device %s", log_strdup(cfg->label));
+    // Enable the children back to back so their scan timers start in lockstep.
+    for (int i = 0; i < CHILD_COUNT; i++) {
+        if (!data->children[i]) {
             continue;
         }
-        kscan_enable_callback(dev);
+        kscan_enable_callback(data->children[i]);
     }
     return 0;
 }
 
 static int kscan_composite_disable_callback(const struct device *dev) {
-    for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
-        const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
+    struct kscan_composite_data *data = dev->data;
 
-        const struct device *dev = device_get_binding(cfg->label);
-        if (!dev) {
-            LOG_WRN("Failed to load child kscan device %s", log_strdup(cfg->label));
+    for (int i = 0; i < CHILD_COUNT; i++) {
+        if (!data->children[i]) {
             continue;
         }
-        kscan_disable_callback(dev);
+        kscan_disable_callback(data->children[i]);
     }
+
+    k_delayed_work_cancel(&data->flush_work);
+
     return 0;
 }
 
+static void kscan_composite_flush(struct kscan_composite_data *data) {
+    struct kscan_composite_event batch[CONFIG_ZMK_KSCAN_COMPOSITE_BATCH_SIZE];
+    uint8_t len;
+
+    k_spinlock_key_t key = k_spin_lock(&data->lock);
+    len = data->batch_len;
+    memcpy(batch, data->batch, len * sizeof(batch[0]));
+    data->batch_len = 0;
+    k_spin_unlock(&data->lock, key);
+
+    if (len == 0) {
+        return;
+    }
+
+    LOG_DBG("Forwarding %d composite events", len);
+
+    for (int i = 0; i < len; i++) {
+        zmk_kscan_forward(data->callback, data->dev, batch[i].row, batch[i].column,
+                          batch[i].pressed, batch[i].timestamp);
+    }
+}
+
+static void kscan_composite_flush_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct kscan_composite_data *data =
+        CONTAINER_OF(dwork, struct kscan_composite_data, flush_work);
+
+    kscan_composite_flush(data);
+}
+
 static void kscan_composite_child_callback(const struct device *child_dev, uint32_t row,
                                            uint32_t column, bool pressed) {
-    // TODO: Ideally we can get this passed into our callback!
-    const struct device *dev = device_get_binding(DT_INST_LABEL(0));
-    struct kscan_composite_data *data = dev->data;
+    struct kscan_composite_data *data = &kscan_composite_data;
+    const int64_t timestamp = k_uptime_get();
+    bool full = false;
+    bool first = false;
 
-    for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
+    for (int i = 0; i < CHILD_COUNT; i++) {
         const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
 
-        if (device_get_binding(cfg->label) != child_dev) {
+        if (data->children[i] != child_dev) {
             continue;
         }
 
-        data->callback(dev, row + cfg->row_offset, column + cfg->column_offset, pressed);
+        k_spinlock_key_t key = k_spin_lock(&data->lock);
+        if (data->batch_len < CONFIG_ZMK_KSCAN_COMPOSITE_BATCH_SIZE) {
+            first = data->batch_len == 0;
+            data->batch[data->batch_len++] = (struct kscan_composite_event){
+                .row = row + cfg->row_offset,
+                .column = column + cfg->column_offset,
+                .pressed = pressed,
+                .timestamp = timestamp,
+            };
+            full = data->batch_len == CONFIG_ZMK_KSCAN_COMPOSITE_BATCH_SIZE;
+        } else {
+            LOG_WRN("Composite kscan batch is full, dropping event");
+        }
+        k_spin_unlock(&data->lock, key);
+    }
+
+    if (full) {
+        k_delayed_work_cancel(&data->flush_work);
+        kscan_composite_flush(data);
+    } else if (first) {
+        // Children scanning in this cycle have their work already queued, so a
+        // flush queued behind them collects all of their changes.
+        k_delayed_work_submit(&data->flush_work,
+                              K_MSEC(CONFIG_ZMK_KSCAN_COMPOSITE_BATCH_WINDOW_MS));
     }
 }
 
@@ -89,10 +173,16 @@ static int kscan_composite_configure(const struct device *dev, kscan_callback_t
         return -EINVAL;
     }
 
-    for (int i = 0; i < ARRAY_SIZE(kscan_composite_children); i++) {
+    for (int i = 0; i < CHILD_COUNT; i++) {
         const struct kscan_composite_child_config *cfg = &kscan_composite_children[i];
 
-        kscan_config(device_get_binding(cfg->label), &kscan_composite_child_callback);
+        data->children[i] = device_get_binding(cfg->label);
+        if (!data->children[i]) {
+            LOG_WRN("Failed to load child kscan device %s", log_strdup(cfg->label));
+            continue;
+        }
+
+        kscan_config(data->children[i], &kscan_composite_child_callback);
     }
 
     data->callback = callback;
@@ -104,6 +194,7 @@ static int kscan_composite_init(const struct device *dev) {
     struct kscan_composite_data *data = dev->data;
 
     data->dev = dev;
+    k_delayed_work_init(&data->flush_work, kscan_composite_flush_work_handler);
 
     return 0;
 }
@@ -116,8 +207,6 @@ static const struct kscan_driver_api mock_driver_api = {
 
 static const struct kscan_composite_config kscan_composite_config = {};
 
-static struct kscan_composite_data kscan_composite_data;
-
 DEVICE_DT_INST_DEFINE(0, kscan_composite_init, device_pm_control_nop, &kscan_composite_data,
                       &kscan_composite_config, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,
                       &mock_driver_api);
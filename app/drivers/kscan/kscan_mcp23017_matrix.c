@@ -0,0 +1,520 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "debounce.h"
+#include "../gpio/gpio_mcp23017.h"
+
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/gpio.h>
+#include <drivers/kscan.h>
+#include <kernel.h>
+#include <logging/log.h>
+#include <sys/__assert.h>
+#include <sys/util.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define DT_DRV_COMPAT zmk_kscan_mcp23017_matrix
+
+#if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
+
+#define INST_DIODE_DIR(n) DT_ENUM_IDX(DT_DRV_INST(n), diode_direction)
+#define COND_DIODE_DIR(n, row2col_code, col2row_code)                                              \
+    COND_CODE_0(INST_DIODE_DIR(n), row2col_code, col2row_code)
+
+#define INST_ROWS_LEN(n) DT_INST_PROP_LEN(n, row_gpios)
+#define INST_COLS_LEN(n) DT_INST_PROP_LEN(n, col_gpios)
+#define INST_MATRIX_LEN(n) (INST_ROWS_LEN(n) * INST_COLS_LEN(n))
+
+#define INST_HAS_INTERRUPT(n) DT_INST_NODE_HAS_PROP(n, interrupt_gpios)
+
+#if CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS >= 0
+#define INST_DEBOUNCE_PRESS_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS
+#else
+#define INST_DEBOUNCE_PRESS_MS(n) DT_INST_PROP(n, debounce_press_ms)
+#endif
+
+#if CONFIG_ZMK_KSCAN_DEBOUNCE_RELEASE_MS >= 0
+#define INST_DEBOUNCE_RELEASE_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_RELEASE_MS
+#else
+#define INST_DEBOUNCE_RELEASE_MS(n) DT_INST_PROP(n, debounce_release_ms)
+#endif
+
+// TODO (Zephr 2.6): replace kscan_gpio_dt_spec with gpio_dt_spec
+struct kscan_gpio_dt_spec {
+    const struct device *port;
+    gpio_pin_t pin;
+    gpio_dt_flags_t dt_flags;
+};
+
+#define KSCAN_GPIO_DT_SPEC_GET_BY_IDX(node_id, prop, idx)                                          \
+    {                                                                                              \
+        .port = DEVICE_DT_GET(DT_GPIO_CTLR_BY_IDX(node_id, prop, idx)),                            \
+        .pin = DT_GPIO_PIN_BY_IDX(node_id, prop, idx),                                             \
+        .dt_flags = DT_GPIO_FLAGS_BY_IDX(node_id, prop, idx),                                      \
+    }
+
+#define KSCAN_GPIO_ROW_CFG_INIT(idx, inst_idx)                                                     \
+    KSCAN_GPIO_DT_SPEC_GET_BY_IDX(DT_DRV_INST(inst_idx), row_gpios, idx),
+#define KSCAN_GPIO_COL_CFG_INIT(idx, inst_idx)                                                     \
+    KSCAN_GPIO_DT_SPEC_GET_BY_IDX(DT_DRV_INST(inst_idx), col_gpios, idx),
+
+enum kscan_diode_direction {
+    KSCAN_ROW2COL,
+    KSCAN_COL2ROW,
+};
+
+struct kscan_mcp23017_data {
+    const struct device *dev;
+    kscan_callback_t callback;
+    struct k_delayed_work work;
+    struct gpio_callback irq_callback;
+    /** Timestamp of the current or scheduled scan. */
+    int64_t scan_time;
+    /** Expander pins used as matrix inputs. */
+    uint16_t input_mask;
+    /** Input pins which read as 0 when active. */
+    uint16_t input_active_low;
+    /** Expander pins used as matrix outputs. */
+    uint16_t output_mask;
+    /** Raw output value with every output inactive. */
+    uint16_t outputs_idle;
+    /**
+     * Current state of the matrix as a flattened 2D array of length
+     * (config->rows.len * config->cols.len)
+     */
+    struct debounce_state *matrix_state;
+};
+
+struct kscan_gpio_list {
+    const struct kscan_gpio_dt_spec *gpios;
+    size_t len;
+};
+
+/** Define a kscan_gpio_list from a compile-time GPIO array. */
+#define KSCAN_GPIO_LIST(gpio_array)                                                                \
+    ((struct kscan_gpio_list){.gpios = gpio_array, .len = ARRAY_SIZE(gpio_array)})
+
+struct kscan_mcp23017_config {
+    struct kscan_gpio_list rows;
+    struct kscan_gpio_list cols;
+    struct kscan_gpio_list inputs;
+    struct kscan_gpio_list outputs;
+    /** MCU pin wired to INTA/INTB, or a NULL port to poll instead. */
+    struct kscan_gpio_dt_spec interrupt;
+    struct debounce_config debounce_config;
+    int32_t debounce_scan_period_ms;
+    int32_t poll_period_ms;
+    enum kscan_diode_direction diode_direction;
+};
+
+/**
+ * Get the index into a matrix state array from a row and column.
+ */
+static int state_index_rc(const struct kscan_mcp23017_config *config, const int row,
+                          const int col) {
+    __ASSERT(row < config->rows.len, "Invalid row %i", row);
+    __ASSERT(col < config->cols.len, "Invalid column %i", col);
+
+    return (col * config->rows.len) + row;
+}
+
+/**
+ * Get the index into a matrix state array from input/output pin indices.
+ */
+static int state_index_io(const struct kscan_mcp23017_config *config, const int input_idx,
+                          const int output_idx) {
+    return (config->diode_direction == KSCAN_ROW2COL)
+               ? state_index_rc(config, output_idx, input_idx)
+               : state_index_rc(config, input_idx, output_idx);
+}
+
+static const struct device *kscan_mcp23017_expander(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+
+    return config->rows.gpios[0].port;
+}
+
+static bool kscan_mcp23017_use_interrupt(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+
+    return config->interrupt.port != NULL;
+}
+
+/**
+ * Get the raw output value which drives only the given output active.
+ */
+static uint16_t kscan_mcp23017_strobe(const struct device *dev, const int output_idx) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    struct kscan_mcp23017_data *data = dev->data;
+
+    return data->outputs_idle ^ BIT(config->outputs.gpios[output_idx].pin);
+}
+
+static int kscan_mcp23017_set_all_outputs(const struct device *dev, const bool active) {
+    struct kscan_mcp23017_data *data = dev->data;
+    const uint16_t value = active ? (data->outputs_idle ^ data->output_mask) : data->outputs_idle;
+
+    int err = gpio_port_set_masked_raw(kscan_mcp23017_expander(dev), data->output_mask, value);
+    if (err) {
+        LOG_ERR("Failed to set outputs to %i: %i", active, err);
+    }
+
+    return err;
+}
+
+static int kscan_mcp23017_interrupt_enable(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    gpio_port_value_t value;
+
+    // While waiting for an interrupt, set all outputs active so a pressed key
+    // changes an input and raises the expander's interrupt line.
+    int err = kscan_mcp23017_set_all_outputs(dev, true);
+    if (err) {
+        return err;
+    }
+
+    // Reading the port clears any change latched while we were scanning.
+    err = gpio_port_get_raw(kscan_mcp23017_expander(dev), &value);
+    if (err) {
+        LOG_ERR("Failed to clear expander interrupt: %i", err);
+        return err;
+    }
+
+    return gpio_pin_interrupt_configure(config->interrupt.port, config->interrupt.pin,
+                                        GPIO_INT_LEVEL_ACTIVE);
+}
+
+static int kscan_mcp23017_interrupt_disable(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+
+    return gpio_pin_interrupt_configure(config->interrupt.port, config->interrupt.pin,
+                                        GPIO_INT_DISABLE);
+}
+
+static void kscan_mcp23017_irq_callback_handler(const struct device *port,
+                                                struct gpio_callback *cb,
+                                                const gpio_port_pins_t pin) {
+    struct kscan_mcp23017_data *data = CONTAINER_OF(cb, struct kscan_mcp23017_data, irq_callback);
+
+    // The expander can only be read from a thread, so keep the line masked
+    // until the scan has finished and cleared the interrupt.
+    kscan_mcp23017_interrupt_disable(data->dev);
+
+    data->scan_time = k_uptime_get();
+
+    // TODO (Zephyr 2.6): use k_work_reschedule()
+    k_delayed_work_cancel(&data->work);
+    k_delayed_work_submit(&data->work, K_NO_WAIT);
+}
+
+static void kscan_mcp23017_read_continue(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    struct kscan_mcp23017_data *data = dev->data;
+
+    data->scan_time += config->debounce_scan_period_ms;
+
+    // TODO (Zephyr 2.6): use k_work_reschedule()
+    k_delayed_work_cancel(&data->work);
+    k_delayed_work_submit(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+}
+
+static void kscan_mcp23017_read_end(const struct device *dev) {
+    struct kscan_mcp23017_data *data = dev->data;
+    const struct kscan_mcp23017_config *config = dev->config;
+
+    if (kscan_mcp23017_use_interrupt(dev)) {
+        // Return to waiting for an interrupt.
+        kscan_mcp23017_interrupt_enable(dev);
+        return;
+    }
+
+    data->scan_time += config->poll_period_ms;
+
+    // Return to polling slowly.
+    // TODO (Zephyr 2.6): use k_work_reschedule()
+    k_delayed_work_cancel(&data->work);
+    k_delayed_work_submit(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+}
+
+static int kscan_mcp23017_read(const struct device *dev) {
+    struct kscan_mcp23017_data *data = dev->data;
+    const struct kscan_mcp23017_config *config = dev->config;
+    const struct device *expander = kscan_mcp23017_expander(dev);
+
+    // Scan the matrix. Each transfer reads the inputs for the current strobe
+    // and drives the next one, so a full scan is (outputs + 1) I2C transfers.
+    int err = gpio_port_set_masked_raw(expander, data->output_mask, kscan_mcp23017_strobe(dev, 0));
+    if (err) {
+        LOG_ERR("Failed to set output 0 active: %i", err);
+        return err;
+    }
+
+    for (int o = 0; o < config->outputs.len; o++) {
+        const uint16_t next = (o + 1 < config->outputs.len) ? kscan_mcp23017_strobe(dev, o + 1)
+                                                             : data->outputs_idle;
+        uint16_t raw;
+
+        err = mcp23017_port_read_and_set_masked_raw(expander, &raw, data->output_mask, next);
+        if (err) {
+            LOG_ERR("Failed to read inputs for output %i: %i", o, err);
+            return err;
+        }
+
+        const uint16_t active_inputs = (raw ^ data->input_active_low) & data->input_mask;
+
+        for (int i = 0; i < config->inputs.len; i++) {
+            const int index = state_index_io(config, i, o);
+            const bool active = active_inputs & BIT(config->inputs.gpios[i].pin);
+
+            debounce_update(&data->matrix_state[index], active, config->debounce_scan_period_ms,
+                            &config->debounce_config);
+        }
+    }
+
+    // Process the new state.
+    bool continue_scan = false;
+
+    for (int r = 0; r < config->rows.len; r++) {
+        for (int c = 0; c < config->cols.len; c++) {
+            const int index = state_index_rc(config, r, c);
+            struct debounce_state *state = &data->matrix_state[index];
+
+            if (debounce_get_changed(state)) {
+                const bool pressed = debounce_is_pressed(state);
+
+                LOG_DBG("Sending event at %i,%i state %s", r, c, pressed ? "on" : "off");
+                data->callback(dev, r, c, pressed);
+            }
+
+            continue_scan = continue_scan || debounce_is_active(state);
+        }
+    }
+
+    if (continue_scan) {
+        // At least one key is pressed or the debouncer has not yet decided if
+        // it is pressed. Poll quickly until everything is released.
+        kscan_mcp23017_read_continue(dev);
+    } else {
+        // All keys are released. Return to normal.
+        kscan_mcp23017_read_end(dev);
+    }
+
+    return 0;
+}
+
+static void kscan_mcp23017_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct kscan_mcp23017_data *data = CONTAINER_OF(dwork, struct kscan_mcp23017_data, work);
+    kscan_mcp23017_read(data->dev);
+}
+
+static int kscan_mcp23017_configure(const struct device *dev, const kscan_callback_t callback) {
+    struct kscan_mcp23017_data *data = dev->data;
+
+    if (!callback) {
+        return -EINVAL;
+    }
+
+    data->callback = callback;
+    return 0;
+}
+
+static int kscan_mcp23017_enable(const struct device *dev) {
+    struct kscan_mcp23017_data *data = dev->data;
+
+    if (kscan_mcp23017_use_interrupt(dev)) {
+        int err = mcp23017_configure_change_interrupt(kscan_mcp23017_expander(dev),
+                                                      data->input_mask);
+        if (err) {
+            LOG_ERR("Failed to enable expander interrupts: %i", err);
+            return err;
+        }
+    }
+
+    data->scan_time = k_uptime_get();
+
+    // Read will automatically start interrupts/polling once done.
+    return kscan_mcp23017_read(dev);
+}
+
+static int kscan_mcp23017_disable(const struct device *dev) {
+    struct kscan_mcp23017_data *data = dev->data;
+
+    k_delayed_work_cancel(&data->work);
+
+    if (kscan_mcp23017_use_interrupt(dev)) {
+        int err = kscan_mcp23017_interrupt_disable(dev);
+        if (err) {
+            return err;
+        }
+
+        return mcp23017_configure_change_interrupt(kscan_mcp23017_expander(dev), 0);
+    }
+
+    return 0;
+}
+
+static int kscan_mcp23017_init_pin(const struct device *dev, const struct kscan_gpio_dt_spec *gpio,
+                                   const gpio_flags_t flags) {
+    if (gpio->port != kscan_mcp23017_expander(dev)) {
+        LOG_ERR("All matrix pins must be on the same expander, found %s", gpio->port->name);
+        return -EINVAL;
+    }
+
+    int err = gpio_pin_configure(gpio->port, gpio->pin, flags | gpio->dt_flags);
+    if (err) {
+        LOG_ERR("Unable to configure pin %u on %s", gpio->pin, gpio->port->name);
+        return err;
+    }
+
+    LOG_DBG("Configured pin %u on %s", gpio->pin, gpio->port->name);
+
+    return 0;
+}
+
+static int kscan_mcp23017_init_inputs(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    struct kscan_mcp23017_data *data = dev->data;
+
+    for (int i = 0; i < config->inputs.len; i++) {
+        const struct kscan_gpio_dt_spec *gpio = &config->inputs.gpios[i];
+        int err = kscan_mcp23017_init_pin(dev, gpio, GPIO_INPUT);
+        if (err) {
+            return err;
+        }
+
+        data->input_mask |= BIT(gpio->pin);
+        if (gpio->dt_flags & GPIO_ACTIVE_LOW) {
+            data->input_active_low |= BIT(gpio->pin);
+        }
+    }
+
+    return 0;
+}
+
+static int kscan_mcp23017_init_outputs(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    struct kscan_mcp23017_data *data = dev->data;
+
+    for (int i = 0; i < config->outputs.len; i++) {
+        const struct kscan_gpio_dt_spec *gpio = &config->outputs.gpios[i];
+        int err = kscan_mcp23017_init_pin(dev, gpio, GPIO_OUTPUT);
+        if (err) {
+            return err;
+        }
+
+        data->output_mask |= BIT(gpio->pin);
+        if (gpio->dt_flags & GPIO_ACTIVE_LOW) {
+            data->outputs_idle |= BIT(gpio->pin);
+        }
+    }
+
+    return 0;
+}
+
+static int kscan_mcp23017_init_interrupt(const struct device *dev) {
+    const struct kscan_mcp23017_config *config = dev->config;
+    struct kscan_mcp23017_data *data = dev->data;
+    const struct kscan_gpio_dt_spec *gpio = &config->interrupt;
+
+    if (!device_is_ready(gpio->port)) {
+        LOG_ERR("GPIO is not ready: %s", gpio->port->name);
+        return -ENODEV;
+    }
+
+    int err = gpio_pin_configure(gpio->port, gpio->pin, GPIO_INPUT | gpio->dt_flags);
+    if (err) {
+        LOG_ERR("Unable to configure interrupt pin %u on %s", gpio->pin, gpio->port->name);
+        return err;
+    }
+
+    gpio_init_callback(&data->irq_callback, kscan_mcp23017_irq_callback_handler, BIT(gpio->pin));
+    err = gpio_add_callback(gpio->port, &data->irq_callback);
+    if (err) {
+        LOG_ERR("Error adding the callback to the interrupt pin: %i", err);
+        return err;
+    }
+
+    return 0;
+}
+
+static int kscan_mcp23017_init(const struct device *dev) {
+    struct kscan_mcp23017_data *data = dev->data;
+    const struct device *expander = kscan_mcp23017_expander(dev);
+
+    data->dev = dev;
+
+    if (!device_is_ready(expander)) {
+        LOG_ERR("Expander is not ready: %s", expander->name);
+        return -ENODEV;
+    }
+
+    kscan_mcp23017_init_inputs(dev);
+    kscan_mcp23017_init_outputs(dev);
+    kscan_mcp23017_set_all_outputs(dev, false);
+
+    if (kscan_mcp23017_use_interrupt(dev)) {
+        kscan_mcp23017_init_interrupt(dev);
+    }
+
+    k_delayed_work_init(&data->work, kscan_mcp23017_work_handler);
+
+    return 0;
+}
+
+static const struct kscan_driver_api kscan_mcp23017_api = {
+    .config = kscan_mcp23017_configure,
+    .enable_callback = kscan_mcp23017_enable,
+    .disable_callback = kscan_mcp23017_disable,
+};
+
+#define KSCAN_MCP23017_INIT(index)                                                                 \
+    BUILD_ASSERT(INST_DEBOUNCE_PRESS_MS(index) <= DEBOUNCE_COUNTER_MAX,                            \
+                 "ZMK_KSCAN_DEBOUNCE_PRESS_MS or debounce-press-ms is too large");                 \
+    BUILD_ASSERT(INST_DEBOUNCE_RELEASE_MS(index) <= DEBOUNCE_COUNTER_MAX,                          \
+                 "ZMK_KSCAN_DEBOUNCE_RELEASE_MS or debounce-release-ms is too large");             \
+                                                                                                   \
+    static const struct kscan_gpio_dt_spec kscan_mcp23017_rows_##index[] = {                       \
+        UTIL_LISTIFY(INST_ROWS_LEN(index), KSCAN_GPIO_ROW_CFG_INIT, index)};                       \
+                                                                                                   \
+    static const struct kscan_gpio_dt_spec kscan_mcp23017_cols_##index[] = {                       \
+        UTIL_LISTIFY(INST_COLS_LEN(index), KSCAN_GPIO_COL_CFG_INIT, index)};                       \
+                                                                                                   \
+    static struct debounce_state kscan_mcp23017_state_##index[INST_MATRIX_LEN(index)];             \
+                                                                                                   \
+    static struct kscan_mcp23017_data kscan_mcp23017_data_##index = {                              \
+        .matrix_state = kscan_mcp23017_state_##index,                                              \
+    };                                                                                             \
+                                                                                                   \
+    static struct kscan_mcp23017_config kscan_mcp23017_config_##index = {                          \
+        .rows = KSCAN_GPIO_LIST(kscan_mcp23017_rows_##index),                                      \
+        .cols = KSCAN_GPIO_LIST(kscan_mcp23017_cols_##index),                                      \
+        .inputs = KSCAN_GPIO_LIST(                                                                 \
+            COND_DIODE_DIR(index, (kscan_mcp23017_cols_##index), (kscan_mcp23017_rows_##index))),  \
+        .outputs = KSCAN_GPIO_LIST(                                                                \
+            COND_DIODE_DIR(index, (kscan_mcp23017_rows_##index), (kscan_mcp23017_cols_##index))),  \
+        .interrupt = COND_CODE_1(                                                                  \
+            INST_HAS_INTERRUPT(index),                                                             \
+            (KSCAN_GPIO_DT_SPEC_GET_BY_IDX(DT_DRV_INST(index), interrupt_gpios, 0)), ({0})),       \
+        .debounce_config =                                                                         \
+            {                                                                                      \
+                .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(index),                                \
+                .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(index),                            \
+            },                                                                                     \
+        .debounce_scan_period_ms = DT_INST_PROP(index, debounce_scan_period_ms),                   \
+        .poll_period_ms = DT_INST_PROP(index, poll_period_ms),                                     \
+        .diode_direction = INST_DIODE_DIR(index),                                                  \
+    };                                                                                             \
+                                                                                                   \
+    DEVICE_DT_INST_DEFINE(index, &kscan_mcp23017_init, device_pm_control_nop,                      \
+                          &kscan_mcp23017_data_##index, &kscan_mcp23017_config_##index,            \
+                          APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY, &kscan_mcp23017_api);
+
+DT_INST_FOREACH_STATUS_OKAY(KSCAN_MCP23017_INIT);
+
+#endif // DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
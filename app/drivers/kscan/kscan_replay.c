@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_kscan_replay
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <device.h>
+#include <drivers/kscan.h>
+#include <logging/log.h>
+
+#include "soc.h"
+#include "cmdline.h"
+
+#include <zmk/kscan.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define REPLAY_NODE_ID DT_DRV_INST(0)
+#define REPLAY_COLS DT_PROP(REPLAY_NODE_ID, columns)
+
+struct kscan_replay_event {
+    uint32_t position;
+    bool pressed;
+    uint64_t timestamp_us;
+};
+
+struct kscan_replay_data {
+    kscan_callback_t callback;
+    const struct device *dev;
+    struct k_delayed_work work;
+
+    FILE *trace;
+    /** Next event read from the trace, valid if has_next is set. */
+    struct kscan_replay_event next;
+    bool has_next;
+    uint32_t line;
+
+    /** Timestamp of the first trace event, replayed at start_ticks. */
+    uint64_t first_timestamp_us;
+    int64_t start_ticks;
+
+    uint32_t event_count;
+    struct timespec wall_start;
+};
+
+static char *trace_file_arg;
+static bool fast_arg;
+
+static void kscan_replay_add_options(void) {
+    static struct args_struct_t replay_options[] = {
+        {.option = "replay-file",
+         .name = "path",
+         .type = 's',
+         .dest = (void *)&trace_file_arg,
+         .descript = "Key event trace to replay, overriding the devicetree trace-file"},
+        {.is_switch = true,
+         .option = "replay-fast",
+         .type = 'b',
+         .dest = (void *)&fast_arg,
+         .descript = "Replay the trace as fast as possible instead of in real time"},
+        ARG_TABLE_ENDMARKER};
+
+    native_add_command_line_opts(replay_options);
+}
+
+NATIVE_TASK(kscan_replay_add_options, PRE_BOOT_1, 10);
+
+static bool kscan_replay_is_fast(void) {
+    return fast_arg || DT_ENUM_IDX(REPLAY_NODE_ID, mode) == 1;
+}
+
+/**
+ * Read the next "<position> <state> <timestamp_us>" line, skipping blank lines
+ * and comments.
+ */
+static bool kscan_replay_read_next(struct kscan_replay_data *data) {
+    char buf[64];
+
+    while (fgets(buf, sizeof(buf), data->trace)) {
+        unsigned long position, state;
+        unsigned long long timestamp;
+
+        data->line++;
+
+        if (buf[0] == '#' || buf[0] == '\n') {
+            continue;
+        }
+
+        if (sscanf(buf, "%lu %lu %llu", &position, &state, &timestamp) != 3) {
+            LOG_WRN("Skipping malformed trace line %d", data->line);
+            continue;
+        }
+
+        data->next = (struct kscan_replay_event){
+            .position = position,
+            .pressed = state != 0,
+            .timestamp_us = timestamp,
+        };
+        return true;
+    }
+
+    return false;
+}
+
+static uint32_t kscan_replay_elapsed_wall_us(const struct kscan_replay_data *data) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - data->wall_start.tv_sec) * USEC_PER_SEC +
+           (now.tv_nsec - data->wall_start.tv_nsec) / NSEC_PER_USEC;
+}
+
+static void kscan_replay_finish(struct kscan_replay_data *data) {
+    struct zmk_kscan_stats stats;
+    const uint32_t elapsed_us = MAX(kscan_replay_elapsed_wall_us(data), 1);
+    const uint32_t simulated_ms = k_ticks_to_ms_floor32(k_uptime_ticks() - data->start_ticks);
+
+    zmk_kscan_get_stats(&stats);
+
+    // Printed directly so the statistics are not lost to deferred logging on exit.
+    printk("replay: %u events in %u us (%u events/s), %u ms simulated\n", data->event_count,
+           elapsed_us, (uint32_t)((uint64_t)data->event_count * USEC_PER_SEC / elapsed_us),
+           simulated_ms);
+    printk("replay: kscan queue high-water %u of %d, %u dropped\n", stats.queue_high_water,
+           CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, stats.dropped);
+
+    fclose(data->trace);
+    data->trace = NULL;
+
+    if (DT_PROP(REPLAY_NODE_ID, exit_after)) {
+        LOG_DBG("Exiting");
+        exit(0);
+    }
+}
+
+static void kscan_replay_schedule_next(struct kscan_replay_data *data) {
+    if (!data->has_next) {
+        kscan_replay_finish(data);
+        return;
+    }
+
+    if (kscan_replay_is_fast()) {
+        k_delayed_work_submit(&data->work, K_NO_WAIT);
+        return;
+    }
+
+    const uint64_t offset_us = data->next.timestamp_us - data->first_timestamp_us;
+
+    k_delayed_work_submit(&data->work,
+                          K_TIMEOUT_ABS_TICKS(data->start_ticks + k_us_to_ticks_ceil64(offset_us)));
+}
+
+static void kscan_replay_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct kscan_replay_data *data = CONTAINER_OF(dwork, struct kscan_replay_data, work);
+    const struct kscan_replay_event ev = data->next;
+
+    data->has_next = kscan_replay_read_next(data);
+    data->event_count++;
+
+    data->callback(data->dev, ev.position / REPLAY_COLS, ev.position % REPLAY_COLS, ev.pressed);
+
+    kscan_replay_schedule_next(data);
+}
+
+static int kscan_replay_configure(const struct device *dev, kscan_callback_t callback) {
+    struct kscan_replay_data *data = dev->data;
+
+    if (!callback) {
+        return -EINVAL;
+    }
+
+    data->callback = callback;
+
+    return 0;
+}
+
+static int kscan_replay_enable_callback(const struct device *dev) {
+    struct kscan_replay_data *data = dev->data;
+    const char *path = trace_file_arg ? trace_file_arg : DT_PROP(REPLAY_NODE_ID, trace_file);
+
+    if (data->trace) {
+        return 0;
+    }
+
+    data->trace = fopen(path, "r");
+    if (!data->trace) {
+        LOG_ERR("Unable to open replay trace %s", log_strdup(path));
+        return -ENOENT;
+    }
+
+    data->line = 0;
+    data->event_count = 0;
+    data->has_next = kscan_replay_read_next(data);
+    data->first_timestamp_us = data->has_next ? data->next.timestamp_us : 0;
+    data->start_ticks = k_uptime_ticks();
+    clock_gettime(CLOCK_MONOTONIC, &data->wall_start);
+
+    kscan_replay_schedule_next(data);
+
+    return 0;
+}
+
+static int kscan_replay_disable_callback(const struct device *dev) {
+    struct kscan_replay_data *data = dev->data;
+
+    k_delayed_work_cancel(&data->work);
+
+    return 0;
+}
+
+static int kscan_replay_init(const struct device *dev) {
+    struct kscan_replay_data *data = dev->data;
+
+    data->dev = dev;
+    k_delayed_work_init(&data->work, kscan_replay_work_handler);
+
+    return 0;
+}
+
+static const struct kscan_driver_api replay_driver_api = {
+    .config = kscan_replay_configure,
+    .enable_callback = kscan_replay_enable_callback,
+    .disable_callback = kscan_replay_disable_callback,
+};
+
+static struct kscan_replay_data kscan_replay_data;
+
+DEVICE_DT_INST_DEFINE(0, kscan_replay_init, device_pm_control_nop, &kscan_replay_data, NULL,
+                      APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &replay_driver_api);
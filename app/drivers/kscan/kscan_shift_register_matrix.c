@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "debounce.h"
+
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/gpio.h>
+#include <drivers/kscan.h>
+#include <drivers/spi.h>
+#include <kernel.h>
+#include <logging/log.h>
+#include <sys/__assert.h>
+#include <sys/util.h>
+#include <string.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define DT_DRV_COMPAT zmk_kscan_shift_register_matrix
+
+#if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
+
+#define INST_ROWS(n) DT_INST_PROP(n, rows)
+#define INST_COLS(n) DT_INST_PROP(n, columns)
+/** Direct wiring is stored as a single row. */
+#define INST_STATE_ROWS(n) MAX(INST_ROWS(n), 1)
+#define INST_MATRIX_LEN(n) (INST_STATE_ROWS(n) * INST_COLS(n))
+
+#define INST_OUTPUT_BYTES(n) ceiling_fraction(INST_ROWS(n), 8)
+#define INST_INPUT_BYTES(n) ceiling_fraction(INST_COLS(n), 8)
+#define INST_XFER_LEN(n) MAX(INST_OUTPUT_BYTES(n), INST_INPUT_BYTES(n))
+
+#if CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS >= 0
+#define INST_DEBOUNCE_PRESS_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_PRESS_MS
+#else
+#define INST_DEBOUNCE_PRESS_MS(n) DT_INST_PROP(n, debounce_press_ms)
+#endif
+
+#if CONFIG_ZMK_KSCAN_DEBOUNCE_RELEASE_MS >= 0
+#define INST_DEBOUNCE_RELEASE_MS(n) CONFIG_ZMK_KSCAN_DEBOUNCE_RELEASE_MS
+#else
+#define INST_DEBOUNCE_RELEASE_MS(n) DT_INST_PROP(n, debounce_release_ms)
+#endif
+
+// TODO (Zephr 2.6): replace kscan_gpio_dt_spec with gpio_dt_spec
+struct kscan_gpio_dt_spec {
+    const struct device *port;
+    gpio_pin_t pin;
+    gpio_dt_flags_t dt_flags;
+};
+
+#define KSCAN_GPIO_DT_SPEC_GET_BY_IDX(node_id, prop, idx)                                          \
+    {                                                                                              \
+        .port = DEVICE_DT_GET(DT_GPIO_CTLR_BY_IDX(node_id, prop, idx)),                            \
+        .pin = DT_GPIO_PIN_BY_IDX(node_id, prop, idx),                                             \
+        .dt_flags = DT_GPIO_FLAGS_BY_IDX(node_id, prop, idx),                                      \
+    }
+
+struct kscan_shift_data {
+    const struct device *dev;
+    const struct device *spi;
+    kscan_callback_t callback;
+    struct k_delayed_work work;
+    /** Timestamp of the current or scheduled scan. */
+    int64_t scan_time;
+    /**
+     * Transmit buffers for each row strobe followed by the idle pattern, each
+     * config->xfer_len bytes long. Kept in RAM so SPI drivers can DMA from them.
+     */
+    uint8_t *strobes;
+    /** Receive buffer of config->xfer_len bytes. */
+    uint8_t *rx_buf;
+    /**
+     * Current state of the matrix as a flattened 2D array of length
+     * (state rows * config->cols)
+     */
+    struct debounce_state *matrix_state;
+};
+
+struct kscan_shift_config {
+    const char *spi_label;
+    struct spi_config spi_config;
+    struct kscan_gpio_dt_spec latch;
+    /** Number of row strobes, or 0 if switches are wired directly to the inputs. */
+    uint16_t rows;
+    uint16_t cols;
+    uint8_t xfer_len;
+    bool outputs_active_low;
+    bool inputs_active_low;
+    struct debounce_config debounce_config;
+    int32_t debounce_scan_period_ms;
+    int32_t poll_period_ms;
+};
+
+/**
+ * Get the index into a matrix state array from a row and column.
+ */
+static int state_index_rc(const struct kscan_shift_config *config, const int row, const int col) {
+    const int rows = MAX(config->rows, 1);
+
+    __ASSERT(row < rows, "Invalid row %i", row);
+    __ASSERT(col < config->cols, "Invalid column %i", col);
+
+    return (col * rows) + row;
+}
+
+/**
+ * Get the transmit buffer which selects the given row. Passing config->rows
+ * returns the buffer with every row deselected.
+ */
+static const uint8_t *kscan_shift_strobe(const struct device *dev, const int row) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+
+    return &data->strobes[row * config->xfer_len];
+}
+
+static int kscan_shift_transfer(const struct device *dev, const uint8_t *tx, uint8_t *rx) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+
+    const struct spi_buf tx_buf = {.buf = (uint8_t *)tx, .len = config->xfer_len};
+    const struct spi_buf_set tx_set = {.buffers = &tx_buf, .count = 1};
+    const struct spi_buf rx_buf = {.buf = rx, .len = config->xfer_len};
+    const struct spi_buf_set rx_set = {.buffers = &rx_buf, .count = 1};
+
+    int err = spi_transceive(data->spi, &config->spi_config, &tx_set, rx ? &rx_set : NULL);
+    if (err) {
+        LOG_ERR("Failed to transfer shift register data: %i", err);
+    }
+
+    return err;
+}
+
+/**
+ * Pulse the latch line. Entering the active level loads the current column
+ * states into the 165s, and leaving it latches the shifted-in strobe onto the
+ * 595 outputs.
+ */
+static int kscan_shift_latch(const struct device *dev) {
+    const struct kscan_shift_config *config = dev->config;
+
+    int err = gpio_pin_set(config->latch.port, config->latch.pin, 1);
+    if (err) {
+        LOG_ERR("Failed to set latch active: %i", err);
+        return err;
+    }
+
+    err = gpio_pin_set(config->latch.port, config->latch.pin, 0);
+    if (err) {
+        LOG_ERR("Failed to set latch inactive: %i", err);
+    }
+
+    return err;
+}
+
+static void kscan_shift_update_row(const struct device *dev, const int row) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+
+    for (int c = 0; c < config->cols; c++) {
+        const int index = state_index_rc(config, row, c);
+        const bool active = ((data->rx_buf[c / 8] & BIT(c % 8)) != 0) != config->inputs_active_low;
+
+        debounce_update(&data->matrix_state[index], active, config->debounce_scan_period_ms,
+                        &config->debounce_config);
+    }
+}
+
+static int kscan_shift_scan(const struct device *dev) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+    int err;
+
+    if (config->rows == 0) {
+        // Directly wired switches only need the inputs captured and shifted out.
+        err = kscan_shift_latch(dev);
+        if (err) {
+            return err;
+        }
+
+        err = kscan_shift_transfer(dev, kscan_shift_strobe(dev, 0), data->rx_buf);
+        if (err) {
+            return err;
+        }
+
+        kscan_shift_update_row(dev, 0);
+        return 0;
+    }
+
+    // Shift in and latch the first strobe.
+    err = kscan_shift_transfer(dev, kscan_shift_strobe(dev, 0), NULL);
+    if (err) {
+        return err;
+    }
+
+    err = kscan_shift_latch(dev);
+    if (err) {
+        return err;
+    }
+
+    for (int o = 0; o <= config->rows; o++) {
+        // Each transfer shifts in the next strobe while shifting out the columns
+        // captured by the previous latch pulse, which belong to the previous row.
+        err = kscan_shift_transfer(dev, kscan_shift_strobe(dev, MIN(o + 1, config->rows)),
+                                   data->rx_buf);
+        if (err) {
+            return err;
+        }
+
+        if (o > 0) {
+            kscan_shift_update_row(dev, o - 1);
+        }
+
+        if (o < config->rows) {
+            // Capture this row's columns and select the next row.
+            err = kscan_shift_latch(dev);
+            if (err) {
+                return err;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void kscan_shift_schedule(const struct device *dev, const int32_t period_ms) {
+    struct kscan_shift_data *data = dev->data;
+
+    data->scan_time += period_ms;
+
+    // TODO (Zephyr 2.6): use k_work_reschedule()
+    k_delayed_work_cancel(&data->work);
+    k_delayed_work_submit(&data->work, K_TIMEOUT_ABS_MS(data->scan_time));
+}
+
+static int kscan_shift_read(const struct device *dev) {
+    struct kscan_shift_data *data = dev->data;
+    const struct kscan_shift_config *config = dev->config;
+    const int rows = MAX(config->rows, 1);
+
+    int err = kscan_shift_scan(dev);
+    if (err) {
+        // Keep polling so a transient bus error doesn't stop the keyboard.
+        kscan_shift_schedule(dev, config->poll_period_ms);
+        return err;
+    }
+
+    // Process the new state.
+    bool continue_scan = false;
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < config->cols; c++) {
+            const int index = state_index_rc(config, r, c);
+            struct debounce_state *state = &data->matrix_state[index];
+
+            if (debounce_get_changed(state)) {
+                const bool pressed = debounce_is_pressed(state);
+
+                LOG_DBG("Sending event at %i,%i state %s", r, c, pressed ? "on" : "off");
+                data->callback(dev, r, c, pressed);
+            }
+
+            continue_scan = continue_scan || debounce_is_active(state);
+        }
+    }
+
+    // Poll quickly while any key is pressed or undecided, otherwise slowly.
+    kscan_shift_schedule(dev, continue_scan ? config->debounce_scan_period_ms
+                                            : config->poll_period_ms);
+
+    return 0;
+}
+
+static void kscan_shift_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct kscan_shift_data *data = CONTAINER_OF(dwork, struct kscan_shift_data, work);
+    kscan_shift_read(data->dev);
+}
+
+static int kscan_shift_configure(const struct device *dev, const kscan_callback_t callback) {
+    struct kscan_shift_data *data = dev->data;
+
+    if (!callback) {
+        return -EINVAL;
+    }
+
+    data->callback = callback;
+    return 0;
+}
+
+static int kscan_shift_enable(const struct device *dev) {
+    struct kscan_shift_data *data = dev->data;
+
+    data->scan_time = k_uptime_get();
+
+    // Read will automatically schedule the next poll once done.
+    return kscan_shift_read(dev);
+}
+
+static int kscan_shift_disable(const struct device *dev) {
+    struct kscan_shift_data *data = dev->data;
+
+    k_delayed_work_cancel(&data->work);
+
+    return 0;
+}
+
+static void kscan_shift_init_strobes(const struct device *dev) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+    const uint8_t idle = config->outputs_active_low ? 0xFF : 0x00;
+
+    for (int r = 0; r <= config->rows; r++) {
+        uint8_t *buf = &data->strobes[r * config->xfer_len];
+
+        memset(buf, idle, config->xfer_len);
+
+        if (r < config->rows) {
+            // The byte for the 595 nearest the MCU is shifted out last.
+            buf[config->xfer_len - 1 - (r / 8)] ^= BIT(r % 8);
+        }
+    }
+}
+
+static int kscan_shift_init(const struct device *dev) {
+    const struct kscan_shift_config *config = dev->config;
+    struct kscan_shift_data *data = dev->data;
+
+    data->dev = dev;
+
+    data->spi = device_get_binding(config->spi_label);
+    if (!data->spi) {
+        LOG_ERR("SPI bus is not ready: %s", config->spi_label);
+        return -ENODEV;
+    }
+
+    if (!device_is_ready(config->latch.port)) {
+        LOG_ERR("GPIO is not ready: %s", config->latch.port->name);
+        return -ENODEV;
+    }
+
+    int err = gpio_pin_configure(config->latch.port, config->latch.pin,
+                                 GPIO_OUTPUT_INACTIVE | config->latch.dt_flags);
+    if (err) {
+        LOG_ERR("Unable to configure latch pin %u on %s", config->latch.pin,
+                config->latch.port->name);
+        return err;
+    }
+
+    kscan_shift_init_strobes(dev);
+
+    k_delayed_work_init(&data->work, kscan_shift_work_handler);
+
+    return 0;
+}
+
+static const struct kscan_driver_api kscan_shift_api = {
+    .config = kscan_shift_configure,
+    .enable_callback = kscan_shift_enable,
+    .disable_callback = kscan_shift_disable,
+};
+
+#define KSCAN_SHIFT_INIT(index)                                                                    \
+    BUILD_ASSERT(INST_DEBOUNCE_PRESS_MS(index) <= DEBOUNCE_COUNTER_MAX,                            \
+                 "ZMK_KSCAN_DEBOUNCE_PRESS_MS or debounce-press-ms is too large");                 \
+    BUILD_ASSERT(INST_DEBOUNCE_RELEASE_MS(index) <= DEBOUNCE_COUNTER_MAX,                          \
+                 "ZMK_KSCAN_DEBOUNCE_RELEASE_MS or debounce-release-ms is too large");             \
+    BUILD_ASSERT(INST_COLS(index) > 0, "columns must be greater than 0");                          \
+    BUILD_ASSERT(INST_XFER_LEN(index) <= UINT8_MAX, "Too many shift registers");                   \
+                                                                                                   \
+    static uint8_t kscan_shift_strobes_##index[(INST_ROWS(index) + 1) * INST_XFER_LEN(index)];     \
+    static uint8_t kscan_shift_rx_##index[INST_XFER_LEN(index)];                                   \
+    static struct debounce_state kscan_shift_state_##index[INST_MATRIX_LEN(index)];                \
+                                                                                                   \
+    static struct kscan_shift_data kscan_shift_data_##index = {                                    \
+        .strobes = kscan_shift_strobes_##index,                                                    \
+        .rx_buf = kscan_shift_rx_##index,                                                          \
+        .matrix_state = kscan_shift_state_##index,                                                 \
+    };                                                                                             \
+                                                                                                   \
+    static const struct kscan_shift_config kscan_shift_config_##index = {                          \
+        .spi_label = DT_INST_BUS_LABEL(index),                                                     \
+        .spi_config =                                                                              \
+            {                                                                                      \
+                .frequency = DT_INST_PROP(index, spi_max_frequency),                               \
+                .operation = SPI_OP_MODE_MASTER | SPI_WORD_SET(8) | SPI_TRANSFER_MSB,              \
+                .slave = DT_INST_REG_ADDR(index),                                                  \
+                .cs = NULL,                                                                        \
+            },                                                                                     \
+        .latch = KSCAN_GPIO_DT_SPEC_GET_BY_IDX(DT_DRV_INST(index), latch_gpios, 0),                \
+        .rows = INST_ROWS(index),                                                                  \
+        .cols = INST_COLS(index),                                                                  \
+        .xfer_len = INST_XFER_LEN(index),                                                          \
+        .outputs_active_low = DT_INST_PROP(index, outputs_active_low),                             \
+        .inputs_active_low = DT_INST_PROP(index, inputs_active_low),                               \
+        .debounce_config =                                                                         \
+            {                                                                                      \
+                .debounce_press_ms = INST_DEBOUNCE_PRESS_MS(index),                                \
+                .debounce_release_ms = INST_DEBOUNCE_RELEASE_MS(index),                            \
+            },                                                                                     \
+        .debounce_scan_period_ms = DT_INST_PROP(index, debounce_scan_period_ms),                   \
+        .poll_period_ms = DT_INST_PROP(index, poll_period_ms),                                     \
+    };                                                                                             \
+                                                                                                   \
+    DEVICE_DT_INST_DEFINE(index, &kscan_shift_init, device_pm_control_nop,                         \
+                          &kscan_shift_data_##index, &kscan_shift_config_##index, APPLICATION,     \
+                          CONFIG_APPLICATION_INIT_PRIORITY, &kscan_shift_api);
+
+DT_INST_FOREACH_STATUS_OKAY(KSCAN_SHIFT_INIT);
+
+#endif // DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
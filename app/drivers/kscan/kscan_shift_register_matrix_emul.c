@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * @file Emulator for the shift register chains of a zmk,kscan-shift-register-matrix.
+ *
+ * The zmk,shift-register-emul node provides the latch GPIO and presses the switches. Pulling the
+ * latch low loads the 165s with the columns of every row the 595 outputs select, and releasing it
+ * latches the 595 shift register onto the outputs. Every transfer and latch pulse is logged, so
+ * tests can check the sequence the driver sends.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <device.h>
+#include <devicetree.h>
+#include <drivers/emul.h>
+#include <drivers/gpio.h>
+#include <drivers/spi.h>
+#include <drivers/spi_emul.h>
+#include <kernel.h>
+#include <logging/log.h>
+#include <sys/util.h>
+
+#include <dt-bindings/zmk/kscan_mock.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#define SHIFT_REGISTER_EMUL_MAX_ROWS 32
+#define SHIFT_REGISTER_EMUL_MAX_COLS 32
+
+struct shift_register_emul_chain_cfg;
+
+struct shift_register_emul_chain {
+    struct spi_emul emul;
+    const struct shift_register_emul_chain_cfg *cfg;
+    /* 595 shift register, with the byte for the 595 nearest the MCU last */
+    uint8_t *shift;
+    /* 595 outputs, in the same order as the shift register */
+    uint8_t *outputs;
+    /* 165 shift register, with the byte for the 165 nearest the MCU first */
+    uint8_t *inputs;
+};
+
+struct shift_register_emul_chain_cfg {
+    struct shift_register_emul_chain *chain;
+    const struct device *board;
+    uint16_t chipsel;
+    uint16_t rows;
+    uint16_t cols;
+    uint8_t xfer_len;
+    bool outputs_active_low;
+    bool inputs_active_low;
+};
+
+struct shift_register_emul_data {
+    /* gpio_driver_data needs to be first */
+    struct gpio_driver_data common;
+    const struct device *dev;
+    struct k_delayed_work work;
+    uint32_t event_index;
+    /* Physical level of the latch pin */
+    bool latch;
+    /* Pressed switches, one bit per column for each row */
+    uint32_t pressed[SHIFT_REGISTER_EMUL_MAX_ROWS];
+    /* Chain of the matrix whose latch pin is this node */
+    struct shift_register_emul_chain *chain;
+};
+
+struct shift_register_emul_config {
+    /* gpio_driver_config needs to be first */
+    struct gpio_driver_config common;
+    const uint32_t *events;
+    size_t events_len;
+};
+
+static void shift_register_emul_hex(char *buf, const size_t size, const uint8_t *bytes,
+                                    const size_t len) {
+    size_t pos = 0;
+
+    buf[0] = '\0';
+    for (size_t i = 0; i < len && pos < size; i++) {
+        pos += snprintf(&buf[pos], size - pos, "%02x", bytes[i]);
+    }
+}
+
+static bool shift_register_emul_row_selected(const struct shift_register_emul_chain *chain,
+                                             const int row) {
+    const struct shift_register_emul_chain_cfg *cfg = chain->cfg;
+    const bool high = (chain->outputs[cfg->xfer_len - 1 - (row / 8)] & BIT(row % 8)) != 0;
+
+    return high != cfg->outputs_active_low;
+}
+
+static void shift_register_emul_load(struct shift_register_emul_chain *chain,
+                                     const uint32_t *pressed) {
+    const struct shift_register_emul_chain_cfg *cfg = chain->cfg;
+
+    memset(chain->inputs, cfg->inputs_active_low ? 0xFF : 0x00, cfg->xfer_len);
+
+    for (int c = 0; c < cfg->cols; c++) {
+        bool active = cfg->rows == 0 && (pressed[0] & BIT(c));
+
+        for (int r = 0; r < cfg->rows && !active; r++) {
+            active = shift_register_emul_row_selected(chain, r) && (pressed[r] & BIT(c));
+        }
+
+        if (active) {
+            chain->inputs[c / 8] ^= BIT(c % 8);
+        }
+    }
+}
+
+static void shift_register_emul_latch(struct shift_register_emul_chain *chain,
+                                      const uint32_t *pressed, const bool level) {
+    const struct shift_register_emul_chain_cfg *cfg = chain->cfg;
+    char hex[2 * UINT8_MAX + 1];
+
+    if (!level) {
+        // The 165s load while SH/LD is low.
+        shift_register_emul_load(chain, pressed);
+        shift_register_emul_hex(hex, sizeof(hex), chain->inputs, cfg->xfer_len);
+        LOG_DBG("load %s", log_strdup(hex));
+    } else if (cfg->rows > 0) {
+        // The 595s latch on the rising RCLK edge. Direct wiring has no 595s.
+        memcpy(chain->outputs, chain->shift, cfg->xfer_len);
+        shift_register_emul_hex(hex, sizeof(hex), chain->outputs, cfg->xfer_len);
+        LOG_DBG("latch %s", log_strdup(hex));
+    }
+}
+
+static int shift_register_emul_io(struct spi_emul *emul, const struct spi_config *config,
+                                  const struct spi_buf_set *tx_bufs,
+                                  const struct spi_buf_set *rx_bufs) {
+    struct shift_register_emul_chain *chain =
+        CONTAINER_OF(emul, struct shift_register_emul_chain, emul);
+    const struct shift_register_emul_chain_cfg *cfg = chain->cfg;
+    char tx_hex[2 * UINT8_MAX + 1];
+    char rx_hex[2 * UINT8_MAX + 1];
+
+    if (!tx_bufs || tx_bufs->count != 1 || (rx_bufs && rx_bufs->count != 1)) {
+        LOG_ERR("Only transfers of a single buffer are emulated");
+        return -ENOTSUP;
+    }
+
+    const struct spi_buf *tx = &tx_bufs->buffers[0];
+    const struct spi_buf *rx = rx_bufs ? &rx_bufs->buffers[0] : NULL;
+
+    if (rx && rx->len != tx->len) {
+        LOG_ERR("Transmit and receive buffers differ in length");
+        return -EINVAL;
+    }
+
+    shift_register_emul_hex(tx_hex, sizeof(tx_hex), tx->buf, tx->len);
+
+    for (size_t i = 0; i < tx->len; i++) {
+        // MISO is the output of the 165 nearest the MCU, and the serial input of the last 165 is
+        // grounded. MOSI feeds the 595 nearest the MCU.
+        const uint8_t out = chain->inputs[0];
+
+        memmove(&chain->inputs[0], &chain->inputs[1], cfg->xfer_len - 1);
+        chain->inputs[cfg->xfer_len - 1] = 0;
+
+        memmove(&chain->shift[0], &chain->shift[1], cfg->xfer_len - 1);
+        chain->shift[cfg->xfer_len - 1] = ((const uint8_t *)tx->buf)[i];
+
+        if (rx) {
+            ((uint8_t *)rx->buf)[i] = out;
+        }
+    }
+
+    if (rx) {
+        shift_register_emul_hex(rx_hex, sizeof(rx_hex), rx->buf, rx->len);
+        LOG_DBG("tx %s rx %s", log_strdup(tx_hex), log_strdup(rx_hex));
+    } else {
+        LOG_DBG("tx %s", log_strdup(tx_hex));
+    }
+
+    return 0;
+}
+
+static const struct spi_emul_api shift_register_emul_api = {
+    .io = shift_register_emul_io,
+};
+
+#define DT_DRV_COMPAT zmk_shift_register_emul
+
+static void shift_register_emul_set_latch(const struct device *dev, const bool level) {
+    struct shift_register_emul_data *data = dev->data;
+
+    if (level == data->latch) {
+        return;
+    }
+
+    data->latch = level;
+
+    if (data->chain) {
+        shift_register_emul_latch(data->chain, data->pressed, level);
+    }
+}
+
+static int shift_register_emul_pin_configure(const struct device *dev, gpio_pin_t pin,
+                                             gpio_flags_t flags) {
+    if (pin != 0) {
+        return -EINVAL;
+    }
+
+    if ((flags & GPIO_OUTPUT) == 0) {
+        return -ENOTSUP;
+    }
+
+    if (flags & GPIO_OUTPUT_INIT_HIGH) {
+        shift_register_emul_set_latch(dev, true);
+    } else if (flags & GPIO_OUTPUT_INIT_LOW) {
+        shift_register_emul_set_latch(dev, false);
+    }
+
+    return 0;
+}
+
+static int shift_register_emul_port_get_raw(const struct device *dev, gpio_port_value_t *value) {
+    struct shift_register_emul_data *data = dev->data;
+
+    *value = data->latch ? BIT(0) : 0;
+    return 0;
+}
+
+static int shift_register_emul_port_set_masked_raw(const struct device *dev,
+                                                   gpio_port_pins_t mask,
+                                                   gpio_port_value_t value) {
+    if (mask & BIT(0)) {
+        shift_register_emul_set_latch(dev, (value & BIT(0)) != 0);
+    }
+    return 0;
+}
+
+static int shift_register_emul_port_set_bits_raw(const struct device *dev, gpio_port_pins_t pins) {
+    return shift_register_emul_port_set_masked_raw(dev, pins, pins);
+}
+
+static int shift_register_emul_port_clear_bits_raw(const struct device *dev,
+                                                   gpio_port_pins_t pins) {
+    return shift_register_emul_port_set_masked_raw(dev, pins, 0);
+}
+
+static int shift_register_emul_port_toggle_bits(const struct device *dev, gpio_port_pins_t pins) {
+    struct shift_register_emul_data *data = dev->data;
+
+    return shift_register_emul_port_set_masked_raw(dev, pins, data->latch ? 0 : BIT(0));
+}
+
+static int shift_register_emul_pin_interrupt_configure(const struct device *dev, gpio_pin_t pin,
+                                                       enum gpio_int_mode mode,
+                                                       enum gpio_int_trig trig) {
+    return -ENOTSUP;
+}
+
+static const struct gpio_driver_api shift_register_emul_gpio_api = {
+    .pin_configure = shift_register_emul_pin_configure,
+    .port_get_raw = shift_register_emul_port_get_raw,
+    .port_set_masked_raw = shift_register_emul_port_set_masked_raw,
+    .port_set_bits_raw = shift_register_emul_port_set_bits_raw,
+    .port_clear_bits_raw = shift_register_emul_port_clear_bits_raw,
+    .port_toggle_bits = shift_register_emul_port_toggle_bits,
+    .pin_interrupt_configure = shift_register_emul_pin_interrupt_configure,
+};
+
+static void shift_register_emul_schedule_next_event(const struct device *dev) {
+    struct shift_register_emul_data *data = dev->data;
+    const struct shift_register_emul_config *config = dev->config;
+
+    if (data->event_index < config->events_len) {
+        const uint32_t ev = config->events[data->event_index];
+
+        k_delayed_work_submit(&data->work, K_MSEC(ZMK_MOCK_MSEC(ev)));
+    }
+}
+
+static void shift_register_emul_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct shift_register_emul_data *data =
+        CONTAINER_OF(dwork, struct shift_register_emul_data, work);
+    const struct shift_register_emul_config *config = data->dev->config;
+    const uint32_t ev = config->events[data->event_index++];
+    const int row = ZMK_MOCK_ROW(ev);
+    const int col = ZMK_MOCK_COL(ev);
+
+    if (row < SHIFT_REGISTER_EMUL_MAX_ROWS && col < SHIFT_REGISTER_EMUL_MAX_COLS) {
+        LOG_DBG("Switch %d,%d %s", row, col, ZMK_MOCK_IS_PRESS(ev) ? "pressed" : "released");
+        WRITE_BIT(data->pressed[row], col, ZMK_MOCK_IS_PRESS(ev));
+    } else {
+        LOG_ERR("No emulated switch at %d,%d", row, col);
+    }
+
+    shift_register_emul_schedule_next_event(data->dev);
+}
+
+static int shift_register_emul_init(const struct device *dev) {
+    struct shift_register_emul_data *data = dev->data;
+
+    data->dev = dev;
+    // SH/LD and RCLK idle high, so configuring the pin as inactive is not a pulse.
+    data->latch = true;
+    k_delayed_work_init(&data->work, shift_register_emul_work_handler);
+    shift_register_emul_schedule_next_event(dev);
+
+    return 0;
+}
+
+#define SHIFT_REGISTER_EMUL_INIT(n)                                                                \
+    static const uint32_t shift_register_emul_events_##n[] = DT_INST_PROP(n, events);              \
+    static struct shift_register_emul_data shift_register_emul_data_##n;                           \
+    static const struct shift_register_emul_config shift_register_emul_config_##n = {              \
+        .common = {.port_pin_mask = GPIO_PORT_PIN_MASK_FROM_DT_INST(n)},                           \
+        .events = shift_register_emul_events_##n,                                                  \
+        .events_len = DT_INST_PROP_LEN(n, events),                                                 \
+    };                                                                                             \
+    DEVICE_DT_INST_DEFINE(n, shift_register_emul_init, device_pm_control_nop,                      \
+                          &shift_register_emul_data_##n, &shift_register_emul_config_##n,          \
+                          POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEVICE,                         \
+                          &shift_register_emul_gpio_api);
+
+DT_INST_FOREACH_STATUS_OKAY(SHIFT_REGISTER_EMUL_INIT)
+
+#undef DT_DRV_COMPAT
+#define DT_DRV_COMPAT zmk_kscan_shift_register_matrix
+
+static int shift_register_emul_chain_init(const struct emul *emul, const struct device *parent) {
+    const struct shift_register_emul_chain_cfg *cfg = emul->cfg;
+    struct shift_register_emul_chain *chain = cfg->chain;
+    struct shift_register_emul_data *board = cfg->board->data;
+
+    // Power-on state, with every 595 output low.
+    memset(chain->shift, 0, cfg->xfer_len);
+    memset(chain->outputs, 0, cfg->xfer_len);
+    memset(chain->inputs, cfg->inputs_active_low ? 0xFF : 0x00, cfg->xfer_len);
+
+    chain->cfg = cfg;
+    chain->emul.api = &shift_register_emul_api;
+    chain->emul.chipsel = cfg->chipsel;
+    board->chain = chain;
+
+    return spi_emul_register(parent, emul->dev_label, &chain->emul);
+}
+
+#define INST_XFER_LEN(n)                                                                           \
+    MAX(ceiling_fraction(DT_INST_PROP(n, rows), 8), ceiling_fraction(DT_INST_PROP(n, columns), 8))
+
+#define SHIFT_REGISTER_EMUL_CHAIN(n)                                                               \
+    BUILD_ASSERT(DT_INST_PROP(n, rows) <= SHIFT_REGISTER_EMUL_MAX_ROWS, "Too many emulated rows"); \
+    BUILD_ASSERT(DT_INST_PROP(n, columns) <= SHIFT_REGISTER_EMUL_MAX_COLS,                         \
+                 "Too many emulated columns");                                                     \
+                                                                                                   \
+    static uint8_t shift_register_emul_shift_##n[INST_XFER_LEN(n)];                                \
+    static uint8_t shift_register_emul_outputs_##n[INST_XFER_LEN(n)];                              \
+    static uint8_t shift_register_emul_inputs_##n[INST_XFER_LEN(n)];                               \
+                                                                                                   \
+    static struct shift_register_emul_chain shift_register_emul_chain_##n = {                      \
+        .shift = shift_register_emul_shift_##n,                                                    \
+        .outputs = shift_register_emul_outputs_##n,                                                \
+        .inputs = shift_register_emul_inputs_##n,                                                  \
+    };                                                                                             \
+                                                                                                   \
+    static const struct shift_register_emul_chain_cfg shift_register_emul_chain_cfg_##n = {        \
+        .chain = &shift_register_emul_chain_##n,                                                   \
+        .board = DEVICE_DT_GET(DT_GPIO_CTLR_BY_IDX(DT_DRV_INST(n), latch_gpios, 0)),               \
+        .chipsel = DT_INST_REG_ADDR(n),                                                            \
+        .rows = DT_INST_PROP(n, rows),                                                             \
+        .cols = DT_INST_PROP(n, columns),                                                          \
+        .xfer_len = INST_XFER_LEN(n),                                                              \
+        .outputs_active_low = DT_INST_PROP(n, outputs_active_low),                                 \
+        .inputs_active_low = DT_INST_PROP(n, inputs_active_low),                                   \
+    };                                                                                             \
+                                                                                                   \
+    EMUL_DEFINE(shift_register_emul_chain_init, DT_DRV_INST(n),                                    \
+                &shift_register_emul_chain_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(SHIFT_REGISTER_EMUL_CHAIN)
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/util.h>
+
+/** The moment at which a hold-tap was decided. */
+enum zmk_behavior_hold_tap_moment {
+    ZMK_BHV_HOLD_TAP_MOMENT_KEY_UP,
+    ZMK_BHV_HOLD_TAP_MOMENT_OTHER_KEY_DOWN,
+    ZMK_BHV_HOLD_TAP_MOMENT_OTHER_KEY_UP,
+    ZMK_BHV_HOLD_TAP_MOMENT_TIMER,
+    ZMK_BHV_HOLD_TAP_MOMENT_QUICK_TAP,
+    ZMK_BHV_HOLD_TAP_MOMENT_PRIOR_IDLE,
+    ZMK_BHV_HOLD_TAP_MOMENT_COUNT,
+};
+
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+
+struct zmk_behavior_hold_tap_latency {
+    // decisions, by the moment they were made
+    uint32_t moments[ZMK_BHV_HOLD_TAP_MOMENT_COUNT];
+    // decisions, by time from key-down to decision in buckets of
+    // CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKET_MS. The last bucket also counts longer delays.
+    uint32_t histogram[CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKETS];
+};
+
+#endif
+
+struct zmk_behavior_hold_tap_stats {
+    uint32_t taps;
+    uint32_t hold_interrupts;
+    uint32_t hold_timers;
+    // taps decided at key-down because the require-prior-idle-ms period was not met
+    uint32_t prior_idle_taps;
+    // timed holds turned into a tap by retro-tap
+    uint32_t retro_taps;
+    // time from hold-tap key-down until it was decided, summed over all decisions
+    uint64_t total_decision_delay_ms;
+    uint32_t max_decision_delay_ms;
+    // events held back until the hold-tap was decided, and for how long
+    uint32_t captured_events;
+    uint64_t total_capture_delay_ms;
+    uint32_t max_capture_delay_ms;
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+    struct zmk_behavior_hold_tap_latency latency;
+#endif
+};
+
+/**
+ * Get the decision statistics of the hold-tap behavior with the given label.
+ * Returns -ENODEV if it is not a hold-tap behavior.
+ */
+int zmk_behavior_hold_tap_get_stats(const char *behavior_dev,
+                                    struct zmk_behavior_hold_tap_stats *stats);
+
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+
+/**
+ * Get the decision latency of the hold-tap behavior with the given label, for presses of a
+ * single key position. Returns -ENODEV if it is not a hold-tap behavior, or -EINVAL if the
+ * position is not part of the keymap.
+ */
+int zmk_behavior_hold_tap_get_position_latency(const char *behavior_dev, uint32_t position,
+                                               struct zmk_behavior_hold_tap_latency *latency);
+
+#endif
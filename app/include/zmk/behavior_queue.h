@@ -7,8 +7,66 @@
 #pragma once
 
 #include <kernel.h>
+#include <device.h>
 #include <stdint.h>
+#include <sys/slist.h>
 #include <zmk/behavior.h>
+#include <zmk/behavior_timer.h>
 
-int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding behavior,
+/**
+ * Pressing or releasing a behavior, followed by a wait in milliseconds. A paced step waits at least
+ * CONFIG_ZMK_BEHAVIORS_QUEUE_PACED_MIN_MS, and until the reports it caused have been sent.
+ */
+struct zmk_behavior_queue_step {
+    const struct zmk_behavior_binding *binding;
+    // the binding's behavior, if already resolved, so it is not looked up by its label.
+    const struct device *behavior;
+    bool press;
+    bool paced;
+    uint32_t wait;
+};
+
+struct zmk_behavior_queue_stream;
+
+/**
+ * Fill in the next step of the stream. Returns false once the stream has finished. The binding
+ * must stay valid until the step has been invoked.
+ */
+typedef bool (*zmk_behavior_queue_next_t)(struct zmk_behavior_queue_stream *stream,
+                                          struct zmk_behavior_queue_step *step);
+
+/**
+ * A sequence of queued behaviors, e.g. one macro invocation. Steps are pulled from the stream one
+ * at a time, so a stream is not limited in length.
+ *
+ * With CONFIG_ZMK_BEHAVIORS_QUEUE_SERIALIZE, a stream only runs once all streams started before it
+ * have finished. With CONFIG_ZMK_BEHAVIORS_QUEUE_INTERLEAVE, streams run at the same time, each
+ * waiting on its own timer.
+ */
+struct zmk_behavior_queue_stream {
+    zmk_behavior_queue_next_t next;
+    uint32_t position;
+    bool running;
+    struct zmk_behavior_timer timer;
+    sys_snode_t node;
+    // set while a paced step waits for the transport, see struct zmk_behavior_queue_step.
+    bool waiting_for_reports;
+    int64_t paced_until;
+    sys_snode_t waiting_node;
+};
+
+void zmk_behavior_queue_stream_init(struct zmk_behavior_queue_stream *stream,
+                                    zmk_behavior_queue_next_t next);
+
+/** Start running the stream. Returns -EBUSY if it is already running. */
+int zmk_behavior_queue_stream_start(struct zmk_behavior_queue_stream *stream, uint32_t position);
+
+/**
+ * Queue pressing or releasing a behavior, followed by a wait in milliseconds. All behaviors added
+ * this way share one stream, which holds up to CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE steps.
+ *
+ * Only a pointer to the binding is queued, so it must stay valid until it has been invoked, e.g.
+ * by pointing into the static config of a behavior.
+ */
+int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding *binding,
                            bool press, uint32_t wait);
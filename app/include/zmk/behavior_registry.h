@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/slist.h>
+#include <sys/util.h>
+#include <zmk/matrix.h>
+
+/**
+ * The active instances of a stateful behavior, e.g. its held keys, each keyed by the position
+ * which activated it. Slots are typed by the behavior, see ZMK_BEHAVIOR_REGISTRY_DEFINE.
+ *
+ * Keymap positions are found through an index. Positions past the end of the keymap, like the
+ * virtual positions of combos, are found by scanning the active slots.
+ */
+struct zmk_behavior_registry {
+    const char *name;
+    void *slots;
+    size_t slot_size;
+    uint8_t slot_count;
+    // bit n is set while slot n is in use.
+    uint32_t active;
+    uint32_t *positions;
+    // one past the slot active for each keymap position, 0 if there is none.
+    uint8_t *index;
+    sys_snode_t node;
+};
+
+/**
+ * Define a registry with count slots of type. The slots are the array name##_slots, so a behavior
+ * can also address them directly, e.g. to initialize their timers.
+ */
+#define ZMK_BEHAVIOR_REGISTRY_DEFINE(name, type, count)                                            \
+    BUILD_ASSERT((count) > 0 && (count) <= 32, "A behavior registry holds 1 to 32 slots");         \
+    static type name##_slots[count];                                                               \
+    static uint32_t name##_positions[count];                                                       \
+    static uint8_t name##_index[ZMK_KEYMAP_LEN];                                                   \
+    static struct zmk_behavior_registry name = {.name = #name,                                     \
+                                                .slots = name##_slots,                             \
+                                                .slot_size = sizeof(type),                         \
+                                                .slot_count = (count),                             \
+                                                .positions = name##_positions,                     \
+                                                .index = name##_index}
+
+/** Make the registry part of zmk_behavior_registry_log_active. */
+void zmk_behavior_registry_init(struct zmk_behavior_registry *registry);
+
+/** Take the first free slot for position. Returns NULL if all slots are in use. */
+void *zmk_behavior_registry_alloc(struct zmk_behavior_registry *registry, uint32_t position);
+
+void zmk_behavior_registry_free(struct zmk_behavior_registry *registry, void *slot);
+
+/** Return the slot active for position, or NULL if there is none. */
+void *zmk_behavior_registry_find(const struct zmk_behavior_registry *registry, uint32_t position);
+
+bool zmk_behavior_registry_is_active(const struct zmk_behavior_registry *registry,
+                                     const void *slot);
+
+static inline bool zmk_behavior_registry_is_empty(const struct zmk_behavior_registry *registry) {
+    return registry->active == 0;
+}
+
+/**
+ * Return the first active slot after the given one, in slot order, or the first active slot if
+ * slot is NULL. Slots may be freed while iterating.
+ */
+void *zmk_behavior_registry_next(const struct zmk_behavior_registry *registry, const void *slot);
+
+/** Log the active slots of every registry, and the position of each. */
+void zmk_behavior_registry_log_active();
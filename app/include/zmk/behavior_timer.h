@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <kernel.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct zmk_behavior_timer;
+
+typedef void (*zmk_behavior_timer_handler_t)(struct zmk_behavior_timer *timer);
+
+/**
+ * A behavior timeout. All behavior timers share a single kernel timer, and their handlers are
+ * invoked on the system work queue in deadline order. Timers with the same deadline fire in the
+ * order they were started.
+ *
+ * Timers must only be started and stopped from the system work queue, so a stopped timer never
+ * fires afterwards.
+ */
+struct zmk_behavior_timer {
+    zmk_behavior_timer_handler_t handler;
+    // uptime in milliseconds at which the handler is invoked
+    int64_t deadline;
+    uint32_t sequence;
+    // one past the position in the deadline queue, 0 if the timer is not running
+    uint16_t slot;
+};
+
+void zmk_behavior_timer_init(struct zmk_behavior_timer *timer,
+                             zmk_behavior_timer_handler_t handler);
+
+/**
+ * Start the timer, or move its deadline if it is already running. A deadline in the past fires
+ * as soon as possible.
+ */
+int zmk_behavior_timer_start(struct zmk_behavior_timer *timer, int64_t deadline);
+
+/** Stop the timer. Returns true if it was running. */
+bool zmk_behavior_timer_stop(struct zmk_behavior_timer *timer);
+
+static inline bool zmk_behavior_timer_is_running(const struct zmk_behavior_timer *timer) {
+    return timer->slot != 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zmk/behavior.h>
+
+/*
+ * The outputs of all chords are a table of bindings. A binding with a NULL behavior_dev stands
+ * for the param1th binding of the zmk,chords node.
+ */
+
+struct zmk_chord_entry {
+    /** Bitset of indices into the key-positions of the zmk,chords node, 0 for an empty slot. */
+    uint32_t chord;
+    uint32_t output_offset : 24;
+    uint32_t output_len : 8;
+};
@@ -13,3 +13,12 @@ int zmk_endpoints_toggle();
 enum zmk_endpoint zmk_endpoints_selected();
 
 int zmk_endpoints_send_report(uint16_t usage_page);
+
+/**
+ * Called by the transports once they have sent a report to the host, from any context. Raises
+ * zmk_endpoint_reports_sent once no more reports are in flight.
+ */
+void zmk_endpoints_report_sent();
+
+/** Number of reports handed to the transports which they have not sent yet. */
+int zmk_endpoints_reports_in_flight();
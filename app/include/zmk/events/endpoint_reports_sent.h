@@ -0,0 +1,18 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <zephyr.h>
+
+#include <zmk/event_manager.h>
+
+/** Raised once the transport has sent every report handed to it so far. */
+struct zmk_endpoint_reports_sent {
+    int64_t timestamp;
+};
+
+ZMK_EVENT_DECLARE(zmk_endpoint_reports_sent);
@@ -6,4 +6,24 @@
 
 #pragma once
 
+#include <zephyr/types.h>
+#include <drivers/kscan.h>
+
+struct zmk_kscan_stats {
+    /** Most events waiting in the kscan event queue at once. */
+    uint32_t queue_high_water;
+    /** Events dropped because the kscan event queue was full. */
+    uint32_t dropped;
+};
+
 int zmk_kscan_init(char *name);
+
+/**
+ * Report a change to a kscan callback, for drivers which forward changes some time after they
+ * saw them. If the callback is ZMK's own, the change keeps the given uptime as its timestamp
+ * instead of being stamped on arrival.
+ */
+void zmk_kscan_forward(kscan_callback_t callback, const struct device *dev, uint32_t row,
+                       uint32_t column, bool pressed, int64_t timestamp);
+
+void zmk_kscan_get_stats(struct zmk_kscan_stats *stats);
@@ -0,0 +1,27 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * The leader key sequences are compiled into a trie by app/scripts/leader_trie.py. Node 0 is the
+ * root, and the edges leaving a node are contiguous and sorted by key.
+ */
+
+struct zmk_leader_node {
+    uint16_t first_edge;
+    uint8_t edge_count;
+    /** Index of the sequence ending at this node, or -1 if none does. */
+    int16_t sequence;
+};
+
+struct zmk_leader_edge {
+    /** Encoded keycode, as taken by &kp. */
+    uint32_t key;
+    uint16_t node;
+};
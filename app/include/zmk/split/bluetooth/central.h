@@ -1,8 +1,15 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
 
 #pragma once
 
-#include <bluetooth/addr.h>
-#include <zmk/behavior.h>
+#include <stdbool.h>
 
-int zmk_split_bt_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
-                                 struct zmk_behavior_binding_event event, bool state);
\ No newline at end of file
+/**
+ * Returns true if a connected peripheral has its clock synchronized, so its position events carry
+ * the time they happened rather than the time they arrived.
+ */
+bool zmk_split_bt_central_clock_synced();
@@ -6,23 +6,16 @@
 
 #pragma once
 
-#include <drivers/sensor.h>
+#include <stdint.h>
+#include <zmk/split/messages.h>
 
-#define ZMK_SPLIT_RUN_BEHAVIOR_DEV_LEN 9
-
-struct zmk_split_run_behavior_data {
-    uint8_t position;
-    uint8_t state;
-    uint32_t param1;
-    uint32_t param2;
-} __packed;
+/*
+ * The peripheral's behaviors characteristic lists its behavior IDs. Position events are notified
+ * from the position state characteristic, and reading it returns the full state. The number of
+ * positions is read from the number of digitals descriptor.
+ */
 
-struct zmk_split_run_behavior_payload {
-    struct zmk_split_run_behavior_data data;
-    char behavior_dev[ZMK_SPLIT_RUN_BEHAVIOR_DEV_LEN];
+/** Read from the clock characteristic, to map peripheral timestamps to the central's clock. */
+struct zmk_split_clock {
+    uint64_t uptime_us;
 } __packed;
-
-
-int zmk_split_bt_position_pressed(uint8_t position);
-int zmk_split_bt_position_released(uint8_t position);
-int zmk_split_bt_sensor_triggered(uint8_t sensor_number, struct sensor_value value);
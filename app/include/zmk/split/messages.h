@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/util.h>
+#include <drivers/sensor.h>
+
+/*
+ * Messages exchanged by the halves of a split keyboard, whichever transport carries them.
+ */
+
+/*
+ * The peripheral lists the IDs of its behaviors, sorted. The central reads the list once connected
+ * and runs a behavior by its index in it, so the peripheral never parses or looks up a behavior
+ * label.
+ */
+
+/** The ID of a behavior, a 32 bit FNV-1a hash of its label. */
+static inline uint32_t zmk_split_behavior_id(const char *label) {
+    uint32_t hash = 0x811c9dc5;
+    for (; *label != '\0'; label++) {
+        hash = (hash ^ (uint8_t)*label) * 0x01000193;
+    }
+    return hash;
+}
+
+/** Index of id in a sorted list of behavior IDs, or -ENOENT. */
+static inline int zmk_split_behavior_index(const uint32_t *ids, int count, uint32_t id) {
+    int low = 0;
+    int high = count - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (ids[mid] == id) {
+            return mid;
+        } else if (ids[mid] < id) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return -ENOENT;
+}
+
+struct zmk_split_run_behavior_payload {
+    /** Index of the behavior in the peripheral's list of behaviors. */
+    uint8_t behavior;
+    uint16_t position;
+    uint8_t state;
+    uint32_t param1;
+    uint32_t param2;
+} __packed;
+
+/*
+ * Position changes are sent as numbered events, several to a message. The full state, one bit per
+ * position of the peripheral, is read instead when the central misses events.
+ */
+
+#define ZMK_SPLIT_POSITION_PROTOCOL_VERSION 3
+
+#define ZMK_SPLIT_POSITION_MAX 0x7FFF
+#define ZMK_SPLIT_POSITION_PRESSED BIT(15)
+
+struct zmk_split_position_event {
+    /** The position in the low 15 bits, and ZMK_SPLIT_POSITION_PRESSED for a press. */
+    uint16_t position;
+    /** Milliseconds since the previous event, saturated at UINT16_MAX. */
+    uint16_t delta_ms;
+} __packed;
+
+struct zmk_split_position_events {
+    uint8_t version;
+    /** Sequence number of the first event, the others follow consecutively. */
+    uint8_t sequence;
+    uint8_t count;
+    /** Peripheral uptime in milliseconds of the last event, truncated to 32 bits. */
+    uint32_t timestamp;
+    struct zmk_split_position_event events[];
+} __packed;
+
+struct zmk_split_position_state {
+    uint8_t version;
+    /** Sequence number of the next event, the state includes every event before it. */
+    uint8_t sequence;
+    uint8_t state[];
+} __packed;
+
+struct zmk_split_sensor_event {
+    uint8_t sensor_number;
+    struct sensor_value value;
+} __packed;
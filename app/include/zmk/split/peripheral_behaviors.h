@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <zmk/split/messages.h>
+
+/**
+ * The sorted IDs of the behaviors the central can run on this peripheral.
+ *
+ * @return the number of IDs
+ */
+uint8_t zmk_split_peripheral_behavior_ids(const uint32_t **ids);
+
+int zmk_split_peripheral_run_behavior(const struct zmk_split_run_behavior_payload *payload);
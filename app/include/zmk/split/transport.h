@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <drivers/sensor.h>
+#include <zmk/behavior.h>
+
+/*
+ * Implemented by the split transport in use, Bluetooth or wired.
+ */
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_ROLE_CENTRAL)
+#include <zmk/ble.h>
+#define ZMK_SPLIT_PERIPHERAL_COUNT ZMK_BLE_SPLIT_PERIPHERAL_COUNT
+#else
+#define ZMK_SPLIT_PERIPHERAL_COUNT 1
+#endif
+
+/* Peripheral side, sends the local changes to the central. */
+int zmk_split_position_pressed(uint32_t position, int64_t timestamp);
+int zmk_split_position_released(uint32_t position, int64_t timestamp);
+int zmk_split_sensor_triggered(uint8_t sensor_number, struct sensor_value value);
+
+/* Central side, runs a behavior on the peripheral with the given source. */
+int zmk_split_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
+                              struct zmk_behavior_binding_event event, bool state);
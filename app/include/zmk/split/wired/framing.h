@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/util.h>
+
+#include <zmk/matrix.h>
+#include <zmk/split/messages.h>
+
+/*
+ * A frame holds a message type, its payload and a CRC-16 of both. It is COBS encoded, so it has no
+ * zero bytes, and followed by a zero byte. A receiver which loses track of the stream picks it up
+ * again at the next zero.
+ */
+
+enum zmk_split_wired_message_type {
+    /* peripheral to central */
+    ZMK_SPLIT_WIRED_MSG_HELLO = 1,
+    ZMK_SPLIT_WIRED_MSG_POSITION_EVENTS,
+    ZMK_SPLIT_WIRED_MSG_POSITION_STATE,
+    ZMK_SPLIT_WIRED_MSG_SENSOR_EVENT,
+    ZMK_SPLIT_WIRED_MSG_BEHAVIORS,
+    ZMK_SPLIT_WIRED_MSG_HEARTBEAT,
+    /* central to peripheral */
+    ZMK_SPLIT_WIRED_MSG_READ_POSITION_STATE,
+    ZMK_SPLIT_WIRED_MSG_READ_BEHAVIORS,
+    ZMK_SPLIT_WIRED_MSG_RUN_BEHAVIOR,
+};
+
+#define ZMK_SPLIT_WIRED_BEHAVIORS_PER_FRAME 16
+
+/** Part of the peripheral's behavior IDs, which take several frames. */
+struct zmk_split_wired_behaviors {
+    /** Index of the first ID in this frame. */
+    uint8_t first;
+    uint8_t total;
+    uint32_t ids[];
+} __packed;
+
+/** Sent periodically, so the central notices when the last position events were lost. */
+struct zmk_split_wired_heartbeat {
+    uint8_t version;
+    /** Sequence number of the next position event. */
+    uint8_t sequence;
+} __packed;
+
+#define ZMK_SPLIT_WIRED_PAYLOAD_MAX                                                                \
+    MAX(sizeof(struct zmk_split_wired_behaviors) +                                                 \
+            ZMK_SPLIT_WIRED_BEHAVIORS_PER_FRAME * sizeof(uint32_t),                                \
+        sizeof(struct zmk_split_position_state) + ceiling_fraction(ZMK_KEYMAP_LEN, 8))
+
+// the type, payload and CRC before encoding
+#define ZMK_SPLIT_WIRED_FRAME_MAX (1 + ZMK_SPLIT_WIRED_PAYLOAD_MAX + 2)
+// COBS adds a byte per 254 and one more, then the zero delimiter follows
+#define ZMK_SPLIT_WIRED_ENCODED_MAX                                                                \
+    (ZMK_SPLIT_WIRED_FRAME_MAX + ZMK_SPLIT_WIRED_FRAME_MAX / 254 + 2)
+
+typedef void (*zmk_split_wired_receive_t)(uint8_t type, const uint8_t *payload, size_t len);
+
+struct zmk_split_wired_decoder {
+    uint8_t buf[ZMK_SPLIT_WIRED_ENCODED_MAX];
+    size_t len;
+    bool overflow;
+    uint32_t dropped;
+};
+
+/**
+ * Encode a frame, with its delimiter, into buf of at least ZMK_SPLIT_WIRED_ENCODED_MAX bytes.
+ *
+ * @return the encoded length, or -EMSGSIZE if the payload is too long
+ */
+int zmk_split_wired_frame_encode(uint8_t type, const void *payload, size_t len, uint8_t *buf);
+
+/**
+ * Feed received bytes to the decoder. Every complete frame with a valid CRC is passed to receive,
+ * others are counted in dropped.
+ */
+void zmk_split_wired_decode(struct zmk_split_wired_decoder *decoder, const uint8_t *data,
+                            size_t len, zmk_split_wired_receive_t receive);
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#pragma once
+
+#include <kernel.h>
+#include <device.h>
+#include <sys/ring_buffer.h>
+
+#include <zmk/split/wired/framing.h>
+
+/*
+ * One end of the wire between the halves. Received bytes are buffered from the UART interrupt and
+ * decoded on the system work queue, so receive is never called from an interrupt.
+ */
+struct zmk_split_wired_link {
+    zmk_split_wired_receive_t receive;
+    struct zmk_split_wired_decoder decoder;
+
+    struct ring_buf rx_ring;
+    uint8_t rx_buf[CONFIG_ZMK_SPLIT_WIRED_RX_BUFFER_SIZE];
+    struct k_work rx_work;
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_WIRED_LOOPBACK)
+    // the other end in the same image, sent bytes go straight into its receive buffer
+    struct zmk_split_wired_link *peer;
+#else
+    const struct device *uart;
+    struct ring_buf tx_ring;
+    uint8_t tx_buf[CONFIG_ZMK_SPLIT_WIRED_TX_BUFFER_SIZE];
+    struct k_spinlock tx_lock;
+#endif
+};
+
+int zmk_split_wired_link_init(struct zmk_split_wired_link *link,
+                              zmk_split_wired_receive_t receive);
+
+/**
+ * Queue a message for the other half.
+ *
+ * @return 0, -EMSGSIZE if the payload is too long, or -ENOMEM if the transmit buffer is full
+ */
+int zmk_split_wired_send(struct zmk_split_wired_link *link, uint8_t type, const void *payload,
+                         size_t len);
@@ -0,0 +1,217 @@
+# Copyright (c) 2022 The ZMK Contributors
+# SPDX-License-Identifier: MIT
+
+"""Generate the perfect hash table for a chord dictionary.
+
+Each dictionary line maps a chord to its output:
+
+    # comment
+    0+1+4 = "the "
+    2+3 = &0 "ing"
+
+A chord lists indices into the key-positions of the zmk,chords node. The output is
+a sequence of quoted text, typed as US keycodes, and &n references to the nth entry
+of the node's bindings.
+
+The table uses hash and displace: every chord is hashed into a bucket, and each
+bucket gets a displacement which moves all of its chords into free slots. A lookup
+is two hashes and one comparison, however large the dictionary is.
+"""
+
+import argparse
+import re
+import sys
+
+MASK = 0xFFFFFFFF
+MAX_CHORD_KEYS = 32
+MAX_DISPLACEMENT = 0xFFFF
+MAX_OUTPUT_LEN = 0xFF
+
+HID_USAGE_KEY = 0x07
+MOD_LSFT = 0x02
+
+OUTPUT_RE = re.compile(r'\s*(?:"((?:[^"\\]|\\.)*)"|&(\d+))')
+ESCAPES = {"n": "\n", "t": "\t", '"': '"', "\\": "\\"}
+
+# Characters in keycode order from 1 (0x1E) to / (0x38), \0 marks keys which type nothing here.
+UNSHIFTED = "1234567890\n\x1b\b\t -=[]\\\0;'`,./"
+SHIFTED = '!@#$%^&*()\0\0\0\0\0_+{}|\0:"~<>?'
+
+
+def keycode(char):
+    """Return the encoded keycode, as taken by &kp, typing char on a US layout."""
+    mods = 0
+    if char.isascii() and char.isalpha():
+        usage = 0x04 + ord(char.lower()) - ord("a")
+        mods = MOD_LSFT if char.isupper() else 0
+    elif char != "\0" and char in UNSHIFTED:
+        usage = 0x1E + UNSHIFTED.index(char)
+    elif char != "\0" and char in SHIFTED:
+        usage = 0x1E + SHIFTED.index(char)
+        mods = MOD_LSFT
+    else:
+        raise ValueError(f"no keycode for {char!r}")
+    return mods << 24 | HID_USAGE_KEY << 16 | usage
+
+
+def fmix32(h):
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK
+    h ^= h >> 16
+    return h
+
+
+def chord_hash(chord, seed):
+    """Must match zmk_chord_hash in app/src/chords.c."""
+    return fmix32(chord ^ ((seed * 0x9E3779B1) & MASK))
+
+
+def parse_outputs(text):
+    outputs = []
+    pos = 0
+    while text[pos:].strip():
+        match = OUTPUT_RE.match(text, pos)
+        if not match:
+            raise ValueError(f"unexpected output {text[pos:].strip()!r}")
+        if match.group(2) is not None:
+            outputs.append(("NULL", int(match.group(2))))
+        else:
+            chars = re.sub(r"\\(.)", lambda m: ESCAPES.get(m.group(1), m.group(1)), match.group(1))
+            outputs.extend(("\"KEY_PRESS\"", keycode(c)) for c in chars)
+        pos = match.end()
+    if not outputs:
+        raise ValueError("chord has no output")
+    if len(outputs) > MAX_OUTPUT_LEN:
+        raise ValueError(f"chord has more than {MAX_OUTPUT_LEN} outputs")
+    return outputs
+
+
+def parse_chord(text):
+    chord = 0
+    for key in text.split("+"):
+        index = int(key)
+        if index >= MAX_CHORD_KEYS:
+            raise ValueError(f"chord key {index} is not below {MAX_CHORD_KEYS}")
+        chord |= 1 << index
+    return chord
+
+
+def read_dictionary(path):
+    dictionary = {}
+    with open(path, encoding="utf-8") as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            try:
+                chord, _, outputs = line.partition("=")
+                chord = parse_chord(chord.strip())
+                if chord in dictionary:
+                    raise ValueError("chord is defined twice")
+                dictionary[chord] = parse_outputs(outputs)
+            except ValueError as e:
+                sys.exit(f"{path}:{number}: {e}")
+    return dictionary
+
+
+def synthetic_dictionary(entries):
+    """A deterministic dictionary of steno sized (23 key) chords, for benchmarks."""
+    dictionary = {}
+    state = 1
+    while len(dictionary) < entries:
+        state = (state * 1103515245 + 12345) & 0x7FFFFFFF
+        chord = state >> 8 & 0x7FFFFF
+        if chord:
+            dictionary[chord] = [("NULL", 0)]
+    return dictionary
+
+
+def place_buckets(groups, slots, seed):
+    """Return the displacement of each bucket, and the chord in each slot, or None."""
+    table = [None] * slots
+    displacements = [0] * len(groups)
+    for bucket in sorted(range(len(groups)), key=lambda b: -len(groups[b])):
+        group = groups[bucket]
+        if not group:
+            break
+        for d in range(MAX_DISPLACEMENT + 1):
+            placed = [chord_hash(c, (seed + 1 + d) & MASK) % slots for c in group]
+            if len(set(placed)) == len(placed) and all(table[s] is None for s in placed):
+                break
+        else:
+            return None
+        displacements[bucket] = d
+        for chord, slot in zip(group, placed):
+            table[slot] = chord
+    return displacements, table
+
+
+def build_table(chords):
+    buckets = max(1, (len(chords) + 3) // 4)
+    slots = max(1, len(chords) + len(chords) // 4)
+
+    for seed in range(1, 256):
+        groups = [[] for _ in range(buckets)]
+        for chord in chords:
+            groups[chord_hash(chord, seed) % buckets].append(chord)
+
+        placement = place_buckets(groups, slots, seed)
+        if placement:
+            return (seed, *placement)
+
+    sys.exit("unable to find a perfect hash for the chord dictionary")
+
+
+def write_table(f, dictionary):
+    seed, displacements, table = build_table(list(dictionary))
+
+    f.write("/*\n * Generated by app/scripts/chord_table.py, do not edit.\n */\n\n")
+    f.write("#pragma once\n\n#include <zmk/chords.h>\n\n")
+    f.write(f"#define ZMK_CHORD_COUNT {len(dictionary)}\n")
+    f.write(f"#define ZMK_CHORD_SEED {seed}\n")
+    f.write(f"#define ZMK_CHORD_BUCKET_COUNT {len(displacements)}\n")
+    f.write(f"#define ZMK_CHORD_SLOT_COUNT {len(table)}\n\n")
+
+    f.write("static const uint16_t zmk_chord_displacements[ZMK_CHORD_BUCKET_COUNT] = {\n")
+    for d in displacements:
+        f.write(f"    {d},\n")
+    f.write("};\n\n")
+
+    outputs = []
+    f.write("static const struct zmk_chord_entry zmk_chord_table[ZMK_CHORD_SLOT_COUNT] = {\n")
+    for chord in table:
+        if chord is None:
+            f.write("    {0},\n")
+            continue
+        f.write(f"    {{0x{chord:08x}, {len(outputs)}, {len(dictionary[chord])}}},\n")
+        outputs.extend(dictionary[chord])
+    f.write("};\n\n")
+
+    f.write(f"#define ZMK_CHORD_OUTPUT_COUNT {len(outputs)}\n\n")
+    f.write("static const struct zmk_behavior_binding zmk_chord_outputs[] = {\n")
+    for behavior_dev, param in outputs or [("NULL", 0)]:
+        f.write(f"    {{{behavior_dev}, 0x{param:08x}, 0}},\n")
+    f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--dictionary", help="chord dictionary to read")
+    source.add_argument("--synthetic", type=int, help="generate a dictionary with this many chords")
+    parser.add_argument("--output", required=True, help="header file to write")
+    args = parser.parse_args()
+
+    if args.dictionary:
+        dictionary = read_dictionary(args.dictionary)
+    else:
+        dictionary = synthetic_dictionary(args.synthetic)
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        write_table(f, dictionary)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,116 @@
+# Copyright (c) 2022 The ZMK Contributors
+# SPDX-License-Identifier: MIT
+
+"""Generate the index from key positions to combos from the devicetree.
+
+The combos are the children of the zmk,combos node, in devicetree order, the same order in which
+combo.c defines them:
+
+    combos {
+        compatible = "zmk,combos";
+        combo_esc {
+            key-positions = <0 1>;
+            bindings = <&kp ESC>;
+        };
+    };
+
+The combos on each key position are listed in compressed sparse row form: the combos on position p
+are combo_lookup[i] for i from combo_lookup_offsets[p] up to combo_lookup_offsets[p + 1], sorted
+shortest-first, then in devicetree order. Each combo's key positions are also written as a bitmask.
+"""
+
+import argparse
+import os
+import pickle
+import sys
+
+COMPAT = "zmk,combos"
+
+MAX_ENTRIES = 0xFFFF
+
+
+def load_edt(path, zephyr_base):
+    # edtlib must be importable for the pickle to load
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "dts"))
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "dts", "python-devicetree", "src"))
+    with open(path, "rb") as f:
+        return pickle.load(f)
+
+
+def read_combos(edt):
+    nodes = edt.compat2okay.get(COMPAT, [])
+    if not nodes:
+        return []
+
+    combos = []
+    for child in nodes[0].children.values():
+        positions = child.props["key-positions"].val
+        if not positions:
+            sys.exit(f"{child.path}: no key positions")
+        combos.append(positions)
+    return combos
+
+
+def build_index(combos):
+    """Return the offsets into the lookup for each position, and the lookup."""
+    position_count = max((max(positions) + 1 for positions in combos), default=0)
+    lookup = [[] for _ in range(position_count)]
+    for combo in sorted(range(len(combos)), key=lambda combo: len(combos[combo])):
+        for position in combos[combo]:
+            lookup[position].append(combo)
+
+    offsets = [0]
+    for combos_on_position in lookup:
+        offsets.append(offsets[-1] + len(combos_on_position))
+
+    if offsets[-1] > MAX_ENTRIES:
+        sys.exit("too many combo key positions")
+    return offsets, [combo for combos_on_position in lookup for combo in combos_on_position]
+
+
+def write_index(f, combos):
+    offsets, lookup = build_index(combos)
+    position_count = len(offsets) - 1
+    mask_words = max((position_count + 31) // 32, 1)
+
+    f.write("/*\n * Generated by app/scripts/combo_index.py, do not edit.\n */\n\n")
+    f.write("#pragma once\n\n#include <stdint.h>\n\n")
+    f.write(f"#define ZMK_COMBO_INDEX_COMBO_COUNT {len(combos)}\n")
+    f.write("// one more than the highest key position in a combo\n")
+    f.write(f"#define ZMK_COMBO_INDEX_POSITION_COUNT {position_count}\n")
+    f.write(f"#define ZMK_COMBO_INDEX_MASK_WORDS {mask_words}\n\n")
+
+    f.write("static const uint16_t combo_lookup_offsets[ZMK_COMBO_INDEX_POSITION_COUNT + 1] = {\n")
+    for offset in offsets:
+        f.write(f"    {offset},\n")
+    f.write("};\n\n")
+
+    f.write("static const uint16_t combo_lookup[] = {\n")
+    for combo in lookup or [0]:
+        f.write(f"    {combo},\n")
+    f.write("};\n\n")
+
+    f.write("static const uint32_t combo_position_masks[][ZMK_COMBO_INDEX_MASK_WORDS] = {\n")
+    for positions in combos or [[]]:
+        words = [0] * mask_words
+        for position in positions:
+            words[position // 32] |= 1 << (position % 32)
+        f.write("    {" + ", ".join(f"0x{word:08x}" for word in words) + "},\n")
+    f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--edt-pickle", required=True, help="pickled devicetree to read")
+    parser.add_argument("--zephyr-base", required=True, help="Zephyr tree providing edtlib")
+    parser.add_argument("--output", required=True, help="header file to write")
+    args = parser.parse_args()
+
+    combos = read_combos(load_edt(args.edt_pickle, args.zephyr_base))
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        write_index(f, combos)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+# Copyright (c) 2022 The ZMK Contributors
+# SPDX-License-Identifier: MIT
+
+"""Generate the trie of leader key sequences from the devicetree.
+
+The sequences are the children of the zmk,behavior-leader-key node, in devicetree order:
+
+    leader: leader_key {
+        compatible = "zmk,behavior-leader-key";
+        ...
+        git_status {
+            sequence = <G S>;
+            bindings = <&macro_git_status>;
+        };
+    };
+
+Each trie node lists its edges sorted by key, so advancing on a key is a binary search over at
+most as many edges as there are distinct keys. Nodes are numbered breadth first.
+"""
+
+import argparse
+import os
+import pickle
+import sys
+
+COMPAT = "zmk,behavior-leader-key"
+
+MAX_EDGES = 0xFF
+MAX_NODES = 0xFFFF
+MAX_SEQUENCES = 0x7FFF
+
+
+def load_edt(path, zephyr_base):
+    # edtlib must be importable for the pickle to load
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "dts"))
+    sys.path.insert(0, os.path.join(zephyr_base, "scripts", "dts", "python-devicetree", "src"))
+    with open(path, "rb") as f:
+        return pickle.load(f)
+
+
+def read_sequences(edt):
+    nodes = edt.compat2okay.get(COMPAT, [])
+    if not nodes:
+        return []
+    if len(nodes) > 1:
+        sys.exit(f"only one {COMPAT} node is supported, found {len(nodes)}")
+
+    sequences = []
+    for child in nodes[0].children.values():
+        sequence = child.props["sequence"].val
+        if not sequence:
+            sys.exit(f"{child.path}: empty sequence")
+        sequences.append((child.path, [key & 0xFFFFFFFF for key in sequence]))
+    return sequences
+
+
+def build_trie(sequences):
+    """Return the nodes as (first edge, edge count, sequence) and the edges as (key, node)."""
+    children = [{}]
+    ends = [-1]
+    for index, (path, sequence) in enumerate(sequences):
+        node = 0
+        for key in sequence:
+            if key not in children[node]:
+                children[node][key] = len(children)
+                children.append({})
+                ends.append(-1)
+            node = children[node][key]
+        if ends[node] != -1:
+            sys.exit(f"{path}: same sequence as {sequences[ends[node]][0]}")
+        ends[node] = index
+
+    order = [0]
+    number = {0: 0}
+    for node in order:
+        for key in sorted(children[node]):
+            number[children[node][key]] = len(order)
+            order.append(children[node][key])
+
+    nodes = []
+    edges = []
+    for node in order:
+        if len(children[node]) > MAX_EDGES:
+            sys.exit(f"more than {MAX_EDGES} keys follow the same leader key prefix")
+        nodes.append((len(edges), len(children[node]), ends[node]))
+        edges.extend((key, number[children[node][key]]) for key in sorted(children[node]))
+
+    if len(nodes) > MAX_NODES or len(sequences) > MAX_SEQUENCES:
+        sys.exit("too many leader key sequences")
+    return nodes, edges
+
+
+def write_trie(f, sequences):
+    nodes, edges = build_trie(sequences)
+
+    f.write("/*\n * Generated by app/scripts/leader_trie.py, do not edit.\n */\n\n")
+    f.write("#pragma once\n\n#include <zmk/leader.h>\n\n")
+    f.write(f"#define ZMK_LEADER_SEQUENCE_COUNT {len(sequences)}\n")
+    f.write(f"#define ZMK_LEADER_NODE_COUNT {len(nodes)}\n")
+    f.write(f"#define ZMK_LEADER_EDGE_COUNT {len(edges)}\n\n")
+
+    f.write("static const struct zmk_leader_node zmk_leader_nodes[ZMK_LEADER_NODE_COUNT] = {\n")
+    for first_edge, edge_count, sequence in nodes:
+        f.write(f"    {{{first_edge}, {edge_count}, {sequence}}},\n")
+    f.write("};\n\n")
+
+    f.write("static const struct zmk_leader_edge zmk_leader_edges[] = {\n")
+    for key, node in edges or [(0, 0)]:
+        f.write(f"    {{0x{key:08x}, {node}}},\n")
+    f.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--edt-pickle", required=True, help="pickled devicetree to read")
+    parser.add_argument("--zephyr-base", required=True, help="Zephyr tree providing edtlib")
+    parser.add_argument("--output", required=True, help="header file to write")
+    args = parser.parse_args()
+
+    sequences = read_sequences(load_edt(args.edt_pickle, args.zephyr_base))
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        write_trie(f, sequences)
+
+
+if __name__ == "__main__":
+    main()
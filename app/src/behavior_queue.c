@@ -9,57 +9,213 @@
 #include <kernel.h>
 #include <logging/log.h>
 #include <drivers/behavior.h>
+#include <zmk/endpoints.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/endpoint_reports_sent.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 struct q_item {
     uint32_t position;
-    struct zmk_behavior_binding binding;
+    // bindings are not copied into the queue, see zmk_behavior_queue_add.
+    const struct zmk_behavior_binding *binding;
     bool press : 1;
     uint32_t wait : 31;
 };
 
 K_MSGQ_DEFINE(zmk_behavior_queue_msgq, sizeof(struct q_item), CONFIG_ZMK_BEHAVIORS_QUEUE_SIZE, 4);
 
-static void behavior_queue_process_next(struct k_work *work);
-static K_DELAYED_WORK_DEFINE(queue_work, behavior_queue_process_next);
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIORS_QUEUE_SERIALIZE)
+// running streams in the order they were started, only the first one is processed.
+static sys_slist_t serialized_streams = SYS_SLIST_STATIC_INIT(&serialized_streams);
+#endif
+
+// streams with a paced step waiting for the transport to send its reports.
+static sys_slist_t waiting_streams = SYS_SLIST_STATIC_INIT(&waiting_streams);
+
+/* Returns true if the stream has to wait before its next step. */
+static bool pace_stream(struct zmk_behavior_queue_stream *stream, uint32_t wait) {
+    const int64_t now = k_uptime_get();
+
+    stream->paced_until = now + MAX(wait, CONFIG_ZMK_BEHAVIORS_QUEUE_PACED_MIN_MS);
+
+    const int in_flight = zmk_endpoints_reports_in_flight();
+    if (in_flight > 0) {
+        // continues once the reports are sent, or after the timeout if that never happens.
+        LOG_DBG("Waiting for %d reports to be sent", in_flight);
+        stream->waiting_for_reports = true;
+        sys_slist_append(&waiting_streams, &stream->waiting_node);
+        zmk_behavior_timer_start(
+            &stream->timer,
+            MAX(stream->paced_until, now + CONFIG_ZMK_BEHAVIORS_QUEUE_PACED_TIMEOUT_MS));
+        return true;
+    }
+
+    if (stream->paced_until > now) {
+        zmk_behavior_timer_start(&stream->timer, stream->paced_until);
+        return true;
+    }
+
+    return false;
+}
+
+/* Returns true if the stream has finished, false if it is waiting for its timer. */
+static bool behavior_queue_process_next(struct zmk_behavior_queue_stream *stream) {
+    struct zmk_behavior_queue_step step;
 
-static void behavior_queue_process_next(struct k_work *work) {
-    struct q_item item = {.wait = 0};
+    while (stream->next(stream, &step)) {
+        struct zmk_behavior_binding binding = *step.binding;
 
-    while (k_msgq_get(&zmk_behavior_queue_msgq, &item, K_NO_WAIT) == 0) {
-        LOG_DBG("Invoking %s: 0x%02x 0x%02x", log_strdup(item.binding.behavior_dev),
-                item.binding.param1, item.binding.param2);
+        LOG_DBG("Invoking %s: 0x%02x 0x%02x", log_strdup(binding.behavior_dev), binding.param1,
+                binding.param2);
 
-        struct zmk_behavior_binding_event event = {.position = item.position,
+        struct zmk_behavior_binding_event event = {.position = stream->position,
                                                    .timestamp = k_uptime_get()};
 
-        if (item.press) {
-            behavior_keymap_binding_pressed(&item.binding, event);
+        if (step.behavior != NULL) {
+            const struct behavior_driver_api *api = step.behavior->api;
+            behavior_keymap_binding_callback_t callback =
+                step.press ? api->binding_pressed : api->binding_released;
+            if (callback != NULL) {
+                callback(&binding, event);
+            }
+        } else if (step.press) {
+            behavior_keymap_binding_pressed(&binding, event);
         } else {
-            behavior_keymap_binding_released(&item.binding, event);
+            behavior_keymap_binding_released(&binding, event);
         }
 
-        LOG_DBG("Processing next queued behavior in %dms", item.wait);
+        if (step.paced) {
+            if (pace_stream(stream, step.wait)) {
+                return false;
+            }
+            continue;
+        }
+
+        LOG_DBG("Processing next queued behavior in %dms", step.wait);
 
-        if (item.wait > 0) {
-            k_delayed_work_submit(&queue_work, K_MSEC(item.wait));
-            break;
+        if (step.wait > 0) {
+            zmk_behavior_timer_start(&stream->timer, k_uptime_get() + step.wait);
+            return false;
         }
     }
+
+    return true;
+}
+
+/* Marks the stream as finished, and returns the next stream to process, if any. */
+static struct zmk_behavior_queue_stream *finish_stream(struct zmk_behavior_queue_stream *stream) {
+    stream->running = false;
+
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIORS_QUEUE_SERIALIZE)
+    sys_slist_find_and_remove(&serialized_streams, &stream->node);
+    sys_snode_t *next = sys_slist_peek_head(&serialized_streams);
+    return next == NULL ? NULL : CONTAINER_OF(next, struct zmk_behavior_queue_stream, node);
+#else
+    return NULL;
+#endif
+}
+
+static void run_streams(struct zmk_behavior_queue_stream *stream) {
+    while (stream != NULL && behavior_queue_process_next(stream)) {
+        stream = finish_stream(stream);
+    }
 }
 
-int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding binding, bool press,
-                           uint32_t wait) {
-    struct q_item item = {.press = press, .binding = binding, .wait = wait};
+static void stream_timer_handler(struct zmk_behavior_timer *timer) {
+    struct zmk_behavior_queue_stream *stream =
+        CONTAINER_OF(timer, struct zmk_behavior_queue_stream, timer);
+
+    if (stream->waiting_for_reports) {
+        LOG_WRN("Reports were not sent within %dms, continuing paced behaviors",
+                CONFIG_ZMK_BEHAVIORS_QUEUE_PACED_TIMEOUT_MS);
+        stream->waiting_for_reports = false;
+        sys_slist_find_and_remove(&waiting_streams, &stream->waiting_node);
+    }
+
+    run_streams(stream);
+}
+
+static int behavior_queue_reports_sent_listener(const zmk_event_t *eh) {
+    struct zmk_behavior_queue_stream *stream, *tmp;
+
+    SYS_SLIST_FOR_EACH_CONTAINER_SAFE(&waiting_streams, stream, tmp, waiting_node) {
+        stream->waiting_for_reports = false;
+        // runs right away once the minimum spacing has passed.
+        LOG_DBG("Reports sent, continuing paced behaviors in %dms",
+                (int)MAX(stream->paced_until - k_uptime_get(), 0));
+        zmk_behavior_timer_start(&stream->timer, stream->paced_until);
+    }
+    sys_slist_init(&waiting_streams);
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+
+ZMK_LISTENER(behavior_queue, behavior_queue_reports_sent_listener);
+ZMK_SUBSCRIPTION(behavior_queue, zmk_endpoint_reports_sent);
+
+void zmk_behavior_queue_stream_init(struct zmk_behavior_queue_stream *stream,
+                                    zmk_behavior_queue_next_t next) {
+    stream->next = next;
+    stream->running = false;
+    stream->waiting_for_reports = false;
+    zmk_behavior_timer_init(&stream->timer, stream_timer_handler);
+}
+
+int zmk_behavior_queue_stream_start(struct zmk_behavior_queue_stream *stream, uint32_t position) {
+    if (stream->running) {
+        return -EBUSY;
+    }
+
+    stream->running = true;
+    stream->position = position;
+
+#if IS_ENABLED(CONFIG_ZMK_BEHAVIORS_QUEUE_SERIALIZE)
+    bool first = sys_slist_is_empty(&serialized_streams);
+    sys_slist_append(&serialized_streams, &stream->node);
+    if (!first) {
+        // started by the stream before it once that one finishes.
+        return 0;
+    }
+#endif
+
+    run_streams(stream);
+
+    return 0;
+}
+
+static bool queue_stream_next(struct zmk_behavior_queue_stream *stream,
+                              struct zmk_behavior_queue_step *step) {
+    struct q_item item;
+
+    if (k_msgq_get(&zmk_behavior_queue_msgq, &item, K_NO_WAIT) != 0) {
+        return false;
+    }
+
+    stream->position = item.position;
+    *step = (struct zmk_behavior_queue_step){
+        .binding = item.binding, .press = item.press, .wait = item.wait};
+    return true;
+}
+
+// the stream of behaviors added with zmk_behavior_queue_add.
+static struct zmk_behavior_queue_stream queue_stream = {
+    .next = queue_stream_next,
+    .timer = {.handler = stream_timer_handler},
+};
+
+int zmk_behavior_queue_add(uint32_t position, const struct zmk_behavior_binding *binding,
+                           bool press, uint32_t wait) {
+    struct q_item item = {.position = position, .press = press, .binding = binding, .wait = wait};
 
     const int ret = k_msgq_put(&zmk_behavior_queue_msgq, &item, K_NO_WAIT);
     if (ret < 0) {
         return ret;
     }
 
-    if (!k_delayed_work_pending(&queue_work)) {
-        behavior_queue_process_next(&queue_work.work);
+    // a running stream picks up the new item by itself.
+    if (!queue_stream.running) {
+        zmk_behavior_queue_stream_start(&queue_stream, position);
     }
 
     return 0;
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zmk/behavior_registry.h>
+
+#include <kernel.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+static sys_slist_t registries = SYS_SLIST_STATIC_INIT(&registries);
+
+static inline void *slot_at(const struct zmk_behavior_registry *registry, int index) {
+    return (uint8_t *)registry->slots + index * registry->slot_size;
+}
+
+static inline int index_of(const struct zmk_behavior_registry *registry, const void *slot) {
+    return ((const uint8_t *)slot - (const uint8_t *)registry->slots) / registry->slot_size;
+}
+
+void zmk_behavior_registry_init(struct zmk_behavior_registry *registry) {
+    sys_slist_append(&registries, &registry->node);
+}
+
+void *zmk_behavior_registry_alloc(struct zmk_behavior_registry *registry, uint32_t position) {
+    const uint32_t all = registry->slot_count == 32 ? UINT32_MAX : BIT_MASK(registry->slot_count);
+    const uint32_t free = ~registry->active & all;
+    if (free == 0) {
+        LOG_DBG("All %d %s slots are in use", registry->slot_count, registry->name);
+        zmk_behavior_registry_log_active();
+        return NULL;
+    }
+
+    const int index = __builtin_ctz(free);
+    registry->active |= BIT(index);
+    registry->positions[index] = position;
+    if (position < ZMK_KEYMAP_LEN) {
+        registry->index[position] = index + 1;
+    }
+
+    return slot_at(registry, index);
+}
+
+void zmk_behavior_registry_free(struct zmk_behavior_registry *registry, void *slot) {
+    const int index = index_of(registry, slot);
+    const uint32_t position = registry->positions[index];
+
+    registry->active &= ~BIT(index);
+    if (position < ZMK_KEYMAP_LEN && registry->index[position] == index + 1) {
+        registry->index[position] = 0;
+    }
+}
+
+void *zmk_behavior_registry_find(const struct zmk_behavior_registry *registry, uint32_t position) {
+    if (position < ZMK_KEYMAP_LEN) {
+        const uint8_t entry = registry->index[position];
+        return entry == 0 ? NULL : slot_at(registry, entry - 1);
+    }
+
+    for (uint32_t active = registry->active; active != 0; active &= active - 1) {
+        const int index = __builtin_ctz(active);
+        if (registry->positions[index] == position) {
+            return slot_at(registry, index);
+        }
+    }
+
+    return NULL;
+}
+
+bool zmk_behavior_registry_is_active(const struct zmk_behavior_registry *registry,
+                                     const void *slot) {
+    return (registry->active & BIT(index_of(registry, slot))) != 0;
+}
+
+void *zmk_behavior_registry_next(const struct zmk_behavior_registry *registry, const void *slot) {
+    const int after = slot == NULL ? -1 : index_of(registry, slot);
+    // shifting by 32 is undefined, and no slot follows the last one anyway.
+    const uint32_t rest = after >= 31 ? 0 : registry->active & (UINT32_MAX << (after + 1));
+
+    return rest == 0 ? NULL : slot_at(registry, __builtin_ctz(rest));
+}
+
+void zmk_behavior_registry_log_active() {
+    struct zmk_behavior_registry *registry;
+
+    SYS_SLIST_FOR_EACH_CONTAINER(&registries, registry, node) {
+        LOG_INF("%s: %d of %d slots active", registry->name, __builtin_popcount(registry->active),
+                registry->slot_count);
+
+        for (uint32_t active = registry->active; active != 0; active &= active - 1) {
+            const int index = __builtin_ctz(active);
+            LOG_INF("%s: slot %d at position %d", registry->name, index,
+                    registry->positions[index]);
+        }
+    }
+}
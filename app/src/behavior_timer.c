@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <zmk/behavior_timer.h>
+
+#include <kernel.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+// Running timers, kept as a binary min-heap ordered by deadline, then by start order.
+static struct zmk_behavior_timer *queue[CONFIG_ZMK_BEHAVIOR_TIMERS_MAX];
+static uint16_t queue_len;
+static uint32_t next_sequence;
+
+// The deadline the kernel timer was last submitted for.
+static int64_t scheduled_deadline;
+
+static void behavior_timer_expired(struct k_work *work);
+static K_DELAYED_WORK_DEFINE(timer_work, behavior_timer_expired);
+
+static bool fires_before(const struct zmk_behavior_timer *a, const struct zmk_behavior_timer *b) {
+    if (a->deadline != b->deadline) {
+        return a->deadline < b->deadline;
+    }
+    return (int32_t)(a->sequence - b->sequence) < 0;
+}
+
+static void place(struct zmk_behavior_timer *timer, uint16_t index) {
+    queue[index] = timer;
+    timer->slot = index + 1;
+}
+
+static void sift_up(uint16_t index) {
+    struct zmk_behavior_timer *timer = queue[index];
+
+    while (index > 0) {
+        uint16_t parent = (index - 1) / 2;
+        if (!fires_before(timer, queue[parent])) {
+            break;
+        }
+        place(queue[parent], index);
+        index = parent;
+    }
+    place(timer, index);
+}
+
+static void sift_down(uint16_t index) {
+    struct zmk_behavior_timer *timer = queue[index];
+
+    for (;;) {
+        uint16_t child = 2 * index + 1;
+        if (child >= queue_len) {
+            break;
+        }
+        if (child + 1 < queue_len && fires_before(queue[child + 1], queue[child])) {
+            child++;
+        }
+        if (!fires_before(queue[child], timer)) {
+            break;
+        }
+        place(queue[child], index);
+        index = child;
+    }
+    place(timer, index);
+}
+
+static void remove_at(uint16_t index) {
+    queue[index]->slot = 0;
+    queue_len--;
+
+    if (index == queue_len) {
+        return;
+    }
+
+    // The last timer fills the hole, and may belong either above or below it.
+    struct zmk_behavior_timer *moved = queue[queue_len];
+    place(moved, index);
+    sift_up(index);
+    sift_down(moved->slot - 1);
+}
+
+static void reschedule() {
+    if (queue_len == 0) {
+        // Leave a pending kernel timer alone, it expires without finding anything to do.
+        return;
+    }
+
+    int64_t deadline = queue[0]->deadline;
+    if (k_delayed_work_pending(&timer_work) && deadline >= scheduled_deadline) {
+        // It expires early at worst, and then reschedules for the first deadline.
+        return;
+    }
+
+    scheduled_deadline = deadline;
+    k_delayed_work_submit(&timer_work, K_MSEC(MAX(deadline - k_uptime_get(), 0)));
+}
+
+static void behavior_timer_expired(struct k_work *work) {
+    int64_t now = k_uptime_get();
+
+    while (queue_len > 0 && queue[0]->deadline <= now) {
+        struct zmk_behavior_timer *timer = queue[0];
+        remove_at(0);
+        timer->handler(timer);
+    }
+
+    reschedule();
+}
+
+void zmk_behavior_timer_init(struct zmk_behavior_timer *timer,
+                             zmk_behavior_timer_handler_t handler) {
+    *timer = (struct zmk_behavior_timer){.handler = handler};
+}
+
+int zmk_behavior_timer_start(struct zmk_behavior_timer *timer, int64_t deadline) {
+    if (zmk_behavior_timer_is_running(timer)) {
+        if (timer->deadline == deadline) {
+            return 0;
+        }
+        remove_at(timer->slot - 1);
+    }
+
+    if (queue_len == CONFIG_ZMK_BEHAVIOR_TIMERS_MAX) {
+        LOG_ERR("Unable to start behavior timer, already %d running. Increase "
+                "CONFIG_ZMK_BEHAVIOR_TIMERS_MAX",
+                CONFIG_ZMK_BEHAVIOR_TIMERS_MAX);
+        return -ENOMEM;
+    }
+
+    timer->deadline = deadline;
+    timer->sequence = next_sequence++;
+    queue[queue_len++] = timer;
+    sift_up(queue_len - 1);
+
+    reschedule();
+
+    return 0;
+}
+
+bool zmk_behavior_timer_stop(struct zmk_behavior_timer *timer) {
+    if (!zmk_behavior_timer_is_running(timer)) {
+        return false;
+    }
+
+    remove_at(timer->slot - 1);
+
+    return true;
+}
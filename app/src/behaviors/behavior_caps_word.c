@@ -37,27 +37,40 @@ struct behavior_caps_word_config {
 };
 
 struct behavior_caps_word_data {
-    bool active;
+    // keyboard page usages on the continue list, one bit per usage id. Built at init.
+    uint32_t continue_usages[256 / 32];
+    // set if the continue list has usages on other pages, which are only found by a scan.
+    bool continue_other_pages;
 };
 
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) <= 32, "At most 32 caps words are supported");
+
+// bit n is set while instance n is active, so the listener returns right away if none is.
+static uint32_t active_caps_words;
+
+static bool caps_word_is_active(const struct device *dev) {
+    const struct behavior_caps_word_config *config = dev->config;
+
+    return (active_caps_words & BIT(config->index)) != 0;
+}
+
 static void activate_caps_word(const struct device *dev) {
-    struct behavior_caps_word_data *data = dev->data;
+    const struct behavior_caps_word_config *config = dev->config;
 
-    data->active = true;
+    active_caps_words |= BIT(config->index);
 }
 
 static void deactivate_caps_word(const struct device *dev) {
-    struct behavior_caps_word_data *data = dev->data;
+    const struct behavior_caps_word_config *config = dev->config;
 
-    data->active = false;
+    active_caps_words &= ~BIT(config->index);
 }
 
 static int on_caps_word_binding_pressed(struct zmk_behavior_binding *binding,
                                         struct zmk_behavior_binding_event event) {
     const struct device *dev = device_get_binding(binding->behavior_dev);
-    struct behavior_caps_word_data *data = dev->data;
 
-    if (data->active) {
+    if (caps_word_is_active(dev)) {
         deactivate_caps_word(dev);
     } else {
         activate_caps_word(dev);
@@ -84,8 +97,17 @@ ZMK_SUBSCRIPTION(behavior_caps_word, zmk_keycode_state_changed);
 static const struct device *devs[DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)];
 
 static bool caps_word_is_caps_includelist(const struct behavior_caps_word_config *config,
+                                          const struct behavior_caps_word_data *data,
                                           uint16_t usage_page, uint8_t usage_id,
                                           uint8_t implicit_modifiers) {
+    if (usage_page == HID_USAGE_KEY &&
+        (data->continue_usages[usage_id / 32] & BIT(usage_id % 32)) == 0) {
+        return false;
+    }
+    if (usage_page != HID_USAGE_KEY && !data->continue_other_pages) {
+        return false;
+    }
+
     for (int i = 0; i < config->continuations_count; i++) {
         const struct caps_word_continue_item *continuation = &config->continuations[i];
         LOG_DBG("Comparing with 0x%02X - 0x%02X (with implicit mods: 0x%02X)", continuation->page,
@@ -127,23 +149,15 @@ static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
-    for (int i = 0; i < DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT); i++) {
-        const struct device *dev = devs[i];
-        if (dev == NULL) {
-            continue;
-        }
-
-        struct behavior_caps_word_data *data = dev->data;
-        if (!data->active) {
-            continue;
-        }
-
+    for (uint32_t active = active_caps_words; active != 0; active &= active - 1) {
+        const struct device *dev = devs[__builtin_ctz(active)];
         const struct behavior_caps_word_config *config = dev->config;
+        const struct behavior_caps_word_data *data = dev->data;
 
         caps_word_enhance_usage(config, ev);
 
         if (!caps_word_is_alpha(ev->keycode) && !caps_word_is_numeric(ev->keycode) &&
-            !caps_word_is_caps_includelist(config, ev->usage_page, ev->keycode,
+            !caps_word_is_caps_includelist(config, data, ev->usage_page, ev->keycode,
                                            ev->implicit_modifiers)) {
             LOG_DBG("Deactivating caps_word for 0x%02X - 0x%02X", ev->usage_page, ev->keycode);
             deactivate_caps_word(dev);
@@ -155,7 +169,19 @@ static int caps_word_keycode_state_changed_listener(const zmk_event_t *eh) {
 
 static int behavior_caps_word_init(const struct device *dev) {
     const struct behavior_caps_word_config *config = dev->config;
+    struct behavior_caps_word_data *data = dev->data;
+
     devs[config->index] = dev;
+
+    for (int i = 0; i < config->continuations_count; i++) {
+        const struct caps_word_continue_item *continuation = &config->continuations[i];
+        if (continuation->page == HID_USAGE_KEY && continuation->id <= UINT8_MAX) {
+            data->continue_usages[continuation->id / 32] |= BIT(continuation->id % 32);
+        } else {
+            data->continue_other_pages = true;
+        }
+    }
+
     return 0;
 }
 
@@ -169,7 +195,7 @@ static int behavior_caps_word_init(const struct device *dev) {
 #define BREAK_ITEM(i, n) PARSE_BREAK(DT_INST_PROP_BY_IDX(n, continue_list, i))
 
 #define KP_INST(n)                                                                                 \
-    static struct behavior_caps_word_data behavior_caps_word_data_##n = {.active = false};         \
+    static struct behavior_caps_word_data behavior_caps_word_data_##n = {};                        \
     static struct behavior_caps_word_config behavior_caps_word_config_##n = {                      \
         .index = n,                                                                                \
         .mods = DT_INST_PROP_OR(n, mods, MOD_LSFT),                                                \
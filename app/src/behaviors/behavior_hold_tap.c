@@ -12,6 +12,9 @@
 #include <dt-bindings/zmk/keys.h>
 #include <logging/log.h>
 #include <zmk/behavior.h>
+#include <zmk/behavior_registry.h>
+#include <zmk/behavior_timer.h>
+#include <zmk/behavior_hold_tap.h>
 #include <zmk/matrix.h>
 #include <zmk/endpoints.h>
 #include <zmk/event_manager.h>
@@ -20,15 +23,19 @@
 #include <zmk/behavior.h>
 #include <zmk/keymap.h>
 
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM) && IS_ENABLED(CONFIG_ARCH_POSIX)
+#include <stdio.h>
+#include "soc.h"
+#endif
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_HOLD_TAP_MAX_HELD 10
-#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS 40
+#define ZMK_BHV_HOLD_TAP_MAX_HELD CONFIG_ZMK_BHV_HOLD_TAP_MAX_HELD
+#define ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS CONFIG_ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS
 
-// increase if you have keyboard with more keys.
-#define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED 9999
+#define ZMK_BHV_HOLD_TAP_POSITION_NOT_USED INT32_MAX
 
 enum flavor {
     FLAVOR_HOLD_PREFERRED,
@@ -45,11 +52,12 @@ enum status {
 };
 
 enum decision_moment {
-    HT_KEY_UP,
-    HT_OTHER_KEY_DOWN,
-    HT_OTHER_KEY_UP,
-    HT_TIMER_EVENT,
-    HT_QUICK_TAP,
+    HT_KEY_UP = ZMK_BHV_HOLD_TAP_MOMENT_KEY_UP,
+    HT_OTHER_KEY_DOWN = ZMK_BHV_HOLD_TAP_MOMENT_OTHER_KEY_DOWN,
+    HT_OTHER_KEY_UP = ZMK_BHV_HOLD_TAP_MOMENT_OTHER_KEY_UP,
+    HT_TIMER_EVENT = ZMK_BHV_HOLD_TAP_MOMENT_TIMER,
+    HT_QUICK_TAP = ZMK_BHV_HOLD_TAP_MOMENT_QUICK_TAP,
+    HT_PRIOR_IDLE = ZMK_BHV_HOLD_TAP_MOMENT_PRIOR_IDLE,
 };
 
 struct behavior_hold_tap_config {
@@ -57,12 +65,20 @@ struct behavior_hold_tap_config {
     char *hold_behavior_dev;
     char *tap_behavior_dev;
     int quick_tap_ms;
+    int require_prior_idle_ms;
     enum flavor flavor;
     bool retro_tap;
     int32_t hold_trigger_key_positions_len;
     int32_t hold_trigger_key_positions[];
 };
 
+struct behavior_hold_tap_data {
+    struct zmk_behavior_hold_tap_stats stats;
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+    struct zmk_behavior_hold_tap_latency position_latency[ZMK_KEYMAP_LEN];
+#endif
+};
+
 // this data is specific for each hold-tap
 struct active_hold_tap {
     int32_t position;
@@ -71,22 +87,32 @@ struct active_hold_tap {
     int64_t timestamp;
     enum status status;
     const struct behavior_hold_tap_config *config;
-    struct k_delayed_work work;
-    bool work_is_cancelled;
+    struct behavior_hold_tap_data *data;
+    struct zmk_behavior_timer timer;
 
     // initialized to -1, which is to be interpreted as "no other key has been pressed yet"
     int32_t position_of_first_other_key_pressed;
+
+    // number of events at the tail of captured_events captured while this hold-tap was undecided
+    uint32_t captured_count;
 };
 
 // The undecided hold tap is the hold tap that needs to be decided before
 // other keypress events can be released. While the undecided_hold_tap is
 // not NULL, most events are captured in captured_events.
 // After the hold_tap is decided, it will stay in the active_hold_taps until
-// its key-up has been processed and the delayed work is cleaned up.
+// its key-up has been processed and its timer is stopped.
 struct active_hold_tap *undecided_hold_tap = NULL;
-struct active_hold_tap active_hold_taps[ZMK_BHV_HOLD_TAP_MAX_HELD] = {};
+ZMK_BEHAVIOR_REGISTRY_DEFINE(active_hold_taps, struct active_hold_tap, ZMK_BHV_HOLD_TAP_MAX_HELD);
 // We capture most position_state_changed events and some modifiers_state_changed events.
-const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS] = {};
+// They are kept in a ring buffer in the order they were captured. The events captured by a
+// hold-tap form a segment at the tail of the ring, and slots that were already released are
+// set to NULL until the head moves past them.
+static const zmk_event_t *captured_events[ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS];
+static uint32_t captured_head;
+static uint32_t captured_tail;
+// Bitmap of the positions whose key-down event is currently captured.
+static uint32_t captured_keydowns[ceiling_fraction(ZMK_KEYMAP_LEN, 32)];
 
 // Keep track of which key was tapped most recently for 'quick_tap_ms'
 struct last_tapped {
@@ -96,6 +122,14 @@ struct last_tapped {
 
 struct last_tapped last_tapped;
 
+// Keep track of which key was released most recently for 'require_prior_idle_ms'
+struct last_released {
+    int32_t position;
+    int64_t timestamp;
+};
+
+struct last_released last_released = {.position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED};
+
 static void store_last_tapped(struct active_hold_tap *hold_tap) {
     last_tapped.position = hold_tap->position;
     last_tapped.tap_deadline = hold_tap->timestamp + hold_tap->config->quick_tap_ms;
@@ -106,73 +140,117 @@ static bool is_quick_tap(struct active_hold_tap *hold_tap) {
            last_tapped.tap_deadline > hold_tap->timestamp;
 }
 
-static int capture_event(const zmk_event_t *event) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        if (captured_events[i] == NULL) {
-            captured_events[i] = event;
-            return 0;
-        }
+static const zmk_event_t **captured_slot(uint32_t index) {
+    return &captured_events[index % ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS];
+}
+
+static void set_keydown_captured(uint32_t position, bool captured) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        return;
+    }
+
+    if (captured) {
+        captured_keydowns[position / 32] |= BIT(position % 32);
+    } else {
+        captured_keydowns[position / 32] &= ~BIT(position % 32);
     }
-    return -ENOMEM;
 }
 
-static struct zmk_position_state_changed *find_captured_keydown_event(uint32_t position) {
-    struct zmk_position_state_changed *last_match = NULL;
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *eh = captured_events[i];
-        if (eh == NULL) {
-            return last_match;
-        }
-        struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(eh);
-        if (position_event == NULL) {
-            continue;
-        }
+static bool is_keydown_captured(uint32_t position) {
+    return position < ZMK_KEYMAP_LEN && (captured_keydowns[position / 32] & BIT(position % 32));
+}
 
-        if (position_event->position == position && position_event->state) {
-            last_match = position_event;
-        }
+static void compact_captured_events() {
+    while (captured_head != captured_tail && *captured_slot(captured_head) == NULL) {
+        captured_head++;
+    }
+
+    // Restart at the beginning once empty, so the indices never wrap.
+    if (captured_head == captured_tail) {
+        captured_head = 0;
+        captured_tail = 0;
     }
-    return last_match;
+}
+
+static void store_last_released(const struct zmk_position_state_changed *ev) {
+    // captured events are raised again later, so only keep the newest release
+    if (last_released.position != ZMK_BHV_HOLD_TAP_POSITION_NOT_USED &&
+        ev->timestamp < last_released.timestamp) {
+        return;
+    }
+    last_released.position = ev->position;
+    last_released.timestamp = ev->timestamp;
+}
+
+// During a typing streak a hold-tap is almost always meant as a tap.
+static bool is_prior_idle_broken(struct active_hold_tap *hold_tap) {
+    return hold_tap->config->require_prior_idle_ms >= 0 &&
+           last_released.position != ZMK_BHV_HOLD_TAP_POSITION_NOT_USED &&
+           last_released.position != hold_tap->position &&
+           last_released.timestamp + hold_tap->config->require_prior_idle_ms > hold_tap->timestamp;
+}
+
+static int capture_event(struct active_hold_tap *hold_tap, const zmk_event_t *event) {
+    if (captured_tail - captured_head >= ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS) {
+        return -ENOMEM;
+    }
+
+    *captured_slot(captured_tail++) = event;
+    hold_tap->captured_count++;
+
+    struct zmk_position_state_changed *position_event = as_zmk_position_state_changed(event);
+    if (position_event != NULL && position_event->state) {
+        set_keydown_captured(position_event->position, true);
+    }
+
+    return 0;
 }
 
 const struct zmk_listener zmk_listener_behavior_hold_tap;
 
-static void release_captured_events() {
+static void update_capture_stats(struct active_hold_tap *hold_tap, int64_t captured_at) {
+    struct zmk_behavior_hold_tap_stats *stats = &hold_tap->data->stats;
+    uint32_t delay_ms = MAX(k_uptime_get() - captured_at, 0);
+
+    stats->captured_events++;
+    stats->total_capture_delay_ms += delay_ms;
+    stats->max_capture_delay_ms = MAX(stats->max_capture_delay_ms, delay_ms);
+}
+
+static void release_captured_events(struct active_hold_tap *hold_tap) {
     if (undecided_hold_tap != NULL) {
         return;
     }
 
-    // We use a trick to prevent copying the captured_events array.
-    //
-    // Events for different mod-tap instances are separated by a NULL pointer.
+    // Only the segment captured by this hold-tap is released. Releasing an event can start a new
+    // undecided hold-tap, which captures the remaining events of this segment again as they are
+    // raised. Those land in its own segment at the tail of the ring, and if it is decided during
+    // this loop, it releases just that segment before we continue with ours.
     //
-    // The first event popped will never be catched by the next active hold-tap
-    // because to start capturing a mod-tap-key-down event must first completely
-    // go through the events queue.
-    //
-    // Example of this release process;
-    // [mt2_down, k1_down, k1_up, mt2_up, null, ...]
-    //  ^
+    // Example of this release process, | marks the start of a segment;
+    // [|mt2_down, k1_down, k1_up, mt2_up]
+    //   ^
     // mt2_down position event isn't captured because no hold-tap is active.
     // mt2_down behavior event is handled, now we have an undecided hold-tap
-    // [null, k1_down, k1_up, mt2_up, null, ...]
+    // [null, k1_down, k1_up, mt2_up, |]
     //        ^
-    // k1_down  is captured by the mt2 mod-tap
-    // !note that searches for find_captured_keydown_event by the mt2 behavior will stop at the
-    // first null encountered [mt1_down, null, k1_up, mt2_up, null, ...]
-    //                  ^
-    // k1_up event is captured by the new hold-tap:
-    // [k1_down, k1_up, null, mt2_up, null, ...]
-    //                        ^
-    // mt2_up event is not captured but causes release of mt2 behavior
-    // [k1_down, k1_up, null, null, null, ...]
-    // now mt2 will start releasing it's own captured positions.
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS; i++) {
-        const zmk_event_t *captured_event = captured_events[i];
-        if (captured_event == NULL) {
-            return;
-        }
-        captured_events[i] = NULL;
+    // k1_down is captured again by mt2
+    // [null, null, k1_up, mt2_up, |k1_down]
+    //              ^
+    // k1_up is captured by mt2, because its key-down is captured
+    // [null, null, null, mt2_up, |k1_down, k1_up]
+    //                    ^
+    // mt2_up event is not captured but causes release of mt2 behavior,
+    // which releases its own segment [k1_down, k1_up].
+    uint32_t end = captured_tail;
+    uint32_t start = end - hold_tap->captured_count;
+    hold_tap->captured_count = 0;
+
+    for (uint32_t i = start; i < end; i++) {
+        const zmk_event_t *captured_event = *captured_slot(i);
+        *captured_slot(i) = NULL;
+        compact_captured_events();
+
         if (undecided_hold_tap != NULL) {
             k_msleep(10);
         }
@@ -182,46 +260,46 @@ static void release_captured_events() {
         if ((position_event = as_zmk_position_state_changed(captured_event)) != NULL) {
             LOG_DBG("Releasing key position event for position %d %s", position_event->position,
                     (position_event->state ? "pressed" : "released"));
+            if (position_event->state) {
+                set_keydown_captured(position_event->position, false);
+            }
+            update_capture_stats(hold_tap, position_event->timestamp);
         } else if ((modifier_event = as_zmk_keycode_state_changed(captured_event)) != NULL) {
             LOG_DBG("Releasing mods changed event 0x%02X %s", modifier_event->keycode,
                     (modifier_event->state ? "pressed" : "released"));
+            update_capture_stats(hold_tap, modifier_event->timestamp);
         }
         ZMK_EVENT_RAISE_AT(captured_event, behavior_hold_tap);
     }
 }
 
 static struct active_hold_tap *find_hold_tap(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position == position) {
-            return &active_hold_taps[i];
-        }
-    }
-    return NULL;
+    return zmk_behavior_registry_find(&active_hold_taps, position);
 }
 
 static struct active_hold_tap *store_hold_tap(uint32_t position, uint32_t param_hold,
                                               uint32_t param_tap, int64_t timestamp,
-                                              const struct behavior_hold_tap_config *config) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        if (active_hold_taps[i].position != ZMK_BHV_HOLD_TAP_POSITION_NOT_USED) {
-            continue;
-        }
-        active_hold_taps[i].position = position;
-        active_hold_taps[i].status = STATUS_UNDECIDED;
-        active_hold_taps[i].config = config;
-        active_hold_taps[i].param_hold = param_hold;
-        active_hold_taps[i].param_tap = param_tap;
-        active_hold_taps[i].timestamp = timestamp;
-        active_hold_taps[i].position_of_first_other_key_pressed = -1;
-        return &active_hold_taps[i];
+                                              const struct behavior_hold_tap_config *config,
+                                              struct behavior_hold_tap_data *data) {
+    struct active_hold_tap *hold_tap = zmk_behavior_registry_alloc(&active_hold_taps, position);
+    if (hold_tap == NULL) {
+        return NULL;
     }
-    return NULL;
+    hold_tap->position = position;
+    hold_tap->status = STATUS_UNDECIDED;
+    hold_tap->config = config;
+    hold_tap->data = data;
+    hold_tap->param_hold = param_hold;
+    hold_tap->param_tap = param_tap;
+    hold_tap->timestamp = timestamp;
+    hold_tap->position_of_first_other_key_pressed = -1;
+    hold_tap->captured_count = 0;
+    return hold_tap;
 }
 
 static void clear_hold_tap(struct active_hold_tap *hold_tap) {
-    hold_tap->position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
+    zmk_behavior_registry_free(&active_hold_taps, hold_tap);
     hold_tap->status = STATUS_UNDECIDED;
-    hold_tap->work_is_cancelled = false;
 }
 
 static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_moment event) {
@@ -236,6 +314,7 @@ static void decide_balanced(struct active_hold_tap *hold_tap, enum decision_mome
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
+    case HT_PRIOR_IDLE:
         hold_tap->status = STATUS_TAP;
         return;
     default:
@@ -252,6 +331,7 @@ static void decide_tap_preferred(struct active_hold_tap *hold_tap, enum decision
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
+    case HT_PRIOR_IDLE:
         hold_tap->status = STATUS_TAP;
         return;
     default:
@@ -272,6 +352,7 @@ static void decide_tap_unless_interrupted(struct active_hold_tap *hold_tap,
         hold_tap->status = STATUS_TAP;
         return;
     case HT_QUICK_TAP:
+    case HT_PRIOR_IDLE:
         hold_tap->status = STATUS_TAP;
         return;
     default:
@@ -291,6 +372,7 @@ static void decide_hold_preferred(struct active_hold_tap *hold_tap, enum decisio
         hold_tap->status = STATUS_HOLD_TIMER;
         return;
     case HT_QUICK_TAP:
+    case HT_PRIOR_IDLE:
         hold_tap->status = STATUS_TAP;
         return;
     default:
@@ -338,6 +420,8 @@ static inline const char *decision_moment_str(enum decision_moment decision_mome
         return "other-key-up";
     case HT_QUICK_TAP:
         return "quick-tap";
+    case HT_PRIOR_IDLE:
+        return "prior-idle";
     case HT_TIMER_EVENT:
         return "timer";
     default:
@@ -421,6 +505,47 @@ static void decide_positional_hold(struct active_hold_tap *hold_tap) {
     hold_tap->status = STATUS_TAP;
 }
 
+static void update_stats(struct active_hold_tap *hold_tap, enum decision_moment decision_moment) {
+    struct zmk_behavior_hold_tap_stats *stats = &hold_tap->data->stats;
+    uint32_t delay_ms = MAX(k_uptime_get() - hold_tap->timestamp, 0);
+
+    switch (hold_tap->status) {
+    case STATUS_TAP:
+        stats->taps++;
+        if (decision_moment == HT_PRIOR_IDLE) {
+            stats->prior_idle_taps++;
+        }
+        break;
+    case STATUS_HOLD_INTERRUPT:
+        stats->hold_interrupts++;
+        break;
+    case STATUS_HOLD_TIMER:
+        stats->hold_timers++;
+        break;
+    default:
+        return;
+    }
+
+    stats->total_decision_delay_ms += delay_ms;
+    stats->max_decision_delay_ms = MAX(stats->max_decision_delay_ms, delay_ms);
+
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+    uint32_t bucket = MIN(delay_ms / CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKET_MS,
+                          CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKETS - 1);
+
+    stats->latency.moments[decision_moment]++;
+    stats->latency.histogram[bucket]++;
+
+    // combos trigger hold-taps on virtual positions past the end of the keymap
+    if (hold_tap->position < ZMK_KEYMAP_LEN) {
+        struct zmk_behavior_hold_tap_latency *latency =
+            &hold_tap->data->position_latency[hold_tap->position];
+        latency->moments[decision_moment]++;
+        latency->histogram[bucket]++;
+    }
+#endif
+}
+
 static void decide_hold_tap(struct active_hold_tap *hold_tap,
                             enum decision_moment decision_moment) {
     if (hold_tap->status != STATUS_UNDECIDED) {
@@ -453,6 +578,7 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
     }
 
     decide_positional_hold(hold_tap);
+    update_stats(hold_tap, decision_moment);
 
     // Since the hold-tap has been decided, clean up undecided_hold_tap and
     // execute the decided behavior.
@@ -461,7 +587,7 @@ static void decide_hold_tap(struct active_hold_tap *hold_tap,
             decision_moment_str(decision_moment));
     undecided_hold_tap = NULL;
     press_binding(hold_tap);
-    release_captured_events();
+    release_captured_events(hold_tap);
 }
 
 static void decide_retro_tap(struct active_hold_tap *hold_tap) {
@@ -471,6 +597,7 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
     if (hold_tap->status == STATUS_HOLD_TIMER) {
         release_binding(hold_tap);
         LOG_DBG("%d retro tap", hold_tap->position);
+        hold_tap->data->stats.retro_taps++;
         hold_tap->status = STATUS_TAP;
         press_binding(hold_tap);
         return;
@@ -478,11 +605,9 @@ static void decide_retro_tap(struct active_hold_tap *hold_tap) {
 }
 
 static void update_hold_status_for_retro_tap(uint32_t ignore_position) {
-    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-        struct active_hold_tap *hold_tap = &active_hold_taps[i];
-        if (hold_tap->position == ignore_position ||
-            hold_tap->position == ZMK_BHV_HOLD_TAP_POSITION_NOT_USED ||
-            hold_tap->config->retro_tap == false) {
+    for (struct active_hold_tap *hold_tap = zmk_behavior_registry_next(&active_hold_taps, NULL);
+         hold_tap != NULL; hold_tap = zmk_behavior_registry_next(&active_hold_taps, hold_tap)) {
+        if (hold_tap->position == ignore_position || hold_tap->config->retro_tap == false) {
             continue;
         }
         if (hold_tap->status == STATUS_HOLD_TIMER) {
@@ -497,6 +622,7 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
                                        struct zmk_behavior_binding_event event) {
     const struct device *dev = device_get_binding(binding->behavior_dev);
     const struct behavior_hold_tap_config *cfg = dev->config;
+    struct behavior_hold_tap_data *data = dev->data;
 
     if (undecided_hold_tap != NULL) {
         LOG_DBG("ERROR another hold-tap behavior is undecided.");
@@ -504,8 +630,8 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
         return ZMK_BEHAVIOR_OPAQUE;
     }
 
-    struct active_hold_tap *hold_tap =
-        store_hold_tap(event.position, binding->param1, binding->param2, event.timestamp, cfg);
+    struct active_hold_tap *hold_tap = store_hold_tap(event.position, binding->param1,
+                                                      binding->param2, event.timestamp, cfg, data);
     if (hold_tap == NULL) {
         LOG_ERR("unable to store hold-tap info, did you press more than %d hold-taps?",
                 ZMK_BHV_HOLD_TAP_MAX_HELD);
@@ -517,12 +643,13 @@ static int on_hold_tap_binding_pressed(struct zmk_behavior_binding *binding,
 
     if (is_quick_tap(hold_tap)) {
         decide_hold_tap(hold_tap, HT_QUICK_TAP);
+    } else if (is_prior_idle_broken(hold_tap)) {
+        // decided at key-down, so no events are captured for this hold-tap.
+        decide_hold_tap(hold_tap, HT_PRIOR_IDLE);
     }
 
-    // if this behavior was queued we have to adjust the timer to only
-    // wait for the remaining time.
-    int32_t tapping_term_ms_left = (hold_tap->timestamp + cfg->tapping_term_ms) - k_uptime_get();
-    k_delayed_work_submit(&hold_tap->work, K_MSEC(tapping_term_ms_left));
+    // if this behavior was queued the timer only waits for the remaining time.
+    zmk_behavior_timer_start(&hold_tap->timer, hold_tap->timestamp + cfg->tapping_term_ms);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -537,7 +664,7 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
 
     // If these events were queued, the timer event may be queued too late or not at all.
     // We insert a timer event before the TH_KEY_UP event to verify.
-    int work_cancel_result = k_delayed_work_cancel(&hold_tap->work);
+    zmk_behavior_timer_stop(&hold_tap->timer);
     if (event.timestamp > (hold_tap->timestamp + hold_tap->config->tapping_term_ms)) {
         decide_hold_tap(hold_tap, HT_TIMER_EVENT);
     }
@@ -546,15 +673,8 @@ static int on_hold_tap_binding_released(struct zmk_behavior_binding *binding,
     decide_retro_tap(hold_tap);
     release_binding(hold_tap);
 
-    if (work_cancel_result == -EINPROGRESS) {
-        // let the timer handler clean up
-        // if we'd clear now, the timer may call back for an uninitialized active_hold_tap.
-        LOG_DBG("%d hold-tap timer work in event queue", event.position);
-        hold_tap->work_is_cancelled = true;
-    } else {
-        LOG_DBG("%d cleaning up hold-tap", event.position);
-        clear_hold_tap(hold_tap);
-    }
+    LOG_DBG("%d cleaning up hold-tap", event.position);
+    clear_hold_tap(hold_tap);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -569,6 +689,10 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     update_hold_status_for_retro_tap(ev->position);
 
+    if (!ev->state) {
+        store_last_released(ev);
+    }
+
     if (undecided_hold_tap == NULL) {
         LOG_DBG("%d bubble (no undecided hold_tap active)", ev->position);
         return ZMK_EV_EVENT_BUBBLE;
@@ -600,7 +724,7 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
         decide_hold_tap(undecided_hold_tap, HT_TIMER_EVENT);
     }
 
-    if (!ev->state && find_captured_keydown_event(ev->position) == NULL) {
+    if (!ev->state && !is_keydown_captured(ev->position)) {
         // no keydown event has been captured, let it bubble.
         // we'll catch modifiers later in modifier_state_changed_listener
         LOG_DBG("%d bubbling %d %s event", undecided_hold_tap->position, ev->position,
@@ -610,7 +734,11 @@ static int position_state_changed_listener(const zmk_event_t *eh) {
 
     LOG_DBG("%d capturing %d %s event", undecided_hold_tap->position, ev->position,
             ev->state ? "down" : "up");
-    capture_event(eh);
+    if (capture_event(undecided_hold_tap, eh) != 0) {
+        LOG_ERR("unable to capture %d %s event, did you press more than %d keys?", ev->position,
+                ev->state ? "down" : "up", ZMK_BHV_HOLD_TAP_MAX_CAPTURED_EVENTS);
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     decide_hold_tap(undecided_hold_tap, ev->state ? HT_OTHER_KEY_DOWN : HT_OTHER_KEY_UP);
     return ZMK_EV_EVENT_CAPTURED;
 }
@@ -633,7 +761,10 @@ static int keycode_state_changed_listener(const zmk_event_t *eh) {
     // if a undecided_hold_tap is active.
     LOG_DBG("%d capturing 0x%02X %s event", undecided_hold_tap->position, ev->keycode,
             ev->state ? "down" : "up");
-    capture_event(eh);
+    if (capture_event(undecided_hold_tap, eh) != 0) {
+        LOG_ERR("unable to capture 0x%02X %s event", ev->keycode, ev->state ? "down" : "up");
+        return ZMK_EV_EVENT_BUBBLE;
+    }
     return ZMK_EV_EVENT_CAPTURED;
 }
 
@@ -651,31 +782,57 @@ ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_position_state_changed);
 // this should be modifiers_state_changed, but unfrotunately that's not implemented yet.
 ZMK_SUBSCRIPTION(behavior_hold_tap, zmk_keycode_state_changed);
 
-void behavior_hold_tap_timer_work_handler(struct k_work *item) {
-    struct active_hold_tap *hold_tap = CONTAINER_OF(item, struct active_hold_tap, work);
+void behavior_hold_tap_timer_handler(struct zmk_behavior_timer *timer) {
+    struct active_hold_tap *hold_tap = CONTAINER_OF(timer, struct active_hold_tap, timer);
 
-    if (hold_tap->work_is_cancelled) {
-        clear_hold_tap(hold_tap);
-    } else {
-        decide_hold_tap(hold_tap, HT_TIMER_EVENT);
-    }
+    decide_hold_tap(hold_tap, HT_TIMER_EVENT);
 }
 
 static int behavior_hold_tap_init(const struct device *dev) {
     static bool init_first_run = true;
 
     if (init_first_run) {
+        zmk_behavior_registry_init(&active_hold_taps);
         for (int i = 0; i < ZMK_BHV_HOLD_TAP_MAX_HELD; i++) {
-            k_delayed_work_init(&active_hold_taps[i].work, behavior_hold_tap_timer_work_handler);
-            active_hold_taps[i].position = ZMK_BHV_HOLD_TAP_POSITION_NOT_USED;
+            zmk_behavior_timer_init(&active_hold_taps_slots[i].timer,
+                                    behavior_hold_tap_timer_handler);
         }
     }
     init_first_run = false;
     return 0;
 }
 
-struct behavior_hold_tap_data {};
-static struct behavior_hold_tap_data behavior_hold_tap_data;
+int zmk_behavior_hold_tap_get_stats(const char *behavior_dev,
+                                    struct zmk_behavior_hold_tap_stats *stats) {
+    const struct device *dev = device_get_binding(behavior_dev);
+    if (dev == NULL || dev->api != &behavior_hold_tap_driver_api) {
+        return -ENODEV;
+    }
+
+    const struct behavior_hold_tap_data *data = dev->data;
+    *stats = data->stats;
+    return 0;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+
+int zmk_behavior_hold_tap_get_position_latency(const char *behavior_dev, uint32_t position,
+                                               struct zmk_behavior_hold_tap_latency *latency) {
+    const struct device *dev = device_get_binding(behavior_dev);
+    if (dev == NULL || dev->api != &behavior_hold_tap_driver_api) {
+        return -ENODEV;
+    }
+
+    if (position >= ZMK_KEYMAP_LEN) {
+        return -EINVAL;
+    }
+
+    const struct behavior_hold_tap_data *data = dev->data;
+    *latency = data->position_latency[position];
+    return 0;
+}
+
+#endif
 
 #define KP_INST(n)                                                                                 \
     static struct behavior_hold_tap_config behavior_hold_tap_config_##n = {                        \
@@ -683,15 +840,96 @@ static struct behavior_hold_tap_data behavior_hold_tap_data;
         .hold_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 0)),                     \
         .tap_behavior_dev = DT_LABEL(DT_INST_PHANDLE_BY_IDX(n, bindings, 1)),                      \
         .quick_tap_ms = DT_INST_PROP(n, quick_tap_ms),                                             \
+        .require_prior_idle_ms = DT_INST_PROP(n, require_prior_idle_ms),                           \
         .flavor = DT_ENUM_IDX(DT_DRV_INST(n), flavor),                                             \
         .retro_tap = DT_INST_PROP(n, retro_tap),                                                   \
         .hold_trigger_key_positions = DT_INST_PROP(n, hold_trigger_key_positions),                 \
         .hold_trigger_key_positions_len = DT_INST_PROP_LEN(n, hold_trigger_key_positions),         \
     };                                                                                             \
+    static struct behavior_hold_tap_data behavior_hold_tap_data_##n;                               \
     DEVICE_DT_INST_DEFINE(n, behavior_hold_tap_init, device_pm_control_nop,                        \
-                          &behavior_hold_tap_data, &behavior_hold_tap_config_##n, APPLICATION,     \
+                          &behavior_hold_tap_data_##n, &behavior_hold_tap_config_##n, APPLICATION, \
                           CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_hold_tap_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM) && IS_ENABLED(CONFIG_ARCH_POSIX)
+
+static void print_latency(const char *label, const char *scope,
+                          const struct zmk_behavior_hold_tap_latency *latency) {
+    printk("hold-tap %s %s: decided at", label, scope);
+    for (int i = 0; i < ZMK_BHV_HOLD_TAP_MOMENT_COUNT; i++) {
+        printk(" %s %u", decision_moment_str(i), latency->moments[i]);
+    }
+    printk("\nhold-tap %s %s: decided after", label, scope);
+    for (int i = 0; i < CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKETS; i++) {
+        printk(" %d+ms %u", i * CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM_BUCKET_MS,
+               latency->histogram[i]);
+    }
+    printk("\n");
+}
+
+static void print_stats(const char *label, const struct behavior_hold_tap_data *data) {
+    const struct zmk_behavior_hold_tap_stats *stats = &data->stats;
+    const uint32_t decisions = stats->taps + stats->hold_interrupts + stats->hold_timers;
+
+    if (decisions == 0) {
+        return;
+    }
+
+    printk("hold-tap %s: %u tap, %u hold-interrupt, %u hold-timer, %u prior-idle, %u retro-tap\n",
+           label, stats->taps, stats->hold_interrupts, stats->hold_timers,
+           stats->prior_idle_taps, stats->retro_taps);
+    printk("hold-tap %s: decision avg %u ms max %u ms\n", label,
+           (uint32_t)(stats->total_decision_delay_ms / decisions), stats->max_decision_delay_ms);
+    if (stats->captured_events > 0) {
+        printk("hold-tap %s: %u captured events, delay avg %u ms max %u ms\n", label,
+               stats->captured_events,
+               (uint32_t)(stats->total_capture_delay_ms / stats->captured_events),
+               stats->max_capture_delay_ms);
+    }
+    print_latency(label, "total", &stats->latency);
+
+    for (int i = 0; i < ZMK_KEYMAP_LEN; i++) {
+        const struct zmk_behavior_hold_tap_latency *latency = &data->position_latency[i];
+        uint32_t position_decisions = 0;
+        char scope[16];
+
+        for (int j = 0; j < ZMK_BHV_HOLD_TAP_MOMENT_COUNT; j++) {
+            position_decisions += latency->moments[j];
+        }
+        if (position_decisions == 0) {
+            continue;
+        }
+
+        snprintf(scope, sizeof(scope), "position %d", i);
+        print_latency(label, scope, latency);
+    }
+}
+
+#define PRINT_INST(n) print_stats(DT_INST_LABEL(n), &behavior_hold_tap_data_##n);
+
+// Dump the statistics when the native_posix build exits, e.g. at the end of a mock or replay run.
+static void behavior_hold_tap_dump_stats(void) { DT_INST_FOREACH_STATUS_OKAY(PRINT_INST) }
+
+NATIVE_TASK(behavior_hold_tap_dump_stats, ON_EXIT, 10);
+
+#endif
+
+#else
+
+int zmk_behavior_hold_tap_get_stats(const char *behavior_dev,
+                                    struct zmk_behavior_hold_tap_stats *stats) {
+    return -ENODEV;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BHV_HOLD_TAP_HISTOGRAM)
+
+int zmk_behavior_hold_tap_get_position_latency(const char *behavior_dev, uint32_t position,
+                                               struct zmk_behavior_hold_tap_latency *latency) {
+    return -ENODEV;
+}
+
+#endif
+
 #endif /* DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT) */
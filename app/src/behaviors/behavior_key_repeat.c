@@ -28,8 +28,17 @@ struct behavior_key_repeat_config {
 struct behavior_key_repeat_data {
     struct zmk_keycode_state_changed last_keycode_pressed;
     struct zmk_keycode_state_changed current_keycode_pressed;
+    // the usage pages to repeat, one bit per page. Built at init.
+    uint32_t usage_pages[256 / 32];
 };
 
+// the usage pages any instance repeats, so other keycodes are skipped without visiting them.
+static uint32_t repeated_usage_pages[256 / 32];
+
+static inline bool usage_page_is_set(const uint32_t *pages, uint16_t usage_page) {
+    return usage_page <= UINT8_MAX && (pages[usage_page / 32] & BIT(usage_page % 32)) != 0;
+}
+
 static int on_key_repeat_binding_pressed(struct zmk_behavior_binding *binding,
                                          struct zmk_behavior_binding_event event) {
     const struct device *dev = device_get_binding(binding->behavior_dev);
@@ -78,7 +87,7 @@ static const struct device *devs[DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)];
 
 static int key_repeat_keycode_state_changed_listener(const zmk_event_t *eh) {
     struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
-    if (ev == NULL || !ev->state) {
+    if (ev == NULL || !ev->state || !usage_page_is_set(repeated_usage_pages, ev->usage_page)) {
         return ZMK_EV_EVENT_BUBBLE;
     }
 
@@ -89,14 +98,9 @@ static int key_repeat_keycode_state_changed_listener(const zmk_event_t *eh) {
         }
 
         struct behavior_key_repeat_data *data = dev->data;
-        const struct behavior_key_repeat_config *config = dev->config;
-
-        for (int u = 0; u < config->usage_pages_count; u++) {
-            if (config->usage_pages[u] == ev->usage_page) {
-                memcpy(&data->last_keycode_pressed, ev, sizeof(struct zmk_keycode_state_changed));
-                data->last_keycode_pressed.implicit_modifiers |= zmk_hid_get_explicit_mods();
-                break;
-            }
+        if (usage_page_is_set(data->usage_pages, ev->usage_page)) {
+            memcpy(&data->last_keycode_pressed, ev, sizeof(struct zmk_keycode_state_changed));
+            data->last_keycode_pressed.implicit_modifiers |= zmk_hid_get_explicit_mods();
         }
     }
 
@@ -105,7 +109,21 @@ static int key_repeat_keycode_state_changed_listener(const zmk_event_t *eh) {
 
 static int behavior_key_repeat_init(const struct device *dev) {
     const struct behavior_key_repeat_config *config = dev->config;
+    struct behavior_key_repeat_data *data = dev->data;
+
     devs[config->index] = dev;
+
+    for (int u = 0; u < config->usage_pages_count; u++) {
+        const uint16_t page = config->usage_pages[u];
+        if (page > UINT8_MAX) {
+            LOG_WRN("Key repeat ignores usage page 0x%04X, only pages up to 0xFF are supported",
+                    page);
+            continue;
+        }
+        data->usage_pages[page / 32] |= BIT(page % 32);
+        repeated_usage_pages[page / 32] |= BIT(page % 32);
+    }
+
     return 0;
 }
 
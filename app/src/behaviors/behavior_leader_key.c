@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_behavior_leader_key
+
+#include <device.h>
+#include <drivers/behavior.h>
+#include <logging/log.h>
+#include <dt-bindings/zmk/modifiers.h>
+#include <zmk/behavior.h>
+#include <zmk/behavior_queue.h>
+#include <zmk/behavior_timer.h>
+#include <zmk/hid.h>
+#include <zmk/keymap.h>
+#include <zmk/keys.h>
+#include <zmk/leader.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/keycode_state_changed.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
+
+BUILD_ASSERT(DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT) == 1, "Only one leader key is supported");
+
+// generated from the leader key sequences by app/scripts/leader_trie.py
+#include <zmk_leader_trie.h>
+
+struct leader_sequence {
+    const struct zmk_behavior_binding *bindings;
+    size_t bindings_count;
+};
+
+#define SEQUENCE_BINDING(idx, node) ZMK_KEYMAP_EXTRACT_BINDING(idx, node),
+
+#define SEQUENCE_BINDINGS(node)                                                                    \
+    static const struct zmk_behavior_binding _CONCAT(leader_bindings_, node)[] = {                 \
+        UTIL_LISTIFY(DT_PROP_LEN(node, bindings), SEQUENCE_BINDING, node)};
+
+#define SEQUENCE(node)                                                                             \
+    {.bindings = _CONCAT(leader_bindings_, node), .bindings_count = DT_PROP_LEN(node, bindings)},
+
+DT_FOREACH_CHILD(DT_DRV_INST(0), SEQUENCE_BINDINGS)
+
+static const struct leader_sequence leader_sequences[] = {
+    DT_FOREACH_CHILD(DT_DRV_INST(0), SEQUENCE)};
+
+BUILD_ASSERT(ARRAY_SIZE(leader_sequences) == ZMK_LEADER_SEQUENCE_COUNT,
+             "The leader key trie does not match the devicetree");
+
+struct leader_state {
+    bool active;
+    // the trie node reached by the keys typed since the leader key
+    uint16_t node;
+    uint32_t position;
+    struct zmk_behavior_timer timeout_timer;
+    // keys consumed by the sequence, whose releases are consumed too
+    uint32_t held_keys[CONFIG_ZMK_BHV_LEADER_KEY_MAX_HELD];
+    uint8_t held_keys_count;
+};
+
+static struct leader_state leader;
+
+static const struct zmk_leader_edge *find_edge(const struct zmk_leader_node *node, uint32_t key) {
+    int low = node->first_edge;
+    int high = node->first_edge + node->edge_count - 1;
+
+    while (low <= high) {
+        int mid = (low + high) / 2;
+        if (zmk_leader_edges[mid].key == key) {
+            return &zmk_leader_edges[mid];
+        } else if (zmk_leader_edges[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return NULL;
+}
+
+// A running leader sequence. Each sequence runs on its own stream, so it is never cut short by a
+// full behavior queue, which could leave a binding pressed.
+struct leader_stream {
+    struct zmk_behavior_queue_stream stream;
+    const struct leader_sequence *sequence;
+    // the next step, each binding is pressed and then released
+    uint16_t step;
+};
+
+static struct leader_stream leader_streams[CONFIG_ZMK_BHV_LEADER_KEY_MAX_RUNNING];
+
+static bool leader_stream_next(struct zmk_behavior_queue_stream *stream,
+                               struct zmk_behavior_queue_step *step) {
+    struct leader_stream *leader_stream = CONTAINER_OF(stream, struct leader_stream, stream);
+
+    if (leader_stream->step >= 2 * leader_stream->sequence->bindings_count) {
+        return false;
+    }
+
+    const bool press = leader_stream->step % 2 == 0;
+    *step = (struct zmk_behavior_queue_step){
+        .binding = &leader_stream->sequence->bindings[leader_stream->step / 2],
+        .press = press,
+        .wait = press ? DT_INST_PROP(0, tap_ms) : DT_INST_PROP(0, wait_ms),
+    };
+    leader_stream->step++;
+    return true;
+}
+
+static void run_sequence(int16_t index) {
+    const struct leader_sequence *sequence = &leader_sequences[index];
+
+    LOG_DBG("leader sequence %d: %d bindings", index, sequence->bindings_count);
+
+    for (int i = 0; i < CONFIG_ZMK_BHV_LEADER_KEY_MAX_RUNNING; i++) {
+        struct leader_stream *leader_stream = &leader_streams[i];
+        if (leader_stream->stream.running) {
+            continue;
+        }
+
+        leader_stream->sequence = sequence;
+        leader_stream->step = 0;
+        zmk_behavior_queue_stream_init(&leader_stream->stream, leader_stream_next);
+        zmk_behavior_queue_stream_start(&leader_stream->stream, leader.position);
+        return;
+    }
+
+    LOG_ERR("Unable to run leader sequence; already %d running. Increase "
+            "CONFIG_ZMK_BHV_LEADER_KEY_MAX_RUNNING",
+            CONFIG_ZMK_BHV_LEADER_KEY_MAX_RUNNING);
+}
+
+// Leaves leader mode, running the sequence ending at the current node if there is one.
+static void leader_finish() {
+    const int16_t sequence = zmk_leader_nodes[leader.node].sequence;
+
+    leader.active = false;
+    zmk_behavior_timer_stop(&leader.timeout_timer);
+
+    if (sequence < 0) {
+        LOG_DBG("leader sequence cancelled");
+        return;
+    }
+    run_sequence(sequence);
+}
+
+static void leader_timeout_handler(struct zmk_behavior_timer *timer) {
+    LOG_DBG("leader key timed out");
+    leader_finish();
+}
+
+static int on_leader_key_binding_pressed(struct zmk_behavior_binding *binding,
+                                         struct zmk_behavior_binding_event event) {
+    LOG_DBG("leader key pressed at %d", event.position);
+
+    leader.active = true;
+    leader.node = 0;
+    leader.position = event.position;
+    zmk_behavior_timer_start(&leader.timeout_timer, event.timestamp + DT_INST_PROP(0, timeout_ms));
+
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static int on_leader_key_binding_released(struct zmk_behavior_binding *binding,
+                                          struct zmk_behavior_binding_event event) {
+    return ZMK_BEHAVIOR_OPAQUE;
+}
+
+static const struct behavior_driver_api behavior_leader_key_driver_api = {
+    .binding_pressed = on_leader_key_binding_pressed,
+    .binding_released = on_leader_key_binding_released,
+};
+
+static bool release_held_key(uint32_t key) {
+    for (int i = 0; i < leader.held_keys_count; i++) {
+        if (leader.held_keys[i] == key) {
+            leader.held_keys[i] = leader.held_keys[--leader.held_keys_count];
+            return true;
+        }
+    }
+    return false;
+}
+
+static int leader_key_keycode_state_changed_listener(const zmk_event_t *eh) {
+    struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
+    if (ev == NULL || (!leader.active && leader.held_keys_count == 0)) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    const uint32_t usage = HID_USAGE((uint32_t)ev->usage_page, ev->keycode);
+
+    if (!ev->state) {
+        return release_held_key(usage) ? ZMK_EV_EVENT_HANDLED : ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (!leader.active || is_mod(ev->usage_page, ev->keycode)) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (leader.held_keys_count < CONFIG_ZMK_BHV_LEADER_KEY_MAX_HELD) {
+        leader.held_keys[leader.held_keys_count++] = usage;
+    } else {
+        LOG_WRN("Too many keys held during a leader sequence, a key release will be sent");
+    }
+
+    // held modifiers are part of the key, so holding shift and typing B matches LS(B)
+    const uint32_t key =
+        APPLY_MODS((uint32_t)(ev->implicit_modifiers | zmk_hid_get_explicit_mods()), usage);
+    const struct zmk_leader_edge *edge = find_edge(&zmk_leader_nodes[leader.node], key);
+    if (edge == NULL) {
+        LOG_DBG("no leader sequence continues with 0x%08x", key);
+        leader_finish();
+        return ZMK_EV_EVENT_HANDLED;
+    }
+
+    leader.node = edge->node;
+    if (zmk_leader_nodes[leader.node].edge_count == 0) {
+        // no longer sequence starts with this one, so there is nothing to wait for
+        leader_finish();
+    } else {
+        zmk_behavior_timer_start(&leader.timeout_timer,
+                                 ev->timestamp + DT_INST_PROP(0, timeout_ms));
+    }
+
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+ZMK_LISTENER(behavior_leader_key, leader_key_keycode_state_changed_listener);
+ZMK_SUBSCRIPTION(behavior_leader_key, zmk_keycode_state_changed);
+
+static int behavior_leader_key_init(const struct device *dev) {
+    zmk_behavior_timer_init(&leader.timeout_timer, leader_timeout_handler);
+    return 0;
+}
+
+DEVICE_DT_INST_DEFINE(0, behavior_leader_key_init, device_pm_control_nop, NULL, NULL, APPLICATION,
+                      CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_leader_key_driver_api);
+
+#endif
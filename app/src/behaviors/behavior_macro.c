@@ -23,6 +23,24 @@ enum behavior_macro_mode {
     MACRO_MODE_RELEASE,
 };
 
+enum behavior_macro_opcode {
+    MACRO_OP_MODE,
+    MACRO_OP_TAP_TIME,
+    MACRO_OP_WAIT_TIME,
+    MACRO_OP_PAUSE,
+    MACRO_OP_INVOKE,
+};
+
+// A macro binding, compiled at build time so running the macro needs no label comparisons.
+struct behavior_macro_op {
+    // the behavior of a MACRO_OP_INVOKE binding.
+    const struct device *behavior;
+    enum behavior_macro_opcode opcode : 3;
+    // the mode for MACRO_OP_MODE, the time for MACRO_OP_TAP_TIME and MACRO_OP_WAIT_TIME, or the
+    // index of the binding for MACRO_OP_INVOKE.
+    uint32_t arg : 29;
+};
+
 struct behavior_macro_trigger_state {
     uint32_t wait_ms;
     uint32_t tap_ms;
@@ -40,49 +58,30 @@ struct behavior_macro_state {
 struct behavior_macro_config {
     uint32_t default_wait_ms;
     uint32_t default_tap_ms;
+    bool paced;
     uint32_t count;
-    struct zmk_behavior_binding bindings[];
+    const struct behavior_macro_op *ops;
+    const struct zmk_behavior_binding *bindings;
 };
 
-#define TAP_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_tap))
-#define PRESS_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_press))
-#define REL_MODE DT_LABEL(DT_INST(0, zmk_macro_control_mode_release))
-
-#define TAP_TIME DT_LABEL(DT_INST(0, zmk_macro_control_tap_time))
-#define WAIT_TIME DT_LABEL(DT_INST(0, zmk_macro_control_wait_time))
-#define WAIT_REL DT_LABEL(DT_INST(0, zmk_macro_pause_for_release))
-
-#define ZM_IS_NODE_MATCH(a, b) (strcmp(a, b) == 0)
-#define IS_TAP_MODE(dev) ZM_IS_NODE_MATCH(dev, TAP_MODE)
-#define IS_PRESS_MODE(dev) ZM_IS_NODE_MATCH(dev, PRESS_MODE)
-#define IS_RELEASE_MODE(dev) ZM_IS_NODE_MATCH(dev, REL_MODE)
-
-#define IS_TAP_TIME(dev) ZM_IS_NODE_MATCH(dev, TAP_TIME)
-#define IS_WAIT_TIME(dev) ZM_IS_NODE_MATCH(dev, WAIT_TIME)
-#define IS_PAUSE(dev) ZM_IS_NODE_MATCH(dev, WAIT_REL)
-
-static bool handle_control_binding(struct behavior_macro_trigger_state *state,
-                                   const struct zmk_behavior_binding *binding) {
-    if (IS_TAP_MODE(binding->behavior_dev)) {
-        state->mode = MACRO_MODE_TAP;
-        LOG_DBG("macro mode set: tap");
-    } else if (IS_PRESS_MODE(binding->behavior_dev)) {
-        state->mode = MACRO_MODE_PRESS;
-        LOG_DBG("macro mode set: press");
-    } else if (IS_RELEASE_MODE(binding->behavior_dev)) {
-        state->mode = MACRO_MODE_RELEASE;
-        LOG_DBG("macro mode set: release");
-    } else if (IS_TAP_TIME(binding->behavior_dev)) {
-        state->tap_ms = binding->param1;
+static bool handle_control_op(struct behavior_macro_trigger_state *state,
+                              struct behavior_macro_op op) {
+    switch (op.opcode) {
+    case MACRO_OP_MODE:
+        state->mode = op.arg;
+        LOG_DBG("macro mode set: %d", state->mode);
+        return true;
+    case MACRO_OP_TAP_TIME:
+        state->tap_ms = op.arg;
         LOG_DBG("macro tap time set: %d", state->tap_ms);
-    } else if (IS_WAIT_TIME(binding->behavior_dev)) {
-        state->wait_ms = binding->param1;
+        return true;
+    case MACRO_OP_WAIT_TIME:
+        state->wait_ms = op.arg;
         LOG_DBG("macro wait time set: %d", state->wait_ms);
-    } else {
+        return true;
+    default:
         return false;
     }
-
-    return true;
 }
 
 static int behavior_macro_init(const struct device *dev) {
@@ -94,9 +93,9 @@ static int behavior_macro_init(const struct device *dev) {
 
     LOG_DBG("Precalculate initial release state:");
     for (int i = 0; i < cfg->count; i++) {
-        if (handle_control_binding(&state->release_state, &cfg->bindings[i])) {
+        if (handle_control_op(&state->release_state, cfg->ops[i])) {
             // Updated state used for initial state on release.
-        } else if (IS_PAUSE(cfg->bindings[i].behavior_dev)) {
+        } else if (cfg->ops[i].opcode == MACRO_OP_PAUSE) {
             state->release_state.start_index = i + 1;
             state->release_state.count = cfg->count - state->release_state.start_index;
             state->press_bindings_count = i;
@@ -110,27 +109,193 @@ static int behavior_macro_init(const struct device *dev) {
     return 0;
 };
 
-static void queue_macro(uint32_t position, const struct zmk_behavior_binding bindings[],
-                        struct behavior_macro_trigger_state state) {
-    LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
-    for (int i = state.start_index; i < state.start_index + state.count; i++) {
-        if (!handle_control_binding(&state, &bindings[i])) {
-            switch (state.mode) {
-            case MACRO_MODE_TAP:
-                zmk_behavior_queue_add(position, bindings[i], true, state.tap_ms);
-                zmk_behavior_queue_add(position, bindings[i], false, state.wait_ms);
-                break;
-            case MACRO_MODE_PRESS:
-                zmk_behavior_queue_add(position, bindings[i], true, state.wait_ms);
-                break;
-            case MACRO_MODE_RELEASE:
-                zmk_behavior_queue_add(position, bindings[i], false, state.wait_ms);
-                break;
-            default:
-                LOG_ERR("Unknown macro mode: %d", state.mode);
-                break;
+// A running invocation of a macro.
+struct behavior_macro_stream {
+    struct zmk_behavior_queue_stream stream;
+    const struct behavior_macro_config *cfg;
+    struct behavior_macro_trigger_state state;
+    // set once the release bindings are part of this stream.
+    bool released;
+    // release bindings to continue with, if the macro was released while its press bindings run.
+    bool release_pending;
+    struct behavior_macro_trigger_state release_state;
+    // in tap mode, the binding to release after its tap time.
+    const struct zmk_behavior_binding *tap_release;
+    const struct device *tap_release_behavior;
+#if IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK)
+    int64_t started_at;
+    uint32_t presses;
+#endif
+};
+
+static struct behavior_macro_stream macro_streams[CONFIG_ZMK_MACRO_MAX_RUNNING];
+
+// A macro press or release which found every stream in use, started once a stream is free.
+struct behavior_macro_pending {
+    const struct behavior_macro_config *cfg;
+    struct behavior_macro_trigger_state state;
+    uint32_t position;
+    bool release;
+};
+
+K_MSGQ_DEFINE(macro_pending_msgq, sizeof(struct behavior_macro_pending),
+              CONFIG_ZMK_MACRO_PENDING_QUEUE_SIZE, 4);
+
+static void start_pending_macros(struct k_work *work);
+
+K_WORK_DEFINE(macro_pending_work, start_pending_macros);
+
+#if IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK)
+
+static void macro_benchmark(const struct behavior_macro_stream *macro) {
+    const uint32_t elapsed_ms = MAX(k_uptime_get() - macro->started_at, 1);
+
+    LOG_INF("%s macro typed %d characters", macro->cfg->paced ? "paced" : "timed", macro->presses);
+    // Printed directly, so the timings stay out of the test snapshots.
+    printk("macro: %u characters in %u ms, %u characters/s\n", macro->presses, elapsed_ms,
+           macro->presses * MSEC_PER_SEC / elapsed_ms);
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK) */
+
+static bool macro_stream_next(struct zmk_behavior_queue_stream *stream,
+                              struct zmk_behavior_queue_step *step) {
+    struct behavior_macro_stream *macro =
+        CONTAINER_OF(stream, struct behavior_macro_stream, stream);
+    struct behavior_macro_trigger_state *state = &macro->state;
+
+    if (macro->tap_release != NULL) {
+        *step = (struct zmk_behavior_queue_step){.binding = macro->tap_release,
+                                                 .behavior = macro->tap_release_behavior,
+                                                 .press = false,
+                                                 .paced = macro->cfg->paced,
+                                                 .wait = state->wait_ms};
+        macro->tap_release = NULL;
+        return true;
+    }
+
+    for (;;) {
+        if (state->count == 0) {
+            if (!macro->release_pending) {
+#if IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK)
+                macro_benchmark(macro);
+#endif
+                // runs once this stream has finished and is free again.
+                if (k_msgq_num_used_get(&macro_pending_msgq) > 0) {
+                    k_work_submit(&macro_pending_work);
+                }
+                return false;
             }
+            *state = macro->release_state;
+            macro->release_pending = false;
+            continue;
         }
+
+        const struct behavior_macro_op op = macro->cfg->ops[state->start_index];
+        state->start_index++;
+        state->count--;
+        if (handle_control_op(state, op) || op.opcode != MACRO_OP_INVOKE) {
+            continue;
+        }
+
+        const struct zmk_behavior_binding *binding = &macro->cfg->bindings[op.arg];
+        *step = (struct zmk_behavior_queue_step){
+            .binding = binding, .behavior = op.behavior, .paced = macro->cfg->paced};
+        switch (state->mode) {
+        case MACRO_MODE_TAP:
+            step->press = true;
+            step->wait = state->tap_ms;
+            macro->tap_release = binding;
+            macro->tap_release_behavior = op.behavior;
+            break;
+        case MACRO_MODE_PRESS:
+            step->press = true;
+            step->wait = state->wait_ms;
+            break;
+        case MACRO_MODE_RELEASE:
+            step->press = false;
+            step->wait = state->wait_ms;
+            break;
+        default:
+            LOG_ERR("Unknown macro mode: %d", state->mode);
+            continue;
+        }
+
+#if IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK)
+        macro->presses += step->press;
+#endif
+        return true;
+    }
+}
+
+/* Returns true if the release follows the macro's press bindings, which are still running. */
+static bool continue_with_release(const struct behavior_macro_pending *pending) {
+    for (int i = 0; i < CONFIG_ZMK_MACRO_MAX_RUNNING; i++) {
+        struct behavior_macro_stream *macro = &macro_streams[i];
+        if (macro->stream.running && !macro->released && macro->cfg == pending->cfg &&
+            macro->stream.position == pending->position) {
+            macro->released = true;
+            macro->release_pending = true;
+            macro->release_state = pending->state;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Returns false if every stream is in use. */
+static bool run_macro(const struct behavior_macro_pending *pending) {
+    if (pending->release && continue_with_release(pending)) {
+        return true;
+    }
+
+    for (int i = 0; i < CONFIG_ZMK_MACRO_MAX_RUNNING; i++) {
+        struct behavior_macro_stream *macro = &macro_streams[i];
+        if (macro->stream.running) {
+            continue;
+        }
+
+        *macro = (struct behavior_macro_stream){
+            .cfg = pending->cfg, .state = pending->state, .released = pending->release};
+#if IS_ENABLED(CONFIG_ZMK_MACRO_BENCHMARK)
+        macro->started_at = k_uptime_get();
+#endif
+        zmk_behavior_queue_stream_init(&macro->stream, macro_stream_next);
+        zmk_behavior_queue_stream_start(&macro->stream, pending->position);
+        return true;
+    }
+
+    return false;
+}
+
+static void start_pending_macros(struct k_work *work) {
+    struct behavior_macro_pending pending;
+
+    while (k_msgq_peek(&macro_pending_msgq, &pending) == 0 && run_macro(&pending)) {
+        k_msgq_get(&macro_pending_msgq, &pending, K_NO_WAIT);
+    }
+}
+
+static void queue_macro(uint32_t position, const struct behavior_macro_config *cfg,
+                        struct behavior_macro_trigger_state state, bool release) {
+    const struct behavior_macro_pending pending = {
+        .cfg = cfg, .state = state, .position = position, .release = release};
+
+    LOG_DBG("Iterating macro bindings - starting: %d, count: %d", state.start_index, state.count);
+    if (release && continue_with_release(&pending)) {
+        return;
+    }
+
+    // macros triggered before this one wait first, so they still start in the order triggered.
+    if (k_msgq_num_used_get(&macro_pending_msgq) == 0 && run_macro(&pending)) {
+        return;
+    }
+
+    if (k_msgq_put(&macro_pending_msgq, &pending, K_NO_WAIT) != 0) {
+        LOG_ERR("Unable to queue macro; already %d waiting. Increase "
+                "CONFIG_ZMK_MACRO_PENDING_QUEUE_SIZE",
+                CONFIG_ZMK_MACRO_PENDING_QUEUE_SIZE);
     }
 }
 
@@ -145,7 +310,7 @@ static int on_macro_binding_pressed(struct zmk_behavior_binding *binding,
                                                          .start_index = 0,
                                                          .count = state->press_bindings_count};
 
-    queue_macro(event.position, cfg->bindings, trigger_state);
+    queue_macro(event.position, cfg, trigger_state, false);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -156,7 +321,7 @@ static int on_macro_binding_released(struct zmk_behavior_binding *binding,
     const struct behavior_macro_config *cfg = dev->config;
     struct behavior_macro_state *state = dev->data;
 
-    queue_macro(event.position, cfg->bindings, state->release_state);
+    queue_macro(event.position, cfg, state->release_state, true);
 
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -169,15 +334,53 @@ static const struct behavior_driver_api behavior_macro_driver_api = {
 #define BINDING_WITH_COMMA(idx, drv_inst) ZMK_KEYMAP_EXTRACT_BINDING(idx, DT_DRV_INST(drv_inst)),
 
 #define TRANSFORMED_BEHAVIORS(n)                                                                   \
-    {UTIL_LISTIFY(DT_PROP_LEN(DT_DRV_INST(n), bindings), BINDING_WITH_COMMA, n)},
+    {UTIL_LISTIFY(DT_PROP_LEN(DT_DRV_INST(n), bindings), BINDING_WITH_COMMA, n)}
+
+#define MACRO_PARAM1(n, idx)                                                                       \
+    COND_CODE_0(DT_PHA_HAS_CELL_AT_IDX(DT_DRV_INST(n), bindings, idx, param1), (0),                \
+                (DT_INST_PHA_BY_IDX(n, bindings, idx, param1)))
+
+#define MACRO_CONTROL_OP(op, value) {.opcode = op, .arg = value}
+
+// The control bindings of macros.dtsi are not devices, any other binding is invoked.
+#define MACRO_OP_FOR_NODE(node, idx, n)                                                            \
+    COND_CODE_1(                                                                                   \
+        DT_NODE_HAS_COMPAT(node, zmk_macro_control_mode_tap),                                      \
+        (MACRO_CONTROL_OP(MACRO_OP_MODE, MACRO_MODE_TAP)),                                         \
+        (COND_CODE_1(                                                                              \
+            DT_NODE_HAS_COMPAT(node, zmk_macro_control_mode_press),                                \
+            (MACRO_CONTROL_OP(MACRO_OP_MODE, MACRO_MODE_PRESS)),                                   \
+            (COND_CODE_1(                                                                          \
+                DT_NODE_HAS_COMPAT(node, zmk_macro_control_mode_release),                          \
+                (MACRO_CONTROL_OP(MACRO_OP_MODE, MACRO_MODE_RELEASE)),                             \
+                (COND_CODE_1(                                                                      \
+                    DT_NODE_HAS_COMPAT(node, zmk_macro_control_tap_time),                          \
+                    (MACRO_CONTROL_OP(MACRO_OP_TAP_TIME, MACRO_PARAM1(n, idx))),                   \
+                    (COND_CODE_1(                                                                  \
+                        DT_NODE_HAS_COMPAT(node, zmk_macro_control_wait_time),                     \
+                        (MACRO_CONTROL_OP(MACRO_OP_WAIT_TIME, MACRO_PARAM1(n, idx))),              \
+                        (COND_CODE_1(DT_NODE_HAS_COMPAT(node, zmk_macro_pause_for_release),        \
+                                     (MACRO_CONTROL_OP(MACRO_OP_PAUSE, 0)),                        \
+                                     ({.behavior = DEVICE_DT_GET(node),                            \
+                                       .opcode = MACRO_OP_INVOKE,                                  \
+                                       .arg = idx}))))))))))))
+
+#define MACRO_OP_WITH_COMMA(idx, n)                                                                \
+    MACRO_OP_FOR_NODE(DT_INST_PHANDLE_BY_IDX(n, bindings, idx), idx, n),
 
 #define MACRO_INST(n)                                                                              \
     static struct behavior_macro_state behavior_macro_state_##n = {};                              \
-    static struct behavior_macro_config behavior_macro_config_##n = {                              \
-        .default_wait_ms = DT_INST_PROP_OR(n, wait_ms, 100),                                       \
-        .default_tap_ms = DT_INST_PROP_OR(n, tap_ms, 100),                                         \
+    static const struct behavior_macro_op behavior_macro_ops_##n[] = {                             \
+        UTIL_LISTIFY(DT_INST_PROP_LEN(n, bindings), MACRO_OP_WITH_COMMA, n)};                      \
+    static const struct zmk_behavior_binding behavior_macro_bindings_##n[] =                       \
+        TRANSFORMED_BEHAVIORS(n);                                                                  \
+    static const struct behavior_macro_config behavior_macro_config_##n = {                        \
+        .default_wait_ms = DT_INST_PROP(n, paced) ? 0 : DT_INST_PROP_OR(n, wait_ms, 100),          \
+        .default_tap_ms = DT_INST_PROP(n, paced) ? 0 : DT_INST_PROP_OR(n, tap_ms, 100),            \
+        .paced = DT_INST_PROP(n, paced),                                                           \
         .count = DT_INST_PROP_LEN(n, bindings),                                                    \
-        .bindings = TRANSFORMED_BEHAVIORS(n)};                                                     \
+        .ops = behavior_macro_ops_##n,                                                             \
+        .bindings = behavior_macro_bindings_##n};                                                  \
     DEVICE_DT_INST_DEFINE(n, behavior_macro_init, device_pm_control_nop,                           \
                           &behavior_macro_state_##n, &behavior_macro_config_##n, APPLICATION,      \
                           CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_macro_driver_api);
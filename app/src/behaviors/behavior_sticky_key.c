@@ -10,6 +10,8 @@
 #include <drivers/behavior.h>
 #include <logging/log.h>
 #include <zmk/behavior.h>
+#include <zmk/behavior_registry.h>
+#include <zmk/behavior_timer.h>
 
 #include <zmk/matrix.h>
 #include <zmk/endpoints.h>
@@ -24,10 +26,6 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_STICKY_KEY_MAX_HELD 10
-
-#define ZMK_BHV_STICKY_KEY_POSITION_FREE ULONG_MAX
-
 struct behavior_sticky_key_config {
     uint32_t release_after_ms;
     bool quick_release;
@@ -42,50 +40,41 @@ struct active_sticky_key {
     const struct behavior_sticky_key_config *config;
     // timer data.
     bool timer_started;
-    bool timer_cancelled;
     int64_t release_at;
-    struct k_delayed_work release_timer;
+    struct zmk_behavior_timer release_timer;
     // usage page and keycode for the key that is being modified by this sticky key
     uint8_t modified_key_usage_page;
     uint32_t modified_key_keycode;
 };
 
-struct active_sticky_key active_sticky_keys[ZMK_BHV_STICKY_KEY_MAX_HELD] = {};
+ZMK_BEHAVIOR_REGISTRY_DEFINE(active_sticky_keys, struct active_sticky_key,
+                             CONFIG_ZMK_BHV_STICKY_KEY_MAX_HELD);
 
 static struct active_sticky_key *store_sticky_key(uint32_t position, uint32_t param1,
                                                   uint32_t param2,
                                                   const struct behavior_sticky_key_config *config) {
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        struct active_sticky_key *const sticky_key = &active_sticky_keys[i];
-        if (sticky_key->position != ZMK_BHV_STICKY_KEY_POSITION_FREE ||
-            sticky_key->timer_cancelled) {
-            continue;
-        }
-        sticky_key->position = position;
-        sticky_key->param1 = param1;
-        sticky_key->param2 = param2;
-        sticky_key->config = config;
-        sticky_key->release_at = 0;
-        sticky_key->timer_cancelled = false;
-        sticky_key->timer_started = false;
-        sticky_key->modified_key_usage_page = 0;
-        sticky_key->modified_key_keycode = 0;
-        return sticky_key;
+    struct active_sticky_key *const sticky_key =
+        zmk_behavior_registry_alloc(&active_sticky_keys, position);
+    if (sticky_key == NULL) {
+        return NULL;
     }
-    return NULL;
+    sticky_key->position = position;
+    sticky_key->param1 = param1;
+    sticky_key->param2 = param2;
+    sticky_key->config = config;
+    sticky_key->release_at = 0;
+    sticky_key->timer_started = false;
+    sticky_key->modified_key_usage_page = 0;
+    sticky_key->modified_key_keycode = 0;
+    return sticky_key;
 }
 
 static void clear_sticky_key(struct active_sticky_key *sticky_key) {
-    sticky_key->position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
+    zmk_behavior_registry_free(&active_sticky_keys, sticky_key);
 }
 
 static struct active_sticky_key *find_sticky_key(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        if (active_sticky_keys[i].position == position && !active_sticky_keys[i].timer_cancelled) {
-            return &active_sticky_keys[i];
-        }
-    }
-    return NULL;
+    return zmk_behavior_registry_find(&active_sticky_keys, position);
 }
 
 static inline int press_sticky_key_behavior(struct active_sticky_key *sticky_key,
@@ -118,13 +107,8 @@ static inline int release_sticky_key_behavior(struct active_sticky_key *sticky_k
     return behavior_keymap_binding_released(&binding, event);
 }
 
-static int stop_timer(struct active_sticky_key *sticky_key) {
-    int timer_cancel_result = k_delayed_work_cancel(&sticky_key->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        sticky_key->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_sticky_key *sticky_key) {
+    zmk_behavior_timer_stop(&sticky_key->release_timer);
 }
 
 static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
@@ -140,7 +124,7 @@ static int on_sticky_key_binding_pressed(struct zmk_behavior_binding *binding,
     sticky_key = store_sticky_key(event.position, binding->param1, binding->param2, cfg);
     if (sticky_key == NULL) {
         LOG_ERR("unable to store sticky key, did you press more than %d sticky_key?",
-                ZMK_BHV_STICKY_KEY_MAX_HELD);
+                CONFIG_ZMK_BHV_STICKY_KEY_MAX_HELD);
         return ZMK_BEHAVIOR_OPAQUE;
     }
 
@@ -166,9 +150,8 @@ static int on_sticky_key_binding_released(struct zmk_behavior_binding *binding,
     sticky_key->timer_started = true;
     sticky_key->release_at = event.timestamp + sticky_key->config->release_after_ms;
     // adjust timer in case this behavior was queued by a hold-tap
-    int32_t ms_left = sticky_key->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_delayed_work_submit(&sticky_key->release_timer, K_MSEC(ms_left));
+    if (sticky_key->release_at > k_uptime_get()) {
+        zmk_behavior_timer_start(&sticky_key->release_timer, sticky_key->release_at);
     }
     return ZMK_BEHAVIOR_OPAQUE;
 }
@@ -184,6 +167,11 @@ ZMK_LISTENER(behavior_sticky_key, sticky_key_keycode_state_changed_listener);
 ZMK_SUBSCRIPTION(behavior_sticky_key, zmk_keycode_state_changed);
 
 static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
+    // most keycodes are pressed while no sticky key is active.
+    if (zmk_behavior_registry_is_empty(&active_sticky_keys)) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
     struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
     if (ev == NULL) {
         return ZMK_EV_EVENT_BUBBLE;
@@ -191,12 +179,10 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
 
     // keep track whether the event has been reraised, so we only reraise it once
     bool event_reraised = false;
-    for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-        struct active_sticky_key *sticky_key = &active_sticky_keys[i];
-        if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
-            continue;
-        }
-
+    for (struct active_sticky_key *sticky_key =
+             zmk_behavior_registry_next(&active_sticky_keys, NULL);
+         sticky_key != NULL;
+         sticky_key = zmk_behavior_registry_next(&active_sticky_keys, sticky_key)) {
         if (strcmp(sticky_key->config->behavior.behavior_dev, "KEY_PRESS") == 0 &&
             HID_USAGE_ID(sticky_key->param1) == ev->keycode &&
             (HID_USAGE_PAGE(sticky_key->param1) & 0xFF) == ev->usage_page &&
@@ -251,26 +237,22 @@ static int sticky_key_keycode_state_changed_listener(const zmk_event_t *eh) {
     return ZMK_EV_EVENT_BUBBLE;
 }
 
-void behavior_sticky_key_timer_handler(struct k_work *item) {
+void behavior_sticky_key_timer_handler(struct zmk_behavior_timer *timer) {
     struct active_sticky_key *sticky_key =
-        CONTAINER_OF(item, struct active_sticky_key, release_timer);
-    if (sticky_key->position == ZMK_BHV_STICKY_KEY_POSITION_FREE) {
+        CONTAINER_OF(timer, struct active_sticky_key, release_timer);
+    if (!zmk_behavior_registry_is_active(&active_sticky_keys, sticky_key)) {
         return;
     }
-    if (sticky_key->timer_cancelled) {
-        sticky_key->timer_cancelled = false;
-    } else {
-        release_sticky_key_behavior(sticky_key, sticky_key->release_at);
-    }
+    release_sticky_key_behavior(sticky_key, sticky_key->release_at);
 }
 
 static int behavior_sticky_key_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
-        for (int i = 0; i < ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
-            k_delayed_work_init(&active_sticky_keys[i].release_timer,
-                                behavior_sticky_key_timer_handler);
-            active_sticky_keys[i].position = ZMK_BHV_STICKY_KEY_POSITION_FREE;
+        zmk_behavior_registry_init(&active_sticky_keys);
+        for (int i = 0; i < CONFIG_ZMK_BHV_STICKY_KEY_MAX_HELD; i++) {
+            zmk_behavior_timer_init(&active_sticky_keys_slots[i].release_timer,
+                                    behavior_sticky_key_timer_handler);
         }
     }
     init_first_run = false;
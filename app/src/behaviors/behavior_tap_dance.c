@@ -10,6 +10,8 @@
 #include <drivers/behavior.h>
 #include <logging/log.h>
 #include <zmk/behavior.h>
+#include <zmk/behavior_registry.h>
+#include <zmk/behavior_timer.h>
 #include <zmk/keymap.h>
 #include <zmk/matrix.h>
 #include <zmk/event_manager.h>
@@ -21,10 +23,6 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
 
-#define ZMK_BHV_TAP_DANCE_MAX_HELD 10
-
-#define ZMK_BHV_TAP_DANCE_POSITION_FREE ULONG_MAX
-
 struct behavior_tap_dance_config {
     uint32_t tapping_term_ms;
     size_t behavior_count;
@@ -41,63 +39,48 @@ struct active_tap_dance {
     const struct behavior_tap_dance_config *config;
 
     // Timer Data
-    bool timer_started;
-    bool timer_cancelled;
     bool tap_dance_decided;
     int64_t release_at;
-    struct k_delayed_work release_timer;
+    struct zmk_behavior_timer release_timer;
 };
 
-struct active_tap_dance active_tap_dances[ZMK_BHV_TAP_DANCE_MAX_HELD] = {};
+ZMK_BEHAVIOR_REGISTRY_DEFINE(active_tap_dances, struct active_tap_dance,
+                             CONFIG_ZMK_BHV_TAP_DANCE_MAX_HELD);
 
 static struct active_tap_dance *find_tap_dance(uint32_t position) {
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        if (active_tap_dances[i].position == position && !active_tap_dances[i].timer_cancelled) {
-            return &active_tap_dances[i];
-        }
-    }
-    return NULL;
+    return zmk_behavior_registry_find(&active_tap_dances, position);
 }
 
 static int new_tap_dance(uint32_t position, const struct behavior_tap_dance_config *config,
                          struct active_tap_dance **tap_dance) {
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        struct active_tap_dance *const ref_dance = &active_tap_dances[i];
-        if (ref_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
-            ref_dance->counter = 0;
-            ref_dance->position = position;
-            ref_dance->config = config;
-            ref_dance->release_at = 0;
-            ref_dance->is_pressed = true;
-            ref_dance->timer_started = true;
-            ref_dance->timer_cancelled = false;
-            ref_dance->tap_dance_decided = false;
-            *tap_dance = ref_dance;
-            return 0;
-        }
-    }
-    return -ENOMEM;
+    struct active_tap_dance *const ref_dance =
+        zmk_behavior_registry_alloc(&active_tap_dances, position);
+    if (ref_dance == NULL) {
+        return -ENOMEM;
+    }
+    ref_dance->counter = 0;
+    ref_dance->position = position;
+    ref_dance->config = config;
+    ref_dance->release_at = 0;
+    ref_dance->is_pressed = true;
+    ref_dance->tap_dance_decided = false;
+    *tap_dance = ref_dance;
+    return 0;
 }
 
 static void clear_tap_dance(struct active_tap_dance *tap_dance) {
-    tap_dance->position = ZMK_BHV_TAP_DANCE_POSITION_FREE;
+    zmk_behavior_registry_free(&active_tap_dances, tap_dance);
 }
 
-static int stop_timer(struct active_tap_dance *tap_dance) {
-    int timer_cancel_result = k_delayed_work_cancel(&tap_dance->release_timer);
-    if (timer_cancel_result == -EINPROGRESS) {
-        // too late to cancel, we'll let the timer handler clear up.
-        tap_dance->timer_cancelled = true;
-    }
-    return timer_cancel_result;
+static void stop_timer(struct active_tap_dance *tap_dance) {
+    zmk_behavior_timer_stop(&tap_dance->release_timer);
 }
 
 static void reset_timer(struct active_tap_dance *tap_dance,
                         struct zmk_behavior_binding_event event) {
     tap_dance->release_at = event.timestamp + tap_dance->config->tapping_term_ms;
-    int32_t ms_left = tap_dance->release_at - k_uptime_get();
-    if (ms_left > 0) {
-        k_delayed_work_submit(&tap_dance->release_timer, K_MSEC(ms_left));
+    if (tap_dance->release_at > k_uptime_get()) {
+        zmk_behavior_timer_start(&tap_dance->release_timer, tap_dance->release_at);
         LOG_DBG("Successfully reset timer at position %d", tap_dance->position);
     }
 }
@@ -131,7 +114,8 @@ static int on_tap_dance_binding_pressed(struct zmk_behavior_binding *binding,
     tap_dance = find_tap_dance(event.position);
     if (tap_dance == NULL) {
         if (new_tap_dance(event.position, cfg, &tap_dance) == -ENOMEM) {
-            LOG_ERR("Unable to create new tap dance. Insufficient space in active_tap_dances[].");
+            LOG_ERR("Unable to create new tap dance, did you press more than %d tap dances?",
+                    CONFIG_ZMK_BHV_TAP_DANCE_MAX_HELD);
             return ZMK_BEHAVIOR_OPAQUE;
         }
         LOG_DBG("%d created new tap dance", event.position);
@@ -168,12 +152,10 @@ static int on_tap_dance_binding_released(struct zmk_behavior_binding *binding,
     return ZMK_BEHAVIOR_OPAQUE;
 }
 
-void behavior_tap_dance_timer_handler(struct k_work *item) {
-    struct active_tap_dance *tap_dance = CONTAINER_OF(item, struct active_tap_dance, release_timer);
-    if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
-        return;
-    }
-    if (tap_dance->timer_cancelled) {
+void behavior_tap_dance_timer_handler(struct zmk_behavior_timer *timer) {
+    struct active_tap_dance *tap_dance =
+        CONTAINER_OF(timer, struct active_tap_dance, release_timer);
+    if (!zmk_behavior_registry_is_active(&active_tap_dances, tap_dance)) {
         return;
     }
     LOG_DBG("Tap dance has been decided via timer. Counter reached: %d", tap_dance->counter);
@@ -203,11 +185,8 @@ static int tap_dance_position_state_changed_listener(const zmk_event_t *eh) {
         LOG_DBG("Ignore upstroke at position %d.", ev->position);
         return ZMK_EV_EVENT_BUBBLE;
     }
-    for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-        struct active_tap_dance *tap_dance = &active_tap_dances[i];
-        if (tap_dance->position == ZMK_BHV_TAP_DANCE_POSITION_FREE) {
-            continue;
-        }
+    for (struct active_tap_dance *tap_dance = zmk_behavior_registry_next(&active_tap_dances, NULL);
+         tap_dance != NULL; tap_dance = zmk_behavior_registry_next(&active_tap_dances, tap_dance)) {
         if (tap_dance->position == ev->position) {
             continue;
         }
@@ -227,10 +206,10 @@ static int tap_dance_position_state_changed_listener(const zmk_event_t *eh) {
 static int behavior_tap_dance_init(const struct device *dev) {
     static bool init_first_run = true;
     if (init_first_run) {
-        for (int i = 0; i < ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
-            k_delayed_work_init(&active_tap_dances[i].release_timer,
-                                behavior_tap_dance_timer_handler);
-            clear_tap_dance(&active_tap_dances[i]);
+        zmk_behavior_registry_init(&active_tap_dances);
+        for (int i = 0; i < CONFIG_ZMK_BHV_TAP_DANCE_MAX_HELD; i++) {
+            zmk_behavior_timer_init(&active_tap_dances_slots[i].release_timer,
+                                    behavior_tap_dance_timer_handler);
         }
     }
     init_first_run = false;
@@ -250,9 +229,9 @@ static int behavior_tap_dance_init(const struct device *dev) {
         .tapping_term_ms = DT_INST_PROP(n, tapping_term_ms),                                       \
         .behaviors = behavior_tap_dance_config_##n##_bindings,                                     \
         .behavior_count = DT_INST_PROP_LEN(n, bindings)};                                          \
-    DEVICE_AND_API_INIT(behavior_tap_dance_##n, DT_INST_LABEL(n), behavior_tap_dance_init, NULL,   \
-                        &behavior_tap_dance_config_##n, APPLICATION,                               \
-                        CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_tap_dance_driver_api);
+    DEVICE_DT_INST_DEFINE(n, behavior_tap_dance_init, device_pm_control_nop, NULL,                 \
+                          &behavior_tap_dance_config_##n, APPLICATION,                             \
+                          CONFIG_KERNEL_INIT_PRIORITY_DEFAULT, &behavior_tap_dance_driver_api);
 
 DT_INST_FOREACH_STATUS_OKAY(KP_INST)
 
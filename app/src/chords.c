@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#define DT_DRV_COMPAT zmk_chords
+
+#include <device.h>
+#include <drivers/behavior.h>
+#include <logging/log.h>
+#include <kernel.h>
+#include <string.h>
+
+#include <zmk/behavior.h>
+#include <zmk/behavior_queue.h>
+#include <zmk/chords.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/keymap.h>
+#include <zmk/matrix.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
+
+// generated from the chord dictionary by app/scripts/chord_table.py
+#include <zmk_chord_table.h>
+
+#define CHORD_KEY_COUNT DT_INST_PROP_LEN(0, key_positions)
+
+BUILD_ASSERT(CHORD_KEY_COUNT <= 32, "Chords support at most 32 key positions");
+
+#define BINDING_WITH_COMMA(idx, drv_inst) ZMK_KEYMAP_EXTRACT_BINDING(idx, DT_DRV_INST(drv_inst)),
+
+// a layer of -1 is global layer scope, the chords are active on every layer
+#define CHORD_LAYER_MASK(layer) ((int8_t)(layer) == -1 ? UINT32_MAX : BIT((layer)&0x1f))
+#define CHORD_LAYER_BIT(i, n) CHORD_LAYER_MASK(DT_INST_PROP_BY_IDX(n, layers, i)) |
+
+static const int32_t chord_key_positions[] = DT_INST_PROP(0, key_positions);
+
+static const struct zmk_behavior_binding chord_bindings[] = {
+    UTIL_LISTIFY(DT_INST_PROP_LEN(0, bindings), BINDING_WITH_COMMA, 0)};
+
+/* TODO: Replace UTIL_LISTIFY with DT_FOREACH_PROP_ELEM after Zepyhr 2.6.0 upgrade. */
+static const zmk_keymap_layers_state_t chord_layer_mask =
+    UTIL_LISTIFY(DT_INST_PROP_LEN(0, layers), CHORD_LAYER_BIT, 0) 0;
+
+// maps a key position to its index in chord_key_positions, or -1 if it is not a chord key.
+static int8_t chord_key_indices[ZMK_KEYMAP_LEN];
+
+// chord keys which are currently held down
+static uint32_t held_keys;
+// every chord key pressed since the first key of the chord went down
+static uint32_t pressed_chord;
+// with first-up, the chord is output on the first release. The remaining keys are only released.
+static bool chord_done;
+
+static inline uint32_t zmk_chord_fmix32(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+// must match chord_hash in app/scripts/chord_table.py
+static inline uint32_t zmk_chord_hash(uint32_t chord, uint32_t seed) {
+    return zmk_chord_fmix32(chord ^ (seed * 0x9e3779b1));
+}
+
+static const struct zmk_chord_entry *chord_lookup(uint32_t chord) {
+    uint32_t bucket = zmk_chord_hash(chord, ZMK_CHORD_SEED) % ZMK_CHORD_BUCKET_COUNT;
+    uint32_t seed = ZMK_CHORD_SEED + 1 + zmk_chord_displacements[bucket];
+    const struct zmk_chord_entry *entry =
+        &zmk_chord_table[zmk_chord_hash(chord, seed) % ZMK_CHORD_SLOT_COUNT];
+
+    return entry->chord == chord ? entry : NULL;
+}
+
+// The binding of an output, which is either in the dictionary or one of the chord's bindings.
+static const struct zmk_behavior_binding *output_binding(const struct zmk_chord_entry *entry,
+                                                         int index) {
+    const struct zmk_behavior_binding *binding = &zmk_chord_outputs[entry->output_offset + index];
+
+    return binding->behavior_dev == NULL ? &chord_bindings[binding->param1] : binding;
+}
+
+// A chord being typed out. Each chord runs on its own stream, so it is never cut short by a full
+// behavior queue, which could leave an output pressed.
+struct chord_stream {
+    struct zmk_behavior_queue_stream stream;
+    const struct zmk_chord_entry *entry;
+    // the next step, each output is pressed and then released
+    uint16_t step;
+};
+
+static struct chord_stream chord_streams[CONFIG_ZMK_CHORDS_MAX_RUNNING];
+
+static bool chord_stream_next(struct zmk_behavior_queue_stream *stream,
+                              struct zmk_behavior_queue_step *step) {
+    struct chord_stream *chord_stream = CONTAINER_OF(stream, struct chord_stream, stream);
+
+    if (chord_stream->step >= 2 * chord_stream->entry->output_len) {
+        return false;
+    }
+
+    const bool press = chord_stream->step % 2 == 0;
+    *step = (struct zmk_behavior_queue_step){
+        .binding = output_binding(chord_stream->entry, chord_stream->step / 2),
+        .press = press,
+        .wait = press ? DT_INST_PROP(0, tap_ms) : DT_INST_PROP(0, wait_ms),
+    };
+    chord_stream->step++;
+    return true;
+}
+
+static void output_chord(uint32_t chord, uint32_t position) {
+    const struct zmk_chord_entry *entry = chord_lookup(chord);
+    if (entry == NULL) {
+        LOG_DBG("chord 0x%08x is not in the dictionary", chord);
+        return;
+    }
+
+    LOG_DBG("chord 0x%08x: %d outputs", chord, entry->output_len);
+
+    // checked up front, so a chord is output whole or not at all
+    for (int i = 0; i < entry->output_len; i++) {
+        const struct zmk_behavior_binding *binding = &zmk_chord_outputs[entry->output_offset + i];
+
+        if (binding->behavior_dev == NULL && binding->param1 >= ARRAY_SIZE(chord_bindings)) {
+            LOG_ERR("Chord dictionary uses binding %d, but only %d are defined", binding->param1,
+                    ARRAY_SIZE(chord_bindings));
+            return;
+        }
+    }
+
+    for (int i = 0; i < CONFIG_ZMK_CHORDS_MAX_RUNNING; i++) {
+        struct chord_stream *chord_stream = &chord_streams[i];
+        if (chord_stream->stream.running) {
+            continue;
+        }
+
+        chord_stream->entry = entry;
+        chord_stream->step = 0;
+        zmk_behavior_queue_stream_init(&chord_stream->stream, chord_stream_next);
+        zmk_behavior_queue_stream_start(&chord_stream->stream, position);
+        return;
+    }
+
+    LOG_ERR("Unable to output chord; already %d running. Increase CONFIG_ZMK_CHORDS_MAX_RUNNING",
+            CONFIG_ZMK_CHORDS_MAX_RUNNING);
+}
+
+static int position_state_down(struct zmk_position_state_changed *data, int8_t index) {
+    if ((chord_layer_mask & BIT(zmk_keymap_highest_layer_active())) == 0) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (held_keys == 0) {
+        pressed_chord = 0;
+        chord_done = false;
+    }
+    held_keys |= BIT(index);
+    pressed_chord |= BIT(index);
+
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+static int position_state_up(struct zmk_position_state_changed *data, int8_t index) {
+    if ((held_keys & BIT(index)) == 0) {
+        // pressed while the chords were not active on the highest layer
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    held_keys &= ~BIT(index);
+    if (!chord_done && (held_keys == 0 || DT_INST_PROP(0, first_up))) {
+        chord_done = true;
+        output_chord(pressed_chord, data->position);
+    }
+
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+static int position_state_changed_listener(const zmk_event_t *ev) {
+    struct zmk_position_state_changed *data = as_zmk_position_state_changed(ev);
+    if (data == NULL || data->position >= ZMK_KEYMAP_LEN) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    int8_t index = chord_key_indices[data->position];
+    if (index < 0) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (data->state) {
+        return position_state_down(data, index);
+    } else {
+        return position_state_up(data, index);
+    }
+}
+
+ZMK_LISTENER(chords, position_state_changed_listener);
+ZMK_SUBSCRIPTION(chords, zmk_position_state_changed);
+
+#if IS_ENABLED(CONFIG_ZMK_CHORDS_BENCHMARK)
+
+#include <time.h>
+
+#define CHORDS_BENCHMARK_ROUNDS 100
+
+static void chords_benchmark() {
+    struct timespec start, end;
+    uint32_t lookups = 0, hits = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < CHORDS_BENCHMARK_ROUNDS; round++) {
+        for (int i = 0; i < ZMK_CHORD_SLOT_COUNT; i++) {
+            uint32_t chord = zmk_chord_table[i].chord;
+            if (chord == 0) {
+                continue;
+            }
+            // the second lookup, with a key no chord uses, always misses.
+            hits += (chord_lookup(chord) != NULL) + (chord_lookup(chord | BIT(31)) != NULL);
+            lookups += 2;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const uint64_t elapsed_ns = (end.tv_sec - start.tv_sec) * NSEC_PER_SEC + end.tv_nsec -
+                                start.tv_nsec;
+
+    LOG_INF("%d chords, %d of %d lookups found", ZMK_CHORD_COUNT, hits, lookups);
+    // Printed directly, timings differ between runs so they are kept out of the log.
+    printk("chords: %u lookups in %u us, %u ns per lookup\n", lookups,
+           (uint32_t)(elapsed_ns / NSEC_PER_USEC), (uint32_t)(elapsed_ns / MAX(lookups, 1)));
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_CHORDS_BENCHMARK) */
+
+static int chords_init() {
+    memset(chord_key_indices, -1, sizeof(chord_key_indices));
+    for (int i = 0; i < CHORD_KEY_COUNT; i++) {
+        if (chord_key_positions[i] >= ZMK_KEYMAP_LEN) {
+            LOG_ERR("Chord key position %d does not exist", chord_key_positions[i]);
+            continue;
+        }
+        chord_key_indices[chord_key_positions[i]] = i;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_CHORDS_BENCHMARK)
+    chords_benchmark();
+#endif
+
+    return 0;
+}
+
+SYS_INIT(chords_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
+
+#endif /* DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT) */
@@ -13,12 +13,15 @@
 #include <kernel.h>
 
 #include <zmk/behavior.h>
+#include <zmk/behavior_timer.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/hid.h>
 #include <zmk/matrix.h>
 #include <zmk/keymap.h>
 
+#include <zmk_combo_index.h>
+
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 #if DT_HAS_COMPAT_STATUS_OKAY(DT_DRV_COMPAT)
@@ -34,8 +37,8 @@ struct combo_cfg {
     // the virtual key position is a key position outside the range used by the keyboard.
     // it is necessary so hold-taps can uniquely identify a behavior.
     int32_t virtual_key_position;
-    int32_t layers_len;
-    int8_t layers[];
+    // a bitmask of the layers this combo is active on, all bits are set for a global combo.
+    zmk_keymap_layers_state_t layer_mask;
 };
 
 struct active_combo {
@@ -46,145 +49,159 @@ struct active_combo {
     const zmk_event_t *key_positions_pressed[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO];
 };
 
-struct combo_candidate {
-    struct combo_cfg *combo;
-    // the time after which this behavior should be removed from candidates.
-    // by keeping track of when the candidate should be cleared there is no
-    // possibility of accidental releases.
-    int64_t timeout_at;
-};
+// a layer of -1 is global layer scope, the combo is active on every layer
+#define COMBO_LAYER_MASK(layer) ((int8_t)(layer) == -1 ? UINT32_MAX : BIT((layer)&0x1f))
+#define COMBO_LAYER_BIT(i, n) COMBO_LAYER_MASK(DT_PROP_BY_IDX(n, layers, i)) |
+
+#define COMBO_INST(n)                                                                              \
+    static struct combo_cfg combo_config_##n = {                                                   \
+        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
+        .key_positions = DT_PROP(n, key_positions),                                                \
+        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
+        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
+        .virtual_key_position = ZMK_KEYMAP_LEN + __COUNTER__,                                      \
+        .slow_release = DT_PROP(n, slow_release),                                                  \
+        /* TODO: Replace UTIL_LISTIFY with DT_FOREACH_PROP_ELEM after Zepyhr 2.6.0 upgrade. */     \
+        .layer_mask = UTIL_LISTIFY(DT_PROP_LEN(n, layers), COMBO_LAYER_BIT, n) 0,                  \
+    };
+
+DT_INST_FOREACH_CHILD(0, COMBO_INST)
+
+#define COMBO_REF(n) &combo_config_##n,
+#define COMBO_ONE(n) +1
+
+// all combos, in the order they are defined
+static struct combo_cfg *const combos[] = {DT_INST_FOREACH_CHILD(0, COMBO_REF)};
+
+#define COMBO_COUNT (0 DT_INST_FOREACH_CHILD(0, COMBO_ONE))
+
+#define COMBO_CANDIDATE_WORDS ceiling_fraction(COMBO_COUNT, 32)
+
+BUILD_ASSERT(ZMK_COMBO_INDEX_COMBO_COUNT == COMBO_COUNT,
+             "The combo index does not match the combos in the devicetree");
+BUILD_ASSERT(ZMK_COMBO_INDEX_POSITION_COUNT <= ZMK_KEYMAP_LEN,
+             "A combo uses a key position outside the keymap");
+
+// The combos on each key position, and the key positions of each combo, are looked up in
+// combo_lookup and combo_position_masks, generated at build time by scripts/combo_index.py.
 
 // set of keys pressed
 const zmk_event_t *pressed_keys[CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO] = {NULL};
-// the set of candidate combos based on the currently pressed_keys
-struct combo_candidate candidates[CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY];
+// the set of candidate combos based on the currently pressed_keys, as a bitset of indices into
+// combos. A candidate is removed once its timeout_ms has passed since candidates_pressed_at.
+// By keeping track of when the candidate should be cleared there is no possibility of
+// accidental releases.
+static uint32_t candidates[COMBO_CANDIDATE_WORDS];
+static int64_t candidates_pressed_at;
 // the last candidate that was completely pressed
 struct combo_cfg *fully_pressed_combo = NULL;
-// a lookup dict that maps a key position to all combos on that position
-struct combo_cfg *combo_lookup[ZMK_KEYMAP_LEN][CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY] = {NULL};
 // combos that have been activated and still have (some) keys pressed
 // this array is always contiguous from 0.
 struct active_combo active_combos[CONFIG_ZMK_COMBO_MAX_PRESSED_COMBOS] = {NULL};
 int active_combo_count = 0;
 
-struct k_delayed_work timeout_task;
-int64_t timeout_task_timeout_at;
-
-// Store the combo key pointer in the combos array, one pointer for each key position
-// The combos are sorted shortest-first, then by virtual-key-position.
-static int initialize_combo(struct combo_cfg *new_combo) {
-    for (int i = 0; i < new_combo->key_position_len; i++) {
-        int32_t position = new_combo->key_positions[i];
-        if (position >= ZMK_KEYMAP_LEN) {
-            LOG_ERR("Unable to initialize combo, key position %d does not exist", position);
-            return -EINVAL;
-        }
+struct zmk_behavior_timer timeout_timer;
 
-        struct combo_cfg *insert_combo = new_combo;
-        bool set = false;
-        for (int j = 0; j < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; j++) {
-            struct combo_cfg *combo_at_j = combo_lookup[position][j];
-            if (combo_at_j == NULL) {
-                combo_lookup[position][j] = insert_combo;
-                set = true;
-                break;
-            }
-            if (combo_at_j->key_position_len < insert_combo->key_position_len ||
-                (combo_at_j->key_position_len == insert_combo->key_position_len &&
-                 combo_at_j->virtual_key_position < insert_combo->virtual_key_position)) {
-                continue;
-            }
-            // put insert_combo in this spot, move all other combos up.
-            combo_lookup[position][j] = insert_combo;
-            insert_combo = combo_at_j;
-        }
-        if (!set) {
-            LOG_ERR("Too many combos for key position %d, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY %d.",
-                    position, CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY);
-            return -ENOMEM;
-        }
+static inline int combo_lookup_len(int32_t position) {
+    if (position >= ZMK_COMBO_INDEX_POSITION_COUNT) {
+        return 0;
     }
-    return 0;
+    return combo_lookup_offsets[position + 1] - combo_lookup_offsets[position];
 }
 
-static bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
-    if (combo->layers[0] == -1) {
-        // -1 in the first layer position is global layer scope
-        return true;
-    }
-    for (int j = 0; j < combo->layers_len; j++) {
-        if (combo->layers[j] == layer) {
-            return true;
+static inline uint16_t combo_lookup_at(int32_t position, int index) {
+    return combo_lookup[combo_lookup_offsets[position] + index];
+}
+
+static inline bool combo_has_position(uint16_t id, int32_t position) {
+    return position < ZMK_COMBO_INDEX_POSITION_COUNT &&
+           combo_position_masks[id][position / 32] & BIT(position % 32);
+}
+
+static inline void set_candidate(uint16_t id) { candidates[id / 32] |= BIT(id % 32); }
+
+static inline void clear_candidate(uint16_t id) { candidates[id / 32] &= ~BIT(id % 32); }
+
+// Returns the first candidate at or after index from, or -1 if there is none.
+static int next_candidate(int from) {
+    for (int word = from / 32; word < COMBO_CANDIDATE_WORDS; word++) {
+        uint32_t bits = candidates[word];
+        if (word == from / 32) {
+            bits &= ~0U << (from % 32);
+        }
+        if (bits != 0) {
+            return word * 32 + __builtin_ctz(bits);
         }
     }
-    return false;
+    return -1;
+}
+
+static inline bool combo_active_on_layer(struct combo_cfg *combo, uint8_t layer) {
+    return combo->layer_mask & BIT(layer);
 }
 
 static int setup_candidates_for_first_keypress(int32_t position, int64_t timestamp) {
     int number_of_combo_candidates = 0;
     uint8_t highest_active_layer = zmk_keymap_highest_layer_active();
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_cfg *combo = combo_lookup[position][i];
-        if (combo == NULL) {
-            return number_of_combo_candidates;
-        }
-        if (combo_active_on_layer(combo, highest_active_layer)) {
-            candidates[number_of_combo_candidates].combo = combo;
-            candidates[number_of_combo_candidates].timeout_at = timestamp + combo->timeout_ms;
+    candidates_pressed_at = timestamp;
+    for (int i = 0; i < combo_lookup_len(position); i++) {
+        uint16_t id = combo_lookup_at(position, i);
+        if (combo_active_on_layer(combos[id], highest_active_layer)) {
+            set_candidate(id);
             number_of_combo_candidates++;
         }
-        // LOG_DBG("combo timeout %d %d %d", position, i, candidates[i].timeout_at);
     }
     return number_of_combo_candidates;
 }
 
 static int filter_candidates(int32_t position) {
-    // this code iterates over candidates and the lookup together to filter in O(n)
-    // assuming they are both sorted on key_position_len, virtal_key_position
-    int matches = 0, lookup_idx = 0, candidate_idx = 0;
-    while (lookup_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY &&
-           candidate_idx < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY) {
-        struct combo_cfg *candidate = candidates[candidate_idx].combo;
-        struct combo_cfg *lookup = combo_lookup[position][lookup_idx];
-        if (candidate == NULL || lookup == NULL) {
-            break;
-        }
-        if (candidate->virtual_key_position == lookup->virtual_key_position) {
-            candidates[matches] = candidates[candidate_idx];
+    // every candidate already contains the keys pressed so far, so a candidate remains one if its
+    // position mask also has the new key position.
+    int matches = 0;
+    for (int id = next_candidate(0); id >= 0; id = next_candidate(id + 1)) {
+        if (combo_has_position(id, position)) {
             matches++;
-            candidate_idx++;
-            lookup_idx++;
-        } else if (candidate->key_position_len > lookup->key_position_len) {
-            lookup_idx++;
-        } else if (candidate->key_position_len < lookup->key_position_len) {
-            candidate_idx++;
-        } else if (candidate->virtual_key_position > lookup->virtual_key_position) {
-            lookup_idx++;
-        } else if (candidate->virtual_key_position < lookup->virtual_key_position) {
-            candidate_idx++;
+        } else {
+            clear_candidate(id);
         }
     }
-    // clear unmatched candidates
-    for (int i = matches; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        candidates[i].combo = NULL;
-    }
     // LOG_DBG("combo matches after filter %d", matches);
     return matches;
 }
 
 static int64_t first_candidate_timeout() {
     int64_t first_timeout = LONG_MAX;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            break;
-        }
-        if (candidates[i].timeout_at < first_timeout) {
-            first_timeout = candidates[i].timeout_at;
+    for (int id = next_candidate(0); id >= 0; id = next_candidate(id + 1)) {
+        int64_t timeout_at = candidates_pressed_at + combos[id]->timeout_ms;
+        if (timeout_at < first_timeout) {
+            first_timeout = timeout_at;
         }
     }
     return first_timeout;
 }
 
+// Returns the shortest candidate, or the first one defined if several are equally short.
+static struct combo_cfg *first_candidate() {
+    struct combo_cfg *first = NULL;
+    for (int id = next_candidate(0); id >= 0; id = next_candidate(id + 1)) {
+        if (first == NULL || combos[id]->key_position_len < first->key_position_len) {
+            first = combos[id];
+        }
+    }
+    return first;
+}
+
+// Returns true if any candidate has more keys than len, i.e. more keys may still be pressed
+// before a combo is decided.
+static bool candidates_longer_than(int32_t len) {
+    for (int id = next_candidate(0); id >= 0; id = next_candidate(id + 1)) {
+        if (combos[id]->key_position_len > len) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static inline bool candidate_is_completely_pressed(struct combo_cfg *candidate) {
     // this code assumes set(pressed_keys) <= set(candidate->key_positions)
     // this invariant is enforced by filter_candidates
@@ -203,32 +220,17 @@ static int cleanup();
 
 static int filter_timed_out_candidates(int64_t timestamp) {
     int num_candidates = 0;
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        struct combo_candidate *candidate = &candidates[i];
-        if (candidate->combo == NULL) {
-            break;
-        }
-        if (candidate->timeout_at > timestamp) {
-            // reorder candidates so they're contiguous
-            candidates[num_candidates].combo = candidate->combo;
-            candidates[num_candidates].timeout_at = candidates->timeout_at;
+    for (int id = next_candidate(0); id >= 0; id = next_candidate(id + 1)) {
+        if (candidates_pressed_at + combos[id]->timeout_ms > timestamp) {
             num_candidates++;
         } else {
-            candidate->combo = NULL;
+            clear_candidate(id);
         }
     }
     return num_candidates;
 }
 
-static int clear_candidates() {
-    for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY; i++) {
-        if (candidates[i].combo == NULL) {
-            return i;
-        }
-        candidates[i].combo = NULL;
-    }
-    return CONFIG_ZMK_COMBO_MAX_COMBOS_PER_KEY;
-}
+static void clear_candidates() { memset(candidates, 0, sizeof(candidates)); }
 
 static int capture_pressed_key(const zmk_event_t *ev) {
     for (int i = 0; i < CONFIG_ZMK_COMBO_MAX_KEYS_PER_COMBO; i++) {
@@ -370,7 +372,7 @@ static bool release_combo_key(int32_t position, int64_t timestamp) {
 }
 
 static int cleanup() {
-    k_delayed_work_cancel(&timeout_task);
+    zmk_behavior_timer_stop(&timeout_timer);
     clear_candidates();
     if (fully_pressed_combo != NULL) {
         activate_combo(fully_pressed_combo);
@@ -381,22 +383,16 @@ static int cleanup() {
 
 static void update_timeout_task() {
     int64_t first_timeout = first_candidate_timeout();
-    if (timeout_task_timeout_at == first_timeout) {
-        return;
-    }
-    if (first_timeout == LLONG_MAX) {
-        timeout_task_timeout_at = 0;
-        k_delayed_work_cancel(&timeout_task);
+    if (first_timeout == LONG_MAX) {
+        zmk_behavior_timer_stop(&timeout_timer);
         return;
     }
-    if (k_delayed_work_submit(&timeout_task, K_MSEC(first_timeout - k_uptime_get())) == 0) {
-        timeout_task_timeout_at = first_timeout;
-    }
+    zmk_behavior_timer_start(&timeout_timer, first_timeout);
 }
 
 static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
     int num_candidates;
-    if (candidates[0].combo == NULL) {
+    if (next_candidate(0) < 0) {
         num_candidates = setup_candidates_for_first_keypress(data->position, data->timestamp);
         if (num_candidates == 0) {
             return 0;
@@ -407,25 +403,22 @@ static int position_state_down(const zmk_event_t *ev, struct zmk_position_state_
     }
     update_timeout_task();
 
-    struct combo_cfg *candidate_combo = candidates[0].combo;
+    struct combo_cfg *candidate_combo = first_candidate();
     LOG_DBG("combo: capturing position event %d", data->position);
     int ret = capture_pressed_key(ev);
-    switch (num_candidates) {
-    case 0:
+    if (num_candidates == 0) {
         cleanup();
         return ret;
-    case 1:
-        if (candidate_is_completely_pressed(candidate_combo)) {
-            fully_pressed_combo = candidate_combo;
+    }
+    if (candidate_is_completely_pressed(candidate_combo)) {
+        fully_pressed_combo = candidate_combo;
+        // all remaining candidates are made up of exactly the pressed keys, so pressing more keys
+        // can only break the combo. There is no need to wait for the timeout.
+        if (!candidates_longer_than(candidate_combo->key_position_len)) {
             cleanup();
         }
-        return ret;
-    default:
-        if (candidate_is_completely_pressed(candidate_combo)) {
-            fully_pressed_combo = candidate_combo;
-        }
-        return ret;
     }
+    return ret;
 }
 
 static int position_state_up(const zmk_event_t *ev, struct zmk_position_state_changed *data) {
@@ -442,12 +435,10 @@ static int position_state_up(const zmk_event_t *ev, struct zmk_position_state_ch
     return 0;
 }
 
-static void combo_timeout_handler(struct k_work *item) {
-    if (timeout_task_timeout_at == 0 || k_uptime_get() < timeout_task_timeout_at) {
-        // timer was cancelled or rescheduled.
-        return;
-    }
-    if (filter_timed_out_candidates(timeout_task_timeout_at) < 2) {
+static void combo_timeout_handler(struct zmk_behavior_timer *timer) {
+    if (filter_timed_out_candidates(timer->deadline) < 2 ||
+        (fully_pressed_combo != NULL &&
+         !candidates_longer_than(fully_pressed_combo->key_position_len))) {
         cleanup();
     }
     update_timeout_task();
@@ -469,25 +460,8 @@ static int position_state_changed_listener(const zmk_event_t *ev) {
 ZMK_LISTENER(combo, position_state_changed_listener);
 ZMK_SUBSCRIPTION(combo, zmk_position_state_changed);
 
-#define COMBO_INST(n)                                                                              \
-    static struct combo_cfg combo_config_##n = {                                                   \
-        .timeout_ms = DT_PROP(n, timeout_ms),                                                      \
-        .key_positions = DT_PROP(n, key_positions),                                                \
-        .key_position_len = DT_PROP_LEN(n, key_positions),                                         \
-        .behavior = ZMK_KEYMAP_EXTRACT_BINDING(0, n),                                              \
-        .virtual_key_position = ZMK_KEYMAP_LEN + __COUNTER__,                                      \
-        .slow_release = DT_PROP(n, slow_release),                                                  \
-        .layers = DT_PROP(n, layers),                                                              \
-        .layers_len = DT_PROP_LEN(n, layers),                                                      \
-    };
-
-#define INITIALIZE_COMBO(n) initialize_combo(&combo_config_##n);
-
-DT_INST_FOREACH_CHILD(0, COMBO_INST)
-
 static int combo_init() {
-    k_delayed_work_init(&timeout_task, combo_timeout_handler);
-    DT_INST_FOREACH_CHILD(0, INITIALIZE_COMBO);
+    zmk_behavior_timer_init(&timeout_timer, combo_timeout_handler);
     return 0;
 }
 
@@ -6,6 +6,7 @@
 
 #include <init.h>
 #include <settings/settings.h>
+#include <sys/atomic.h>
 
 #include <zmk/ble.h>
 #include <zmk/endpoints.h>
@@ -17,6 +18,7 @@
 #include <zmk/events/ble_active_profile_changed.h>
 #include <zmk/events/usb_conn_state_changed.h>
 #include <zmk/events/endpoint_selection_changed.h>
+#include <zmk/events/endpoint_reports_sent.h>
 
 #include <logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -71,15 +73,91 @@ int zmk_endpoints_toggle() {
     return zmk_endpoints_select(new_endpoint);
 }
 
+// reports handed to a transport which it has not sent yet.
+static atomic_t reports_in_flight;
+
+static void raise_reports_sent(struct k_work *work) {
+    ZMK_EVENT_RAISE(new_zmk_endpoint_reports_sent(
+        (struct zmk_endpoint_reports_sent){.timestamp = k_uptime_get()}));
+}
+
+K_WORK_DEFINE(reports_sent_work, raise_reports_sent);
+
+void zmk_endpoints_report_sent() {
+    atomic_val_t count;
+
+    do {
+        count = atomic_get(&reports_in_flight);
+        if (count == 0) {
+            // e.g. the USB endpoint becoming ready after enumeration, not after one of our reports.
+            return;
+        }
+    } while (!atomic_cas(&reports_in_flight, count, count - 1));
+
+    if (count == 1) {
+        k_work_submit(&reports_sent_work);
+    }
+}
+
+int zmk_endpoints_reports_in_flight() { return atomic_get(&reports_in_flight); }
+
+// Reports queued on a connection which went away are never reported sent, so the count starts over
+// whenever the endpoint or its connection changes.
+static void reset_reports_in_flight() {
+    if (atomic_set(&reports_in_flight, 0) > 0) {
+        k_work_submit(&reports_sent_work);
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MOCK)
+
+static void mock_host_poll(struct k_work *work);
+static K_DELAYED_WORK_DEFINE(mock_host_work, mock_host_poll);
+
+// reports the pretend host has taken, it stops after CONFIG_ZMK_ENDPOINTS_MOCK_STALL_AFTER.
+static uint32_t mock_host_taken;
+
+// takes one report per poll, like a USB host polling the HID endpoint.
+static void mock_host_poll(struct k_work *work) {
+    if (CONFIG_ZMK_ENDPOINTS_MOCK_STALL_AFTER > 0 &&
+        mock_host_taken >= CONFIG_ZMK_ENDPOINTS_MOCK_STALL_AFTER) {
+        // like a lost connection, the reports stay in flight.
+        return;
+    }
+
+    mock_host_taken++;
+    zmk_endpoints_report_sent();
+
+    if (atomic_get(&reports_in_flight) > 0) {
+        k_delayed_work_submit(&mock_host_work, K_MSEC(CONFIG_ZMK_ENDPOINTS_MOCK_POLL_MS));
+    }
+}
+
+static int send_mock_report() {
+    atomic_inc(&reports_in_flight);
+
+    if (!k_delayed_work_pending(&mock_host_work)) {
+        k_delayed_work_submit(&mock_host_work, K_MSEC(CONFIG_ZMK_ENDPOINTS_MOCK_POLL_MS));
+    }
+
+    return 0;
+}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MOCK) */
+
 static int send_keyboard_report() {
     struct zmk_hid_keyboard_report *keyboard_report = zmk_hid_get_keyboard_report();
 
     switch (current_endpoint) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_ENDPOINT_USB: {
+        // counted first, the transport may report it sent before the call returns. A report which
+        // fails to send is no longer in flight either.
+        atomic_inc(&reports_in_flight);
         int err = zmk_usb_hid_send_report((uint8_t *)keyboard_report, sizeof(*keyboard_report));
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+            zmk_endpoints_report_sent();
         }
         return err;
     }
@@ -87,17 +165,23 @@ static int send_keyboard_report() {
 
 #if IS_ENABLED(CONFIG_ZMK_BLE)
     case ZMK_ENDPOINT_BLE: {
+        atomic_inc(&reports_in_flight);
         int err = zmk_hog_send_keyboard_report(&keyboard_report->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+            zmk_endpoints_report_sent();
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
 
     default:
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MOCK)
+        return send_mock_report();
+#else
         LOG_ERR("Unsupported endpoint %d", current_endpoint);
         return -ENOTSUP;
+#endif
     }
 }
 
@@ -107,9 +191,11 @@ static int send_consumer_report() {
     switch (current_endpoint) {
 #if IS_ENABLED(CONFIG_ZMK_USB)
     case ZMK_ENDPOINT_USB: {
+        atomic_inc(&reports_in_flight);
         int err = zmk_usb_hid_send_report((uint8_t *)consumer_report, sizeof(*consumer_report));
         if (err) {
             LOG_ERR("FAILED TO SEND OVER USB: %d", err);
+            zmk_endpoints_report_sent();
         }
         return err;
     }
@@ -117,17 +203,23 @@ static int send_consumer_report() {
 
 #if IS_ENABLED(CONFIG_ZMK_BLE)
     case ZMK_ENDPOINT_BLE: {
+        atomic_inc(&reports_in_flight);
         int err = zmk_hog_send_consumer_report(&consumer_report->body);
         if (err) {
             LOG_ERR("FAILED TO SEND OVER HOG: %d", err);
+            zmk_endpoints_report_sent();
         }
         return err;
     }
 #endif /* IS_ENABLED(CONFIG_ZMK_BLE) */
 
     default:
+#if IS_ENABLED(CONFIG_ZMK_ENDPOINTS_MOCK)
+        return send_mock_report();
+#else
         LOG_ERR("Unsupported endpoint %d", current_endpoint);
         return -ENOTSUP;
+#endif
     }
 }
 
@@ -251,6 +343,7 @@ static void update_current_endpoint() {
 
 static int endpoint_listener(const zmk_event_t *eh) {
     update_current_endpoint();
+    reset_reports_in_flight();
     return 0;
 }
 
@@ -0,0 +1,10 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <kernel.h>
+#include <zmk/events/endpoint_reports_sent.h>
+
+ZMK_EVENT_IMPL(zmk_endpoint_reports_sent);
@@ -17,6 +17,7 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/ble.h>
 #include <zmk/hog.h>
 #include <zmk/hid.h>
+#include <zmk/endpoints.h>
 
 enum {
     HIDS_REMOTE_WAKE = BIT(0),
@@ -161,6 +162,8 @@ K_THREAD_STACK_DEFINE(hog_q_stack, CONFIG_ZMK_BLE_THREAD_STACK_SIZE);
 
 struct k_work_q hog_work_q;
 
+static void notify_complete(struct bt_conn *conn, void *user_data) { zmk_endpoints_report_sent(); }
+
 K_MSGQ_DEFINE(zmk_hog_keyboard_msgq, sizeof(struct zmk_hid_keyboard_report_body),
               CONFIG_ZMK_BLE_KEYBOARD_REPORT_QUEUE_SIZE, 4);
 
@@ -170,18 +173,22 @@ void send_keyboard_report_callback(struct k_work *work) {
     while (k_msgq_get(&zmk_hog_keyboard_msgq, &report, K_NO_WAIT) == 0) {
         struct bt_conn *conn = destination_connection();
         if (conn == NULL) {
-            return;
+            // dropped, but no longer in flight
+            zmk_endpoints_report_sent();
+            continue;
         }
 
         struct bt_gatt_notify_params notify_params = {
             .attr = &hog_svc.attrs[5],
             .data = &report,
             .len = sizeof(report),
+            .func = notify_complete,
         };
 
         int err = bt_gatt_notify_cb(conn, &notify_params);
         if (err) {
             LOG_ERR("Error notifying %d", err);
+            zmk_endpoints_report_sent();
         }
 
         bt_conn_unref(conn);
@@ -198,6 +205,7 @@ int zmk_hog_send_keyboard_report(struct zmk_hid_keyboard_report_body *report) {
             LOG_WRN("Keyboard message queue full, popping first message and queueing again");
             struct zmk_hid_keyboard_report_body discarded_report;
             k_msgq_get(&zmk_hog_keyboard_msgq, &discarded_report, K_NO_WAIT);
+            zmk_endpoints_report_sent();
             return zmk_hog_send_keyboard_report(report);
         }
         default:
@@ -220,18 +228,22 @@ void send_consumer_report_callback(struct k_work *work) {
     while (k_msgq_get(&zmk_hog_consumer_msgq, &report, K_NO_WAIT) == 0) {
         struct bt_conn *conn = destination_connection();
         if (conn == NULL) {
-            return;
+            // dropped, but no longer in flight
+            zmk_endpoints_report_sent();
+            continue;
         }
 
         struct bt_gatt_notify_params notify_params = {
             .attr = &hog_svc.attrs[10],
             .data = &report,
             .len = sizeof(report),
+            .func = notify_complete,
         };
 
         int err = bt_gatt_notify_cb(conn, &notify_params);
         if (err) {
             LOG_DBG("Error notifying %d", err);
+            zmk_endpoints_report_sent();
         }
 
         bt_conn_unref(conn);
@@ -248,6 +260,7 @@ int zmk_hog_send_consumer_report(struct zmk_hid_consumer_report_body *report) {
             LOG_WRN("Consumer message queue full, popping first message and queueing again");
             struct zmk_hid_consumer_report_body discarded_report;
             k_msgq_get(&zmk_hog_consumer_msgq, &discarded_report, K_NO_WAIT);
+            zmk_endpoints_report_sent();
             return zmk_hog_send_consumer_report(report);
         }
         default:
@@ -12,6 +12,7 @@
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
+#include <zmk/kscan.h>
 #include <zmk/matrix_transform.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
@@ -23,25 +24,48 @@ struct zmk_kscan_event {
     uint32_t row;
     uint32_t column;
     uint32_t state;
+    int64_t timestamp;
 };
 
 struct zmk_kscan_msg_processor {
     struct k_work work;
 } msg_processor;
 
-K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 4);
+K_MSGQ_DEFINE(zmk_kscan_msgq, sizeof(struct zmk_kscan_event), CONFIG_ZMK_KSCAN_EVENT_QUEUE_SIZE, 8);
 
-static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
-                               bool pressed) {
+static struct zmk_kscan_stats stats;
+
+static void zmk_kscan_queue_event(uint32_t row, uint32_t column, bool pressed,
+                                  int64_t timestamp) {
     struct zmk_kscan_event ev = {
         .row = row,
         .column = column,
-        .state = (pressed ? ZMK_KSCAN_EVENT_STATE_PRESSED : ZMK_KSCAN_EVENT_STATE_RELEASED)};
+        .state = (pressed ? ZMK_KSCAN_EVENT_STATE_PRESSED : ZMK_KSCAN_EVENT_STATE_RELEASED),
+        .timestamp = timestamp};
+
+    if (k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT) != 0) {
+        LOG_WRN("KSCAN event queue full, dropping event");
+        stats.dropped++;
+    }
+    stats.queue_high_water = MAX(stats.queue_high_water, k_msgq_num_used_get(&zmk_kscan_msgq));
 
-    k_msgq_put(&zmk_kscan_msgq, &ev, K_NO_WAIT);
     k_work_submit(&msg_processor.work);
 }
 
+static void zmk_kscan_callback(const struct device *dev, uint32_t row, uint32_t column,
+                               bool pressed) {
+    zmk_kscan_queue_event(row, column, pressed, k_uptime_get());
+}
+
+void zmk_kscan_forward(kscan_callback_t callback, const struct device *dev, uint32_t row,
+                       uint32_t column, bool pressed, int64_t timestamp) {
+    if (callback == zmk_kscan_callback) {
+        zmk_kscan_queue_event(row, column, pressed, timestamp);
+    } else {
+        callback(dev, row, column, pressed);
+    }
+}
+
 void zmk_kscan_process_msgq(struct k_work *item) {
     struct zmk_kscan_event ev;
 
@@ -54,10 +78,12 @@ void zmk_kscan_process_msgq(struct k_work *item) {
             (struct zmk_position_state_changed){.source = ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL,
                                                 .state = pressed,
                                                 .position = position,
-                                                .timestamp = k_uptime_get()}));
+                                                .timestamp = ev.timestamp}));
     }
 }
 
+void zmk_kscan_get_stats(struct zmk_kscan_stats *out) { *out = stats; }
+
 int zmk_kscan_init(char *name) {
     const struct device *dev = device_get_binding(name);
     if (dev == NULL) {
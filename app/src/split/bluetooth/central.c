@@ -13,6 +13,12 @@
 #include <bluetooth/hci.h>
 #include <sys/byteorder.h>
 
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES)
+#include <stdio.h>
+#include <stdlib.h>
+#include <settings/settings.h>
+#endif
+
 #include <logging/log.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
@@ -20,9 +26,12 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <zmk/stdlib.h>
 #include <zmk/ble.h>
 #include <zmk/behavior.h>
+#include <zmk/matrix.h>
 #include <zmk/sensors.h>
 #include <zmk/split/bluetooth/uuid.h>
+#include <zmk/split/bluetooth/central.h>
 #include <zmk/split/bluetooth/service.h>
+#include <zmk/split/transport.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/position_state_changed.h>
 #include <zmk/events/sensor_event.h>
@@ -30,7 +39,39 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 static int start_scan(void);
 
-#define POSITION_STATE_DATA_LEN 16
+struct peripheral_slot;
+static void split_central_save_handles(struct peripheral_slot *slot);
+
+// peripheral positions are keymap positions, so the keymap bounds every peripheral's state
+#define POSITION_STATE_WORDS ceiling_fraction(ZMK_KEYMAP_LEN, 32)
+#define POSITION_STATE_READ_LEN                                                                    \
+    (sizeof(struct zmk_split_position_state) + ceiling_fraction(ZMK_KEYMAP_LEN, 8))
+
+/*
+ * Maps a peripheral's uptime to the central's. Each round of clock reads keeps the one with the
+ * fastest round trip, and takes the peripheral clock as read halfway through it. The drift is
+ * measured against the first round, so it gets more precise the longer the connection lasts.
+ */
+struct split_clock {
+    struct k_delayed_work work;
+    bool valid;
+    // peripheral minus central uptime in microseconds, at reference_us central uptime
+    int64_t offset_us;
+    int64_t reference_us;
+    int64_t first_offset_us;
+    int64_t first_reference_us;
+    int32_t drift_ppm;
+
+    // the round in progress
+    uint8_t samples;
+    int64_t request_us;
+    int64_t best_rtt_us;
+    int64_t best_offset_us;
+    int64_t best_midpoint_us;
+};
+
+#define SPLIT_CLOCK_MAX_DRIFT_PPM 1000
+#define SPLIT_CLOCK_SYNC_INTERVAL K_MSEC(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CLOCK_SYNC_INTERVAL_MS)
 
 enum peripheral_slot_state {
     PERIPHERAL_SLOT_STATE_OPEN,
@@ -44,17 +85,58 @@ struct peripheral_slot {
     struct bt_gatt_discover_params discover_params;
     struct bt_gatt_subscribe_params subscribe_params;
     struct bt_gatt_discover_params sub_discover_params;
+    struct bt_gatt_read_params read_params;
+    struct bt_gatt_read_params clock_read_params;
     uint16_t run_behavior_handle;
-    uint8_t position_state[POSITION_STATE_DATA_LEN];
-    uint8_t changed_positions[POSITION_STATE_DATA_LEN];
+    uint16_t clock_handle;
+    struct split_clock clock;
+    struct bt_gatt_read_params behaviors_read_params;
+    uint16_t behaviors_handle;
+    // the IDs of the peripheral's behaviors, sorted. A behavior is run by its index.
+    uint32_t behavior_ids[CONFIG_ZMK_SPLIT_BLE_CENTRAL_PERIPHERAL_BEHAVIORS_MAX];
+    uint16_t behaviors_len;
+    bool behaviors_read;
+    // behaviors run on the peripheral are held back until its behaviors are read, unless that fails
+    bool behaviors_read_failed;
+    struct bt_gatt_read_params position_count_read_params;
+    // the peripheral's number of positions, 0 until it has been read
+    uint16_t position_count;
+    uint32_t position_state[POSITION_STATE_WORDS];
+    // the position state being read, a large state arrives in several parts
+    uint8_t state_read[POSITION_STATE_READ_LEN];
+    uint16_t state_read_len;
+    // sequence number of the next position event expected from the peripheral
+    uint8_t next_sequence;
+    // set once position_state has been read, events are only applied on top of a known state
+    bool synced;
+    bool resyncing;
+    // a resynchronization requested where it can not be started, e.g. from a read callback
+    struct k_work resync_work;
+    struct bt_gatt_read_params db_hash_read_params;
+    uint8_t db_hash[16];
+    bool has_db_hash;
+    bool db_hash_read;
+    // connected with handles from the cache, which are checked against the peripheral, not saved
+    bool cached_handles;
+    bool handles_saved;
+    // when the peripheral's advertisement was seen and when it connected, to time the first event
+    int64_t found_at;
+    int64_t connected_at;
+    bool first_event_seen;
 };
 
 static struct peripheral_slot peripherals[ZMK_BLE_SPLIT_PERIPHERAL_COUNT];
 
 static const struct bt_uuid_128 split_service_uuid = BT_UUID_INIT_128(ZMK_SPLIT_BT_SERVICE_UUID);
 
+// A resynchronization queues an event for each changed position, so it must fit along with a
+// notification.
+#define POSITION_QUEUE_SIZE                                                                        \
+    MAX(CONFIG_ZMK_SPLIT_BLE_CENTRAL_POSITION_QUEUE_SIZE,                                          \
+        ZMK_KEYMAP_LEN + CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_POSITION_EVENTS_PER_NOTIFY)
+
 K_MSGQ_DEFINE(peripheral_event_msgq, sizeof(struct zmk_position_state_changed),
-              CONFIG_ZMK_SPLIT_BLE_CENTRAL_POSITION_QUEUE_SIZE, 4);
+              POSITION_QUEUE_SIZE, 4);
 
 int peripheral_slot_index_for_conn(struct bt_conn *conn) {
     for (int i = 0; i < ZMK_BLE_SPLIT_PERIPHERAL_COUNT; i++) {
@@ -94,14 +176,34 @@ int release_peripheral_slot(int index) {
     }
     slot->state = PERIPHERAL_SLOT_STATE_OPEN;
 
-    for (int i = 0; i < POSITION_STATE_DATA_LEN; i++) {
-        slot->position_state[i] = 0U;
-        slot->changed_positions[i] = 0U;
-    }
+    memset(slot->position_state, 0, sizeof(slot->position_state));
+    slot->position_count = 0;
+    slot->state_read_len = 0;
+
+    slot->next_sequence = 0;
+    slot->synced = false;
+    slot->resyncing = false;
+
+    k_delayed_work_cancel(&slot->clock.work);
+    slot->clock.valid = false;
+    slot->clock.drift_ppm = 0;
+    slot->clock.samples = 0;
 
     // Clean up previously discovered handles;
     slot->subscribe_params.value_handle = 0;
+    slot->subscribe_params.ccc_handle = 0;
     slot->run_behavior_handle = 0;
+    slot->clock_handle = 0;
+    slot->behaviors_handle = 0;
+    slot->behaviors_len = 0;
+    slot->behaviors_read = false;
+    slot->behaviors_read_failed = false;
+
+    slot->has_db_hash = false;
+    slot->db_hash_read = false;
+    slot->cached_handles = false;
+    slot->handles_saved = false;
+    slot->first_event_seen = false;
 
     return 0;
 }
@@ -192,6 +294,209 @@ static uint8_t split_central_sensor_notify_func(struct bt_conn *conn,
 }
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+static inline int64_t central_uptime_us() { return k_ticks_to_us_floor64(k_uptime_ticks()); }
+
+static int64_t split_clock_peripheral_us(const struct split_clock *clock, int64_t central_us) {
+    return central_us + clock->offset_us +
+           (central_us - clock->reference_us) * clock->drift_ppm / USEC_PER_SEC;
+}
+
+static void split_clock_finish_round(struct split_clock *clock) {
+    if (!clock->valid) {
+        clock->first_offset_us = clock->best_offset_us;
+        clock->first_reference_us = clock->best_midpoint_us;
+    } else if (clock->best_midpoint_us > clock->first_reference_us) {
+        const int64_t drift_ppm = (clock->best_offset_us - clock->first_offset_us) * USEC_PER_SEC /
+                                  (clock->best_midpoint_us - clock->first_reference_us);
+        clock->drift_ppm = CLAMP(drift_ppm, -SPLIT_CLOCK_MAX_DRIFT_PPM, SPLIT_CLOCK_MAX_DRIFT_PPM);
+    }
+
+    clock->offset_us = clock->best_offset_us;
+    clock->reference_us = clock->best_midpoint_us;
+    clock->valid = true;
+    clock->samples = 0;
+}
+
+static uint8_t split_central_read_clock(struct bt_conn *conn, uint8_t err,
+                                        struct bt_gatt_read_params *params, const void *data,
+                                        uint16_t length) {
+    const int64_t response_us = central_uptime_us();
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_STOP;
+    }
+
+    struct split_clock *clock = &slot->clock;
+    const struct zmk_split_clock *peripheral_clock = data;
+    if (err || peripheral_clock == NULL || length < sizeof(*peripheral_clock)) {
+        LOG_WRN("Failed to read the peripheral clock (err %d)", err);
+        k_delayed_work_submit(&clock->work, SPLIT_CLOCK_SYNC_INTERVAL);
+        return BT_GATT_ITER_STOP;
+    }
+
+    const int64_t rtt_us = response_us - clock->request_us;
+    if (clock->samples == 0 || rtt_us < clock->best_rtt_us) {
+        clock->best_rtt_us = rtt_us;
+        clock->best_midpoint_us = clock->request_us + rtt_us / 2;
+        clock->best_offset_us = peripheral_clock->uptime_us - clock->best_midpoint_us;
+    }
+
+    if (++clock->samples < CONFIG_ZMK_SPLIT_BLE_CENTRAL_CLOCK_SYNC_SAMPLES) {
+        k_delayed_work_submit(&clock->work, K_NO_WAIT);
+        return BT_GATT_ITER_STOP;
+    }
+
+    split_clock_finish_round(clock);
+    LOG_DBG("Peripheral %d clock offset %lld us, drift %d ppm, round trip %lld us",
+            slot - peripherals, clock->offset_us, clock->drift_ppm, clock->best_rtt_us);
+
+    k_delayed_work_submit(&clock->work, SPLIT_CLOCK_SYNC_INTERVAL);
+    return BT_GATT_ITER_STOP;
+}
+
+static void split_central_clock_work_handler(struct k_work *work) {
+    struct k_delayed_work *dwork = CONTAINER_OF(work, struct k_delayed_work, work);
+    struct peripheral_slot *slot = CONTAINER_OF(dwork, struct peripheral_slot, clock.work);
+
+    if (slot->state != PERIPHERAL_SLOT_STATE_CONNECTED || !slot->clock_handle) {
+        return;
+    }
+
+    slot->clock_read_params.func = split_central_read_clock;
+    slot->clock_read_params.handle_count = 1;
+    slot->clock_read_params.single.handle = slot->clock_handle;
+    slot->clock_read_params.single.offset = 0;
+
+    slot->clock.request_us = central_uptime_us();
+    int err = bt_gatt_read(slot->conn, &slot->clock_read_params);
+    if (err) {
+        LOG_WRN("Failed to read the peripheral clock (err %d)", err);
+        k_delayed_work_submit(&slot->clock.work, SPLIT_CLOCK_SYNC_INTERVAL);
+    }
+}
+
+// Returns false if the queue is full. The slot is then out of sync, and resynchronizes once the
+// queue has drained.
+static bool split_central_queue_position_event(struct peripheral_slot *slot, uint16_t position,
+                                              bool pressed, int64_t timestamp) {
+    struct zmk_position_state_changed ev = {.source = slot - peripherals,
+                                            .position = position,
+                                            .state = pressed,
+                                            .timestamp = timestamp};
+
+    if (k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT) != 0) {
+        LOG_WRN("Peripheral position event queue full at position %d, resynchronizing",
+                position);
+        slot->synced = false;
+        // queued behind the events already in the queue
+        k_work_submit(&slot->resync_work);
+        return false;
+    }
+
+    WRITE_BIT(slot->position_state[position / 32], position % 32, pressed);
+    k_work_submit(&peripheral_event_work);
+    return true;
+}
+
+// Emits an event for every position which differs from the peripheral's state. Returns false if
+// they did not all fit in the queue.
+static bool split_central_apply_position_state(struct peripheral_slot *slot, const uint8_t *state,
+                                               int64_t timestamp) {
+    const uint16_t state_len = ceiling_fraction(slot->position_count, 8);
+
+    for (int word = 0; word < ceiling_fraction(slot->position_count, 32); word++) {
+        uint32_t peripheral_word = 0;
+        for (int byte = 0; byte < 4 && word * 4 + byte < state_len; byte++) {
+            peripheral_word |= (uint32_t)state[word * 4 + byte] << (byte * 8);
+        }
+
+        uint32_t changed = peripheral_word ^ slot->position_state[word];
+        while (changed) {
+            const int bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+            if (!split_central_queue_position_event(slot, word * 32 + bit,
+                                                    (peripheral_word & BIT(bit)) != 0, timestamp)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static uint8_t split_central_read_position_state(struct bt_conn *conn, uint8_t err,
+                                                 struct bt_gatt_read_params *params,
+                                                 const void *data, uint16_t length) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (err) {
+        slot->resyncing = false;
+        LOG_ERR("Failed to read the peripheral position state (err %d)", err);
+        return BT_GATT_ITER_STOP;
+    }
+
+    // long reads arrive in several parts, followed by a call without data
+    if (data != NULL) {
+        const uint16_t len = MIN(length, sizeof(slot->state_read) - slot->state_read_len);
+        memcpy(slot->state_read + slot->state_read_len, data, len);
+        slot->state_read_len += len;
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    slot->resyncing = false;
+
+    const struct zmk_split_position_state *state = (const void *)slot->state_read;
+    if (slot->state_read_len < sizeof(*state) + ceiling_fraction(slot->position_count, 8)) {
+        LOG_ERR("Peripheral position state of %d bytes is too short", slot->state_read_len);
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (state->version != ZMK_SPLIT_POSITION_PROTOCOL_VERSION) {
+        LOG_ERR("Peripheral uses split protocol version %d, expected %d", state->version,
+                ZMK_SPLIT_POSITION_PROTOCOL_VERSION);
+        return BT_GATT_ITER_STOP;
+    }
+
+    LOG_DBG("Resynchronized at position event %d", state->sequence);
+
+    if (!split_central_apply_position_state(slot, state->state, k_uptime_get())) {
+        return BT_GATT_ITER_STOP;
+    }
+
+    slot->next_sequence = state->sequence;
+    slot->synced = true;
+
+    return BT_GATT_ITER_STOP;
+}
+
+static void split_central_resync(struct peripheral_slot *slot) {
+    if (slot->resyncing || slot->position_count == 0) {
+        return;
+    }
+
+    slot->state_read_len = 0;
+    slot->read_params.func = split_central_read_position_state;
+    slot->read_params.handle_count = 1;
+    slot->read_params.single.handle = slot->subscribe_params.value_handle;
+    slot->read_params.single.offset = 0;
+
+    int err = bt_gatt_read(slot->conn, &slot->read_params);
+    if (err) {
+        LOG_ERR("Failed to read the peripheral position state (err %d)", err);
+        return;
+    }
+    slot->resyncing = true;
+}
+
+static void split_central_resync_work_handler(struct k_work *work) {
+    split_central_resync(CONTAINER_OF(work, struct peripheral_slot, resync_work));
+}
+
 static uint8_t split_central_notify_func(struct bt_conn *conn,
                                          struct bt_gatt_subscribe_params *params, const void *data,
                                          uint16_t length) {
@@ -210,26 +515,83 @@ static uint8_t split_central_notify_func(struct bt_conn *conn,
 
     LOG_DBG("[NOTIFICATION] data %p length %u", data, length);
 
-    for (int i = 0; i < POSITION_STATE_DATA_LEN; i++) {
-        slot->changed_positions[i] = ((uint8_t *)data)[i] ^ slot->position_state[i];
-        slot->position_state[i] = ((uint8_t *)data)[i];
-        LOG_DBG("data: %d", slot->position_state[i]);
-    }
-
-    for (int i = 0; i < POSITION_STATE_DATA_LEN; i++) {
-        for (int j = 0; j < 8; j++) {
-            if (slot->changed_positions[i] & BIT(j)) {
-                uint32_t position = (i * 8) + j;
-                bool pressed = slot->position_state[i] & BIT(j);
-                struct zmk_position_state_changed ev = {.source =
-                                                            peripheral_slot_index_for_conn(conn),
-                                                        .position = position,
-                                                        .state = pressed,
-                                                        .timestamp = k_uptime_get()};
-
-                k_msgq_put(&peripheral_event_msgq, &ev, K_NO_WAIT);
-                k_work_submit(&peripheral_event_work);
-            }
+    // A sleeping peripheral wakes on a key press, so its first event after connecting is usually
+    // that press.
+    if (!slot->first_event_seen) {
+        const int64_t now = k_uptime_get();
+
+        slot->first_event_seen = true;
+        LOG_INF("First event from peripheral %d %lld ms after it was found, %lld ms after "
+                "connecting with %s handles",
+                slot - peripherals, now - slot->found_at, now - slot->connected_at,
+                slot->cached_handles ? "cached" : "discovered");
+    }
+
+    const struct zmk_split_position_events *packet = data;
+    if (length < sizeof(*packet) ||
+        length < sizeof(*packet) + packet->count * sizeof(struct zmk_split_position_event)) {
+        LOG_ERR("Malformed position events notification of %d bytes", length);
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    if (packet->version != ZMK_SPLIT_POSITION_PROTOCOL_VERSION) {
+        LOG_ERR("Peripheral uses split protocol version %d, expected %d", packet->version,
+                ZMK_SPLIT_POSITION_PROTOCOL_VERSION);
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    if (!slot->synced) {
+        split_central_resync(slot);
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    int8_t missed = packet->sequence - slot->next_sequence;
+    if (missed > 0) {
+        LOG_WRN("Missed %d position events from the peripheral, resynchronizing", missed);
+        slot->synced = false;
+        split_central_resync(slot);
+        return BT_GATT_ITER_CONTINUE;
+    }
+
+    // The last event is placed by the peripheral clock, or at the time the notification arrived
+    // until the clocks are synchronized. The ones before it are placed back in time by the deltas
+    // which follow them.
+    int64_t timestamp = k_uptime_get();
+    if (slot->clock.valid) {
+        const int64_t peripheral_now_ms =
+            split_clock_peripheral_us(&slot->clock, central_uptime_us()) / USEC_PER_MSEC;
+        const int32_t age_ms = (uint32_t)peripheral_now_ms - packet->timestamp;
+
+        timestamp -= MAX(age_ms, 0);
+    }
+    for (int i = 1; i < packet->count; i++) {
+        timestamp -= packet->events[i].delta_ms;
+    }
+
+    for (int i = 0; i < packet->count; i++) {
+        const struct zmk_split_position_event *event = &packet->events[i];
+        uint8_t sequence = packet->sequence + i;
+
+        if (i > 0) {
+            timestamp += event->delta_ms;
+        }
+
+        // events from before the last resynchronization are already in position_state
+        if ((int8_t)(sequence - slot->next_sequence) < 0) {
+            continue;
+        }
+        slot->next_sequence = sequence + 1;
+
+        const uint16_t position = event->position & ZMK_SPLIT_POSITION_MAX;
+        const bool pressed = (event->position & ZMK_SPLIT_POSITION_PRESSED) != 0;
+        if (position >= slot->position_count) {
+            LOG_ERR("Peripheral position %d out of range", position);
+            continue;
+        }
+
+        LOG_DBG("position %d %s at %lld", position, pressed ? "pressed" : "released", timestamp);
+        if (!split_central_queue_position_event(slot, position, pressed, timestamp)) {
+            break;
         }
     }
 
@@ -278,12 +640,406 @@ static uint8_t split_central_sensor_desc_discovery_func(struct bt_conn *conn,
         sensor_subscribe_params.value = BT_GATT_CCC_NOTIFY;
         sensor_subscribe_params.ccc_handle = attr->handle;
         split_central_subscribe(conn, &sensor_subscribe_params);
+
+        struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+        if (slot != NULL) {
+            split_central_save_handles(slot);
+        }
     }
 
     return BT_GATT_ITER_STOP;
 }
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
+static void split_central_run_queued_behaviors();
+
+static uint8_t split_central_read_behaviors(struct bt_conn *conn, uint8_t err,
+                                            struct bt_gatt_read_params *params, const void *data,
+                                            uint16_t length) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (err) {
+        LOG_ERR("Failed to read the peripheral behaviors (err %d)", err);
+        slot->behaviors_read_failed = true;
+        split_central_run_queued_behaviors();
+        return BT_GATT_ITER_STOP;
+    }
+
+    // long reads arrive in several parts, followed by a call without data
+    if (data == NULL) {
+        slot->behaviors_read = true;
+        LOG_DBG("Peripheral has %d behaviors", slot->behaviors_len / sizeof(uint32_t));
+        split_central_run_queued_behaviors();
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (slot->behaviors_len + length > sizeof(slot->behavior_ids)) {
+        LOG_ERR("Peripheral has more than %d behaviors, increase "
+                "CONFIG_ZMK_SPLIT_BLE_CENTRAL_PERIPHERAL_BEHAVIORS_MAX",
+                CONFIG_ZMK_SPLIT_BLE_CENTRAL_PERIPHERAL_BEHAVIORS_MAX);
+        length = sizeof(slot->behavior_ids) - slot->behaviors_len;
+    }
+
+    memcpy((uint8_t *)slot->behavior_ids + slot->behaviors_len, data, length);
+    slot->behaviors_len += length;
+
+    return BT_GATT_ITER_CONTINUE;
+}
+
+static void split_central_read_behaviors_start(struct peripheral_slot *slot) {
+    slot->behaviors_len = 0;
+    slot->behaviors_read = false;
+    slot->behaviors_read_failed = false;
+    slot->behaviors_read_params.func = split_central_read_behaviors;
+    slot->behaviors_read_params.handle_count = 1;
+    slot->behaviors_read_params.single.handle = slot->behaviors_handle;
+    slot->behaviors_read_params.single.offset = 0;
+
+    int err = bt_gatt_read(slot->conn, &slot->behaviors_read_params);
+    if (err) {
+        LOG_ERR("Failed to read the peripheral behaviors (err %d)", err);
+        slot->behaviors_read_failed = true;
+        split_central_run_queued_behaviors();
+    }
+}
+
+static uint8_t split_central_read_position_count(struct bt_conn *conn, uint8_t err,
+                                                 struct bt_gatt_read_params *params,
+                                                 const void *data, uint16_t length) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_STOP;
+    }
+
+    if (err || data == NULL || length < sizeof(uint16_t)) {
+        LOG_ERR("Failed to read the peripheral's number of positions (err %d)", err);
+        return BT_GATT_ITER_STOP;
+    }
+
+    uint16_t count = sys_get_le16(data);
+    if (count > ZMK_KEYMAP_LEN) {
+        LOG_WRN("Peripheral has %d positions, only the %d in the keymap are used", count,
+                ZMK_KEYMAP_LEN);
+        count = ZMK_KEYMAP_LEN;
+    }
+
+    LOG_DBG("Peripheral has %d positions", count);
+    slot->position_count = count;
+    split_central_resync(slot);
+
+    return BT_GATT_ITER_STOP;
+}
+
+static void split_central_read_position_count_start(struct peripheral_slot *slot) {
+    slot->position_count_read_params.func = split_central_read_position_count;
+    slot->position_count_read_params.handle_count = 0;
+    slot->position_count_read_params.by_uuid.uuid = BT_UUID_NUM_OF_DIGITALS;
+    slot->position_count_read_params.by_uuid.start_handle = slot->subscribe_params.value_handle;
+    slot->position_count_read_params.by_uuid.end_handle = 0xffff;
+
+    int err = bt_gatt_read(slot->conn, &slot->position_count_read_params);
+    if (err) {
+        LOG_ERR("Failed to read the peripheral's number of positions (err %d)", err);
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES)
+
+/*
+ * The split service handles of a bonded peripheral, saved so reconnecting skips discovery. The
+ * peripheral's GATT database hash tells whether they are still valid.
+ */
+struct split_central_handles {
+    bt_addr_le_t addr;
+    uint8_t db_hash[16];
+    bool has_db_hash;
+    uint16_t position_state;
+    uint16_t position_state_ccc;
+    uint16_t run_behavior;
+    uint16_t clock;
+    uint16_t behaviors;
+#if ZMK_KEYMAP_HAS_SENSORS
+    uint16_t sensor_state;
+    uint16_t sensor_state_ccc;
+#endif
+};
+
+// an entry without a position state handle is unused
+static struct split_central_handles cached_handles[ZMK_BLE_SPLIT_PERIPHERAL_COUNT];
+static uint32_t cached_handles_dirty;
+
+static void split_central_save_handles_work(struct k_work *work) {
+    for (int i = 0; i < ARRAY_SIZE(cached_handles); i++) {
+        char setting_name[32];
+        int err;
+
+        if (!(cached_handles_dirty & BIT(i))) {
+            continue;
+        }
+        cached_handles_dirty &= ~BIT(i);
+
+        sprintf(setting_name, "split/central/handles/%d", i);
+        if (cached_handles[i].position_state) {
+            err = settings_save_one(setting_name, &cached_handles[i], sizeof(cached_handles[i]));
+        } else {
+            err = settings_delete(setting_name);
+        }
+
+        if (err) {
+            LOG_ERR("Failed to save the handles of peripheral %d (err %d)", i, err);
+        }
+    }
+}
+
+static K_WORK_DEFINE(save_handles_work, split_central_save_handles_work);
+
+static int split_central_handles_index(const bt_addr_le_t *addr) {
+    for (int i = 0; i < ARRAY_SIZE(cached_handles); i++) {
+        if (cached_handles[i].position_state &&
+            bt_addr_le_cmp(&cached_handles[i].addr, addr) == 0) {
+            return i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+static const struct split_central_handles *split_central_find_handles(struct bt_conn *conn) {
+    int idx = split_central_handles_index(bt_conn_get_dst(conn));
+
+    return idx < 0 ? NULL : &cached_handles[idx];
+}
+
+static void split_central_forget_handles(struct bt_conn *conn) {
+    int idx = split_central_handles_index(bt_conn_get_dst(conn));
+    if (idx < 0) {
+        return;
+    }
+
+    memset(&cached_handles[idx], 0, sizeof(cached_handles[idx]));
+    cached_handles_dirty |= BIT(idx);
+    k_work_submit(&save_handles_work);
+}
+
+static void split_central_save_handles(struct peripheral_slot *slot) {
+    if (slot->cached_handles || slot->handles_saved || !slot->db_hash_read ||
+        !slot->subscribe_params.ccc_handle || !slot->run_behavior_handle || !slot->clock_handle ||
+        !slot->behaviors_handle) {
+        return;
+    }
+
+#if ZMK_KEYMAP_HAS_SENSORS
+    if (!sensor_subscribe_params.ccc_handle) {
+        return;
+    }
+#endif
+
+    const bt_addr_le_t *addr = bt_conn_get_dst(slot->conn);
+    int idx = split_central_handles_index(addr);
+    for (int i = 0; idx < 0 && i < ARRAY_SIZE(cached_handles); i++) {
+        if (!cached_handles[i].position_state) {
+            idx = i;
+        }
+    }
+    if (idx < 0) {
+        // every entry belongs to another bond, the one matching this slot is the likeliest stale
+        idx = slot - peripherals;
+    }
+
+    struct split_central_handles *handles = &cached_handles[idx];
+    *handles = (struct split_central_handles){
+        .has_db_hash = slot->has_db_hash,
+        .position_state = slot->subscribe_params.value_handle,
+        .position_state_ccc = slot->subscribe_params.ccc_handle,
+        .run_behavior = slot->run_behavior_handle,
+        .clock = slot->clock_handle,
+        .behaviors = slot->behaviors_handle,
+#if ZMK_KEYMAP_HAS_SENSORS
+        .sensor_state = sensor_subscribe_params.value_handle,
+        .sensor_state_ccc = sensor_subscribe_params.ccc_handle,
+#endif
+    };
+    bt_addr_le_copy(&handles->addr, addr);
+    memcpy(handles->db_hash, slot->db_hash, sizeof(handles->db_hash));
+
+    LOG_DBG("Saving the handles of peripheral %d", slot - peripherals);
+    slot->handles_saved = true;
+    cached_handles_dirty |= BIT(idx);
+    k_work_submit(&save_handles_work);
+}
+
+// The peripheral's services changed since the handles were cached. Reconnecting discovers them,
+// which is simpler than untangling the requests already made with the old ones.
+static void split_central_handles_stale(struct peripheral_slot *slot) {
+    LOG_WRN("Cached handles of peripheral %d are out of date, reconnecting", slot - peripherals);
+
+    split_central_forget_handles(slot->conn);
+    slot->cached_handles = false;
+
+    int err = bt_conn_disconnect(slot->conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    if (err) {
+        LOG_ERR("Failed to disconnect the peripheral (err %d)", err);
+    }
+}
+
+static int split_central_handles_set(const char *name, size_t len, settings_read_cb read_cb,
+                                     void *cb_arg) {
+    const char *next;
+
+    if (settings_name_steq(name, "handles", &next) && next) {
+        char *endptr;
+        uint8_t idx = strtoul(next, &endptr, 10);
+        if (*endptr != '\0' || idx >= ARRAY_SIZE(cached_handles)) {
+            LOG_WRN("Invalid peripheral handles index: %s", log_strdup(next));
+            return -EINVAL;
+        }
+
+        // handles saved by a different build are discovered again
+        if (len != sizeof(cached_handles[idx])) {
+            return -EINVAL;
+        }
+
+        int err = read_cb(cb_arg, &cached_handles[idx], sizeof(cached_handles[idx]));
+        if (err <= 0) {
+            LOG_ERR("Failed to handle peripheral handles from settings (err %d)", err);
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+struct settings_handler split_central_handler = {.name = "split/central",
+                                                 .h_set = split_central_handles_set};
+
+#else
+
+struct split_central_handles;
+
+static const struct split_central_handles *split_central_find_handles(struct bt_conn *conn) {
+    return NULL;
+}
+
+static void split_central_save_handles(struct peripheral_slot *slot) {}
+
+static void split_central_handles_stale(struct peripheral_slot *slot) {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES) */
+
+static void split_central_subscribed(struct bt_conn *conn, uint8_t err,
+                                     struct bt_gatt_write_params *params) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return;
+    }
+
+    if (err) {
+        LOG_ERR("Failed to subscribe to position events (err %d)", err);
+        if (slot->cached_handles) {
+            split_central_handles_stale(slot);
+        }
+        return;
+    }
+
+    LOG_DBG("Subscribed to peripheral %d %lld ms after connecting", slot - peripherals,
+            k_uptime_get() - slot->connected_at);
+    split_central_save_handles(slot);
+}
+
+static uint8_t split_central_read_db_hash(struct bt_conn *conn, uint8_t err,
+                                          struct bt_gatt_read_params *params, const void *data,
+                                          uint16_t length) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL) {
+        LOG_ERR("No peripheral state found for connection");
+        return BT_GATT_ITER_STOP;
+    }
+
+    // peripherals without GATT caching have no hash, their handles are only checked by subscribing
+    slot->has_db_hash = !err && data != NULL && length == sizeof(slot->db_hash);
+    if (slot->has_db_hash) {
+        memcpy(slot->db_hash, data, sizeof(slot->db_hash));
+    } else {
+        LOG_DBG("Peripheral has no GATT database hash (err %d)", err);
+    }
+    slot->db_hash_read = true;
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES)
+    const struct split_central_handles *handles = split_central_find_handles(conn);
+    if (slot->cached_handles && handles != NULL &&
+        (handles->has_db_hash != slot->has_db_hash ||
+         memcmp(handles->db_hash, slot->db_hash, sizeof(slot->db_hash)) != 0)) {
+        split_central_handles_stale(slot);
+        return BT_GATT_ITER_STOP;
+    }
+#endif
+
+    split_central_save_handles(slot);
+
+    return BT_GATT_ITER_STOP;
+}
+
+static void split_central_read_db_hash_start(struct peripheral_slot *slot) {
+    slot->db_hash_read_params.func = split_central_read_db_hash;
+    slot->db_hash_read_params.handle_count = 0;
+    slot->db_hash_read_params.by_uuid.uuid = BT_UUID_GATT_DB_HASH;
+    slot->db_hash_read_params.by_uuid.start_handle = 0x0001;
+    slot->db_hash_read_params.by_uuid.end_handle = 0xffff;
+
+    int err = bt_gatt_read(slot->conn, &slot->db_hash_read_params);
+    if (err) {
+        LOG_ERR("Failed to read the peripheral's GATT database hash (err %d)", err);
+    }
+}
+
+static void split_central_subscribe_position_state(struct peripheral_slot *slot) {
+    slot->subscribe_params.notify = split_central_notify_func;
+    slot->subscribe_params.write = split_central_subscribed;
+    slot->subscribe_params.value = BT_GATT_CCC_NOTIFY;
+    split_central_subscribe(slot->conn, &slot->subscribe_params);
+    split_central_read_position_count_start(slot);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES)
+
+// Subscribes straight away, the database hash read alongside catches handles which changed.
+static void split_central_use_handles(struct peripheral_slot *slot,
+                                      const struct split_central_handles *handles) {
+    LOG_DBG("Using cached handles for peripheral %d", slot - peripherals);
+
+    slot->subscribe_params.value_handle = handles->position_state;
+    slot->subscribe_params.ccc_handle = handles->position_state_ccc;
+    split_central_subscribe_position_state(slot);
+
+#if ZMK_KEYMAP_HAS_SENSORS
+    sensor_subscribe_params.notify = split_central_sensor_notify_func;
+    sensor_subscribe_params.value = BT_GATT_CCC_NOTIFY;
+    sensor_subscribe_params.value_handle = handles->sensor_state;
+    sensor_subscribe_params.ccc_handle = handles->sensor_state_ccc;
+    split_central_subscribe(slot->conn, &sensor_subscribe_params);
+#endif
+
+    slot->run_behavior_handle = handles->run_behavior;
+    slot->behaviors_handle = handles->behaviors;
+    split_central_read_behaviors_start(slot);
+
+    slot->clock_handle = handles->clock;
+    k_delayed_work_submit(&slot->clock.work, K_NO_WAIT);
+}
+
+#else
+
+static void split_central_use_handles(struct peripheral_slot *slot,
+                                      const struct split_central_handles *handles) {}
+
+#endif /* IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES) */
+
 static uint8_t split_central_chrc_discovery_func(struct bt_conn *conn,
                                                  const struct bt_gatt_attr *attr,
                                                  struct bt_gatt_discover_params *params) {
@@ -315,16 +1071,28 @@ static uint8_t split_central_chrc_discovery_func(struct bt_conn *conn,
         slot->subscribe_params.disc_params = &slot->sub_discover_params;
         slot->subscribe_params.end_handle = slot->discover_params.end_handle;
         slot->subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
-        slot->subscribe_params.notify = split_central_notify_func;
-        slot->subscribe_params.value = BT_GATT_CCC_NOTIFY;
-        split_central_subscribe(conn, &slot->subscribe_params);
+        split_central_subscribe_position_state(slot);
     } else if (!bt_uuid_cmp(((struct bt_gatt_chrc *)attr->user_data)->uuid,
                             BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_RUN_BEHAVIOR_UUID))) {
         LOG_DBG("Found run behavior handle");
         slot->run_behavior_handle = bt_gatt_attr_value_handle(attr);
+    } else if (!bt_uuid_cmp(((struct bt_gatt_chrc *)attr->user_data)->uuid,
+                            BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_CLOCK_UUID))) {
+        LOG_DBG("Found clock handle");
+        slot->clock_handle = bt_gatt_attr_value_handle(attr);
+        k_delayed_work_submit(&slot->clock.work, K_NO_WAIT);
+    } else if (!bt_uuid_cmp(((struct bt_gatt_chrc *)attr->user_data)->uuid,
+                            BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_BEHAVIORS_UUID))) {
+        LOG_DBG("Found behaviors handle");
+        slot->behaviors_handle = bt_gatt_attr_value_handle(attr);
+        split_central_read_behaviors_start(slot);
     }
 
-    bool subscribed = (slot->run_behavior_handle && slot->subscribe_params.value_handle);
+    bool subscribed = (slot->run_behavior_handle && slot->subscribe_params.value_handle &&
+                       slot->clock_handle && slot->behaviors_handle);
+    if (subscribed) {
+        split_central_save_handles(slot);
+    }
 
     return subscribed ? BT_GATT_ITER_STOP : BT_GATT_ITER_CONTINUE;
 }
@@ -380,6 +1148,21 @@ static uint8_t split_central_service_discovery_func(struct bt_conn *conn,
     return BT_GATT_ITER_STOP;
 }
 
+static int split_central_discover(struct peripheral_slot *slot) {
+    slot->discover_params.uuid = &split_service_uuid.uuid;
+    slot->discover_params.func = split_central_service_discovery_func;
+    slot->discover_params.start_handle = 0x0001;
+    slot->discover_params.end_handle = 0xffff;
+    slot->discover_params.type = BT_GATT_DISCOVER_PRIMARY;
+
+    int err = bt_gatt_discover(slot->conn, &slot->discover_params);
+    if (err) {
+        LOG_ERR("Discover failed(err %d)", err);
+    }
+
+    return err;
+}
+
 static void split_central_process_connection(struct bt_conn *conn) {
     int err;
 
@@ -397,20 +1180,24 @@ static void split_central_process_connection(struct bt_conn *conn) {
         return;
     }
 
-    if (!slot->subscribe_params.value_handle) {
-        slot->discover_params.uuid = &split_service_uuid.uuid;
-        slot->discover_params.func = split_central_service_discovery_func;
-        slot->discover_params.start_handle = 0x0001;
-        slot->discover_params.end_handle = 0xffff;
-        slot->discover_params.type = BT_GATT_DISCOVER_PRIMARY;
-
-        err = bt_gatt_discover(slot->conn, &slot->discover_params);
+    const struct split_central_handles *handles = split_central_find_handles(conn);
+    if (handles != NULL && !slot->subscribe_params.value_handle) {
+        // the characteristics need encryption, so the subscription waits for the security change
+        slot->cached_handles = true;
+        if (bt_conn_get_security(conn) >= BT_SECURITY_L2) {
+            split_central_use_handles(slot, handles);
+        }
+    } else if (!slot->subscribe_params.value_handle) {
+        err = split_central_discover(slot);
         if (err) {
-            LOG_ERR("Discover failed(err %d)", err);
             return;
         }
     }
 
+    if (IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES) && !slot->db_hash_read) {
+        split_central_read_db_hash_start(slot);
+    }
+
     struct bt_conn_info info;
 
     bt_conn_get_info(conn, &info);
@@ -472,6 +1259,7 @@ static bool split_central_eir_found(struct bt_data *data, void *user_data) {
             }
 
             struct peripheral_slot *slot = &peripherals[slot_idx];
+            slot->found_at = k_uptime_get();
 
             slot->conn = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr);
             if (slot->conn) {
@@ -549,6 +1337,11 @@ static void split_central_connected(struct bt_conn *conn, uint8_t conn_err) {
     LOG_DBG("Connected: %s", log_strdup(addr));
 
     confirm_peripheral_slot_conn(conn);
+
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot != NULL) {
+        slot->connected_at = k_uptime_get();
+    }
     split_central_process_connection(conn);
 }
 
@@ -560,13 +1353,36 @@ static void split_central_disconnected(struct bt_conn *conn, uint8_t reason) {
     LOG_DBG("Disconnected: %s (reason %d)", log_strdup(addr), reason);
 
     release_peripheral_slot_for_conn(conn);
+    // drops the behaviors held back for the peripheral
+    split_central_run_queued_behaviors();
 
     start_scan();
 }
 
+static void split_central_security_changed(struct bt_conn *conn, bt_security_t level,
+                                           enum bt_security_err err) {
+    struct peripheral_slot *slot = peripheral_slot_for_conn(conn);
+    if (slot == NULL || !slot->cached_handles || slot->subscribe_params.value_handle) {
+        return;
+    }
+
+    if (err) {
+        LOG_WRN("Failed to secure the connection (err %d), discovering the split service", err);
+        slot->cached_handles = false;
+        split_central_discover(slot);
+        return;
+    }
+
+    const struct split_central_handles *handles = split_central_find_handles(conn);
+    if (handles != NULL) {
+        split_central_use_handles(slot, handles);
+    }
+}
+
 static struct bt_conn_cb conn_callbacks = {
     .connected = split_central_connected,
     .disconnected = split_central_disconnected,
+    .security_changed = split_central_security_changed,
 };
 
 K_THREAD_STACK_DEFINE(split_central_split_run_q_stack,
@@ -576,28 +1392,56 @@ struct k_work_q split_central_split_run_q;
 
 struct zmk_split_run_behavior_payload_wrapper {
     uint8_t source;
+    uint32_t behavior_id;
     struct zmk_split_run_behavior_payload payload;
 };
 
-K_MSGQ_DEFINE(zmk_split_central_split_run_msgq,
-              sizeof(struct zmk_split_run_behavior_payload_wrapper),
-              CONFIG_ZMK_BLE_SPLIT_CENTRAL_SPLIT_RUN_QUEUE_SIZE, 4);
+// One queue for each peripheral, so runs held back for a peripheral whose behaviors are not read
+// yet don't hold back the runs for the others.
+#define SPLIT_RUN_MSG_SIZE sizeof(struct zmk_split_run_behavior_payload_wrapper)
 
-void split_central_split_run_callback(struct k_work *work) {
+static struct k_msgq split_run_msgqs[ZMK_BLE_SPLIT_PERIPHERAL_COUNT];
+static char __aligned(4) split_run_msgq_buffers[ZMK_BLE_SPLIT_PERIPHERAL_COUNT]
+                                               [CONFIG_ZMK_BLE_SPLIT_CENTRAL_SPLIT_RUN_QUEUE_SIZE *
+                                                SPLIT_RUN_MSG_SIZE];
+
+static void split_central_run_peripheral_behaviors(struct peripheral_slot *slot,
+                                                   struct k_msgq *msgq) {
     struct zmk_split_run_behavior_payload_wrapper payload_wrapper;
 
-    LOG_DBG("");
+    // sent in order once the behaviors are read, see split_central_read_behaviors
+    if (slot->state == PERIPHERAL_SLOT_STATE_CONNECTED && !slot->behaviors_read &&
+        !slot->behaviors_read_failed) {
+        if (k_msgq_num_used_get(msgq) > 0) {
+            LOG_DBG("Holding behaviors until the peripheral behaviors are read");
+        }
+        return;
+    }
 
-    while (k_msgq_get(&zmk_split_central_split_run_msgq, &payload_wrapper, K_NO_WAIT) == 0) {
-        if (peripherals[payload_wrapper.source].state != PERIPHERAL_SLOT_STATE_CONNECTED) {
+    while (k_msgq_get(msgq, &payload_wrapper, K_NO_WAIT) == 0) {
+        if (slot->state != PERIPHERAL_SLOT_STATE_CONNECTED) {
             LOG_ERR("Source not connected");
             continue;
         }
 
-        int err = bt_gatt_write_without_response(
-            peripherals[payload_wrapper.source].conn,
-            peripherals[payload_wrapper.source].run_behavior_handle, &payload_wrapper.payload,
-            sizeof(struct zmk_split_run_behavior_payload), true);
+        if (!slot->behaviors_read) {
+            LOG_ERR("Failed to read the peripheral behaviors, dropping behavior 0x%08x",
+                    payload_wrapper.behavior_id);
+            continue;
+        }
+
+        int index = zmk_split_behavior_index(slot->behavior_ids,
+                                             slot->behaviors_len / sizeof(uint32_t),
+                                             payload_wrapper.behavior_id);
+        if (index < 0 || index > UINT8_MAX) {
+            LOG_ERR("Peripheral has no behavior with ID 0x%08x", payload_wrapper.behavior_id);
+            continue;
+        }
+        payload_wrapper.payload.behavior = index;
+
+        int err = bt_gatt_write_without_response(slot->conn, slot->run_behavior_handle,
+                                                 &payload_wrapper.payload,
+                                                 sizeof(payload_wrapper.payload), true);
 
         if (err) {
             LOG_ERR("Failed to write the behavior characteristic (err %d)", err);
@@ -605,19 +1449,37 @@ void split_central_split_run_callback(struct k_work *work) {
     }
 }
 
+void split_central_split_run_callback(struct k_work *work) {
+    LOG_DBG("");
+
+    for (int i = 0; i < ZMK_BLE_SPLIT_PERIPHERAL_COUNT; i++) {
+        split_central_run_peripheral_behaviors(&peripherals[i], &split_run_msgqs[i]);
+    }
+}
+
 K_WORK_DEFINE(split_central_split_run_work, split_central_split_run_callback);
 
+static void split_central_run_queued_behaviors() {
+    k_work_submit_to_queue(&split_central_split_run_q, &split_central_split_run_work);
+}
+
 static int
 split_bt_invoke_behavior_payload(struct zmk_split_run_behavior_payload_wrapper payload_wrapper) {
     LOG_DBG("");
 
-    int err = k_msgq_put(&zmk_split_central_split_run_msgq, &payload_wrapper, K_MSEC(100));
+    if (payload_wrapper.source >= ZMK_BLE_SPLIT_PERIPHERAL_COUNT) {
+        LOG_ERR("No peripheral %d", payload_wrapper.source);
+        return -EINVAL;
+    }
+
+    struct k_msgq *msgq = &split_run_msgqs[payload_wrapper.source];
+    int err = k_msgq_put(msgq, &payload_wrapper, K_MSEC(100));
     if (err) {
         switch (err) {
         case -EAGAIN: {
             LOG_WRN("Consumer message queue full, popping first message and queueing again");
             struct zmk_split_run_behavior_payload_wrapper discarded_report;
-            k_msgq_get(&zmk_split_central_split_run_msgq, &discarded_report, K_NO_WAIT);
+            k_msgq_get(msgq, &discarded_report, K_NO_WAIT);
             return split_bt_invoke_behavior_payload(payload_wrapper);
         }
         default:
@@ -626,31 +1488,58 @@ split_bt_invoke_behavior_payload(struct zmk_split_run_behavior_payload_wrapper p
         }
     }
 
-    k_work_submit_to_queue(&split_central_split_run_q, &split_central_split_run_work);
+    split_central_run_queued_behaviors();
 
     return 0;
 };
 
-int zmk_split_bt_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
-                                 struct zmk_behavior_binding_event event, bool state) {
-    struct zmk_split_run_behavior_payload payload = {.data = {
-                                                         .param1 = binding->param1,
-                                                         .param2 = binding->param2,
-                                                         .position = event.position,
-                                                         .state = state ? 1 : 0,
-                                                     }};
-    const size_t payload_dev_size = sizeof(payload.behavior_dev);
-    if (strlcpy(payload.behavior_dev, binding->behavior_dev, payload_dev_size) >=
-        payload_dev_size) {
-        LOG_ERR("Truncated behavior label %s to %s before invoking peripheral behavior",
-                log_strdup(binding->behavior_dev), log_strdup(payload.behavior_dev));
-    }
-
-    struct zmk_split_run_behavior_payload_wrapper wrapper = {.source = source, .payload = payload};
+int zmk_split_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
+                              struct zmk_behavior_binding_event event, bool state) {
+    struct zmk_split_run_behavior_payload_wrapper wrapper = {
+        .source = source,
+        .behavior_id = zmk_split_behavior_id(binding->behavior_dev),
+        .payload =
+            {
+                .param1 = binding->param1,
+                .param2 = binding->param2,
+                .position = event.position,
+                .state = state ? 1 : 0,
+            },
+    };
+
     return split_bt_invoke_behavior_payload(wrapper);
 }
 
+bool zmk_split_bt_central_clock_synced() {
+    for (int i = 0; i < ZMK_BLE_SPLIT_PERIPHERAL_COUNT; i++) {
+        if (peripherals[i].state == PERIPHERAL_SLOT_STATE_CONNECTED && peripherals[i].clock.valid) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 int zmk_split_bt_central_init(const struct device *_arg) {
+    for (int i = 0; i < ZMK_BLE_SPLIT_PERIPHERAL_COUNT; i++) {
+        k_delayed_work_init(&peripherals[i].clock.work, split_central_clock_work_handler);
+        k_work_init(&peripherals[i].resync_work, split_central_resync_work_handler);
+        k_msgq_init(&split_run_msgqs[i], split_run_msgq_buffers[i], SPLIT_RUN_MSG_SIZE,
+                    CONFIG_ZMK_BLE_SPLIT_CENTRAL_SPLIT_RUN_QUEUE_SIZE);
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_BLE_CENTRAL_CACHE_HANDLES)
+    settings_subsys_init();
+
+    int err = settings_register(&split_central_handler);
+    if (err) {
+        LOG_ERR("Failed to register the split central settings handler (err %d)", err);
+        return err;
+    }
+
+    settings_load_subtree("split/central");
+#endif
+
     k_work_q_start(&split_central_split_run_q, split_central_split_run_q_stack,
                    K_THREAD_STACK_SIZEOF(split_central_split_run_q_stack),
                    CONFIG_ZMK_BLE_THREAD_PRIORITY);
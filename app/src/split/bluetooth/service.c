@@ -4,7 +4,9 @@
  * SPDX-License-Identifier: MIT
  */
 
+#include <device.h>
 #include <drivers/sensor.h>
+#include <string.h>
 #include <zephyr/types.h>
 #include <sys/util.h>
 #include <init.h>
@@ -16,11 +18,11 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 #include <bluetooth/gatt.h>
 #include <bluetooth/uuid.h>
 
-#include <drivers/behavior.h>
-#include <zmk/behavior.h>
 #include <zmk/matrix.h>
 #include <zmk/split/bluetooth/uuid.h>
 #include <zmk/split/bluetooth/service.h>
+#include <zmk/split/peripheral_behaviors.h>
+#include <zmk/split/transport.h>
 #include <zmk/sensors.h>
 
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -39,67 +41,70 @@ static void split_svc_sensor_state_ccc(const struct bt_gatt_attr *attr, uint16_t
 }
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
 
-#define POS_STATE_LEN 16
+#define POS_STATE_LEN ceiling_fraction(ZMK_KEYMAP_LEN, 8)
 
-static uint8_t num_of_positions = ZMK_KEYMAP_LEN;
+BUILD_ASSERT(ZMK_KEYMAP_LEN <= ZMK_SPLIT_POSITION_MAX + 1,
+             "Too many key positions for the split protocol");
+
+static uint16_t num_of_positions = ZMK_KEYMAP_LEN;
 static uint8_t position_state[POS_STATE_LEN];
+// sequence number of the next position event
+static uint8_t position_sequence;
+// keeps position_state and position_sequence consistent for reads from the BT thread
+static struct k_spinlock position_lock;
+
+static ssize_t split_svc_clock(struct bt_conn *conn, const struct bt_gatt_attr *attrs, void *buf,
+                               uint16_t len, uint16_t offset) {
+    struct zmk_split_clock clock = {.uptime_us = k_ticks_to_us_floor64(k_uptime_ticks())};
 
-static struct zmk_split_run_behavior_payload behavior_run_payload;
+    return bt_gatt_attr_read(conn, attrs, buf, len, offset, &clock, sizeof(clock));
+}
 
 static ssize_t split_svc_pos_state(struct bt_conn *conn, const struct bt_gatt_attr *attrs,
                                    void *buf, uint16_t len, uint16_t offset) {
-    return bt_gatt_attr_read(conn, attrs, buf, len, offset, &position_state,
-                             sizeof(position_state));
+    // Large states take several reads. The snapshot is taken by the first one, so every part
+    // comes from the same state.
+    static struct {
+        struct zmk_split_position_state header;
+        uint8_t state[POS_STATE_LEN];
+    } __packed snapshot = {.header = {.version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION}};
+
+    if (offset == 0) {
+        k_spinlock_key_t key = k_spin_lock(&position_lock);
+        snapshot.header.sequence = position_sequence;
+        memcpy(snapshot.state, position_state, sizeof(snapshot.state));
+        k_spin_unlock(&position_lock, key);
+    }
+
+    return bt_gatt_attr_read(conn, attrs, buf, len, offset, &snapshot, sizeof(snapshot));
+}
+
+static ssize_t split_svc_behaviors(struct bt_conn *conn, const struct bt_gatt_attr *attrs,
+                                   void *buf, uint16_t len, uint16_t offset) {
+    const uint32_t *ids;
+    uint8_t count = zmk_split_peripheral_behavior_ids(&ids);
+
+    return bt_gatt_attr_read(conn, attrs, buf, len, offset, ids, count * sizeof(ids[0]));
 }
 
 static ssize_t split_svc_run_behavior(struct bt_conn *conn, const struct bt_gatt_attr *attrs,
                                       const void *buf, uint16_t len, uint16_t offset,
                                       uint8_t flags) {
-    struct zmk_split_run_behavior_payload *payload = attrs->user_data;
-    uint16_t end_addr = offset + len;
-
-    LOG_DBG("offset %d len %d", offset, len);
+    const struct zmk_split_run_behavior_payload *payload = buf;
 
-    if (end_addr > sizeof(struct zmk_split_run_behavior_payload)) {
-        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    if (offset != 0 || len != sizeof(*payload)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
     }
 
-    memcpy(payload + offset, buf, len);
-
-    // We run if:
-    // 1: We've gotten all the position/state/param data.
-    // 2: We have a null terminated string for the behavior device label.
-    const size_t behavior_dev_offset =
-        offsetof(struct zmk_split_run_behavior_payload, behavior_dev);
-    if ((end_addr > sizeof(struct zmk_split_run_behavior_data)) &&
-        payload->behavior_dev[end_addr - behavior_dev_offset - 1] == '\0') {
-        struct zmk_behavior_binding binding = {
-            .param1 = payload->data.param1,
-            .param2 = payload->data.param2,
-            .behavior_dev = payload->behavior_dev,
-        };
-        LOG_DBG("%s with params %d %d: pressed? %d", log_strdup(binding.behavior_dev),
-                binding.param1, binding.param2, payload->data.state);
-        struct zmk_behavior_binding_event event = {.position = payload->data.position,
-                                                   .timestamp = k_uptime_get()};
-        int err;
-        if (payload->data.state > 0) {
-            err = behavior_keymap_binding_pressed(&binding, event);
-        } else {
-            err = behavior_keymap_binding_released(&binding, event);
-        }
-
-        if (err) {
-            LOG_ERR("Failed to invoke behavior %s: %d", log_strdup(binding.behavior_dev), err);
-        }
-    }
+    zmk_split_peripheral_run_behavior(payload);
 
     return len;
 }
 
 static ssize_t split_svc_num_of_positions(struct bt_conn *conn, const struct bt_gatt_attr *attrs,
                                           void *buf, uint16_t len, uint16_t offset) {
-    return bt_gatt_attr_read(conn, attrs, buf, len, offset, attrs->user_data, sizeof(uint8_t));
+    return bt_gatt_attr_read(conn, attrs, buf, len, offset, attrs->user_data,
+                             sizeof(num_of_positions));
 }
 
 static void split_svc_pos_state_ccc(const struct bt_gatt_attr *attr, uint16_t value) {
@@ -114,7 +119,7 @@ BT_GATT_SERVICE_DEFINE(
     BT_GATT_CCC(split_svc_pos_state_ccc, BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
     BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_RUN_BEHAVIOR_UUID),
                            BT_GATT_CHRC_WRITE_WITHOUT_RESP, BT_GATT_PERM_WRITE_ENCRYPT, NULL,
-                           split_svc_run_behavior, &behavior_run_payload),
+                           split_svc_run_behavior, NULL),
     BT_GATT_DESCRIPTOR(BT_UUID_NUM_OF_DIGITALS, BT_GATT_PERM_READ, split_svc_num_of_positions, NULL,
                        &num_of_positions),
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -123,40 +128,94 @@ BT_GATT_SERVICE_DEFINE(
                            split_svc_sensor_state, NULL, &sensor_event),
     BT_GATT_CCC(split_svc_sensor_state_ccc, BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT),
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_CLOCK_UUID), BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ_ENCRYPT, split_svc_clock, NULL, NULL),
+    BT_GATT_CHARACTERISTIC(BT_UUID_DECLARE_128(ZMK_SPLIT_BT_CHAR_BEHAVIORS_UUID),
+                           BT_GATT_CHRC_READ, BT_GATT_PERM_READ_ENCRYPT, split_svc_behaviors, NULL,
+                           NULL),
 );
 
 K_THREAD_STACK_DEFINE(service_q_stack, CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_STACK_SIZE);
 
 struct k_work_q service_work_q;
 
-K_MSGQ_DEFINE(position_state_msgq, sizeof(char[POS_STATE_LEN]),
+struct position_event {
+    uint16_t position;
+    bool state;
+    uint8_t sequence;
+    int64_t timestamp;
+};
+
+K_MSGQ_DEFINE(position_event_msgq, sizeof(struct position_event),
               CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_POSITION_QUEUE_SIZE, 4);
 
+#define POSITION_EVENTS_MAX CONFIG_ZMK_SPLIT_BLE_PERIPHERAL_POSITION_EVENTS_PER_NOTIFY
+
+// the time of the last event sent, the first delta of each notification is relative to it
+static int64_t last_timestamp;
+
+struct position_events_packet {
+    struct zmk_split_position_events header;
+    struct zmk_split_position_event events[POSITION_EVENTS_MAX];
+} __packed;
+
+static void notify_position_events(struct position_events_packet *packet) {
+    packet->header.timestamp = (uint32_t)last_timestamp;
+
+    int err = bt_gatt_notify(NULL, &split_svc.attrs[1], packet,
+                             sizeof(packet->header) +
+                                 packet->header.count * sizeof(struct zmk_split_position_event));
+    if (err) {
+        LOG_DBG("Error notifying %d", err);
+    }
+    packet->header.count = 0;
+}
+
 void send_position_state_callback(struct k_work *work) {
-    uint8_t state[POS_STATE_LEN];
+    struct position_events_packet packet = {
+        .header = {.version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION}};
+    struct position_event ev;
+
+    while (k_msgq_get(&position_event_msgq, &ev, K_NO_WAIT) == 0) {
+        // events dropped from a full queue leave a gap, which must start a new notification
+        if (packet.header.count > 0 &&
+            ev.sequence != (uint8_t)(packet.header.sequence + packet.header.count)) {
+            notify_position_events(&packet);
+        }
+        if (packet.header.count == 0) {
+            packet.header.sequence = ev.sequence;
+        }
 
-    while (k_msgq_get(&position_state_msgq, &state, K_NO_WAIT) == 0) {
-        int err = bt_gatt_notify(NULL, &split_svc.attrs[1], &state, sizeof(state));
-        if (err) {
-            LOG_DBG("Error notifying %d", err);
+        packet.events[packet.header.count++] = (struct zmk_split_position_event){
+            .position = ev.position | (ev.state ? ZMK_SPLIT_POSITION_PRESSED : 0),
+            .delta_ms = CLAMP(ev.timestamp - last_timestamp, 0, UINT16_MAX),
+        };
+        last_timestamp = ev.timestamp;
+
+        if (packet.header.count == POSITION_EVENTS_MAX) {
+            notify_position_events(&packet);
         }
     }
+
+    if (packet.header.count > 0) {
+        notify_position_events(&packet);
+    }
 };
 
 K_WORK_DEFINE(service_position_notify_work, send_position_state_callback);
 
-int send_position_state() {
-    int err = k_msgq_put(&position_state_msgq, position_state, K_MSEC(100));
+static int queue_position_event(struct position_event *ev) {
+    int err = k_msgq_put(&position_event_msgq, ev, K_MSEC(100));
     if (err) {
         switch (err) {
         case -EAGAIN: {
-            LOG_WRN("Position state message queue full, popping first message and queueing again");
-            uint8_t discarded_state[POS_STATE_LEN];
-            k_msgq_get(&position_state_msgq, &discarded_state, K_NO_WAIT);
-            return send_position_state();
+            LOG_WRN("Position event message queue full, popping first message and queueing again");
+            struct position_event discarded_event;
+            k_msgq_get(&position_event_msgq, &discarded_event, K_NO_WAIT);
+            return queue_position_event(ev);
         }
         default:
-            LOG_WRN("Failed to queue position state to send (%d)", err);
+            LOG_WRN("Failed to queue position event to send (%d)", err);
             return err;
         }
     }
@@ -166,14 +225,28 @@ int send_position_state() {
     return 0;
 }
 
-int zmk_split_bt_position_pressed(uint8_t position) {
-    WRITE_BIT(position_state[position / 8], position % 8, true);
-    return send_position_state();
+static int send_position_state(uint32_t position, bool state, int64_t timestamp) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        LOG_ERR("Position %d is outside the keymap", position);
+        return -EINVAL;
+    }
+
+    struct position_event ev = {.position = position, .state = state, .timestamp = timestamp};
+
+    k_spinlock_key_t key = k_spin_lock(&position_lock);
+    WRITE_BIT(position_state[position / 8], position % 8, state);
+    ev.sequence = position_sequence++;
+    k_spin_unlock(&position_lock, key);
+
+    return queue_position_event(&ev);
+}
+
+int zmk_split_position_pressed(uint32_t position, int64_t timestamp) {
+    return send_position_state(position, true, timestamp);
 }
 
-int zmk_split_bt_position_released(uint8_t position) {
-    WRITE_BIT(position_state[position / 8], position % 8, false);
-    return send_position_state();
+int zmk_split_position_released(uint32_t position, int64_t timestamp) {
+    return send_position_state(position, false, timestamp);
 }
 
 #if ZMK_KEYMAP_HAS_SENSORS
@@ -214,7 +287,7 @@ int send_sensor_state() {
     return 0;
 }
 
-int zmk_split_bt_sensor_triggered(uint8_t sensor_number, struct sensor_value value) {
+int zmk_split_sensor_triggered(uint8_t sensor_number, struct sensor_value value) {
     sensor_event.sensor_number = sensor_number;
     sensor_event.value = value;
     return send_sensor_state();
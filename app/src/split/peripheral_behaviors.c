@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <device.h>
+#include <init.h>
+#include <string.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <drivers/behavior.h>
+#include <zmk/behavior.h>
+#include <zmk/split/peripheral_behaviors.h>
+
+/*
+ * The IDs of the devices the central can run as behaviors, sorted, and the matching devices.
+ * Behaviors can not be told apart from other devices, so every device is listed.
+ */
+static uint32_t behavior_ids[CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX];
+static const struct device *behavior_devs[CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX];
+static uint8_t behavior_count;
+
+uint8_t zmk_split_peripheral_behavior_ids(const uint32_t **ids) {
+    *ids = behavior_ids;
+    return behavior_count;
+}
+
+int zmk_split_peripheral_run_behavior(const struct zmk_split_run_behavior_payload *payload) {
+    if (payload->behavior >= behavior_count) {
+        LOG_ERR("No behavior at index %d", payload->behavior);
+        return -ENOENT;
+    }
+
+    // the device's own name, so looking the behavior up again is a pointer comparison
+    struct zmk_behavior_binding binding = {
+        .param1 = payload->param1,
+        .param2 = payload->param2,
+        .behavior_dev = behavior_devs[payload->behavior]->name,
+    };
+    LOG_DBG("%s with params %d %d: pressed? %d", log_strdup(binding.behavior_dev), binding.param1,
+            binding.param2, payload->state);
+    struct zmk_behavior_binding_event event = {.position = payload->position,
+                                               .timestamp = k_uptime_get()};
+    int err;
+    if (payload->state > 0) {
+        err = behavior_keymap_binding_pressed(&binding, event);
+    } else {
+        err = behavior_keymap_binding_released(&binding, event);
+    }
+
+    if (err) {
+        LOG_ERR("Failed to invoke behavior %s: %d", log_strdup(binding.behavior_dev), err);
+    }
+
+    return err;
+}
+
+static int peripheral_behaviors_init(const struct device *_arg) {
+    const struct device *devs;
+    size_t count = z_device_get_all_static(&devs);
+
+    for (size_t i = 0; i < count; i++) {
+        const struct device *dev = &devs[i];
+        if (dev->name == NULL) {
+            continue;
+        }
+
+        if (behavior_count == CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX) {
+            LOG_ERR("More than %d devices, increase CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX",
+                    CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX);
+            return 0;
+        }
+
+        const uint32_t id = zmk_split_behavior_id(dev->name);
+        int index = behavior_count;
+        while (index > 0 && behavior_ids[index - 1] > id) {
+            index--;
+        }
+
+        if (index > 0 && behavior_ids[index - 1] == id) {
+            LOG_ERR("%s has the same behavior ID as %s, rename one of them",
+                    log_strdup(dev->name), log_strdup(behavior_devs[index - 1]->name));
+            continue;
+        }
+
+        memmove(&behavior_ids[index + 1], &behavior_ids[index],
+                (behavior_count - index) * sizeof(behavior_ids[0]));
+        memmove(&behavior_devs[index + 1], &behavior_devs[index],
+                (behavior_count - index) * sizeof(behavior_devs[0]));
+        behavior_ids[index] = id;
+        behavior_devs[index] = dev;
+        behavior_count++;
+    }
+
+    return 0;
+}
+
+SYS_INIT(peripheral_behaviors_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
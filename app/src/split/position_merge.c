@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/split/bluetooth/central.h>
+
+/*
+ * Peripheral position events reach the central some time after they happened, but carry their
+ * original timestamp. Every position event is held back for a short window and released in
+ * timestamp order, so a local key pressed after a peripheral key is not seen first. Until a
+ * peripheral's clock is synchronized its events are dated on arrival, so they are passed on
+ * right away.
+ *
+ * This listener must come before every other position listener, see CMakeLists.txt.
+ */
+
+#define MERGE_WINDOW_MS CONFIG_ZMK_SPLIT_POSITION_MERGE_WINDOW_MS
+#define MERGE_QUEUE_SIZE CONFIG_ZMK_SPLIT_POSITION_MERGE_QUEUE_SIZE
+
+// captured events, ordered by timestamp and by arrival for equal timestamps
+static const zmk_event_t *pending_events[MERGE_QUEUE_SIZE];
+static uint8_t pending_count;
+
+static void position_merge_work_handler(struct k_work *work);
+
+K_DELAYED_WORK_DEFINE(position_merge_work, position_merge_work_handler);
+
+static inline int64_t pending_timestamp(uint8_t index) {
+    return as_zmk_position_state_changed(pending_events[index])->timestamp;
+}
+
+static void release_first_pending() {
+    const zmk_event_t *ev = pending_events[0];
+
+    pending_count--;
+    memmove(&pending_events[0], &pending_events[1], pending_count * sizeof(pending_events[0]));
+
+    ZMK_EVENT_RELEASE(ev);
+}
+
+static void position_merge_work_handler(struct k_work *work) {
+    const int64_t now = k_uptime_get();
+
+    while (pending_count > 0 && pending_timestamp(0) + MERGE_WINDOW_MS <= now) {
+        release_first_pending();
+    }
+
+    if (pending_count > 0) {
+        k_delayed_work_submit(&position_merge_work,
+                              K_MSEC(pending_timestamp(0) + MERGE_WINDOW_MS - now));
+    }
+}
+
+static int position_merge_listener(const zmk_event_t *eh) {
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
+    if (ev == NULL || MERGE_WINDOW_MS == 0) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    // events still held back go first
+    if (pending_count == 0 && !zmk_split_bt_central_clock_synced()) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    if (pending_count == MERGE_QUEUE_SIZE) {
+        LOG_WRN("Position merge queue full, releasing the oldest event early");
+        release_first_pending();
+    }
+
+    uint8_t index = pending_count;
+    for (; index > 0 && pending_timestamp(index - 1) > ev->timestamp; index--) {
+        pending_events[index] = pending_events[index - 1];
+    }
+    pending_events[index] = eh;
+    pending_count++;
+
+    if (index < pending_count - 1) {
+        LOG_DBG("Position %d from source %d reordered before %d later events", ev->position,
+                ev->source, pending_count - 1 - index);
+    }
+
+    // The event manager records the capture once this returns, so even an event which is
+    // already due is released from the work queue.
+    k_delayed_work_submit(&position_merge_work, K_NO_WAIT);
+
+    return ZMK_EV_EVENT_CAPTURED;
+}
+
+ZMK_LISTENER(position_merge, position_merge_listener);
+ZMK_SUBSCRIPTION(position_merge, zmk_position_state_changed);
@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <device.h>
+#include <init.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/behavior.h>
+#include <zmk/matrix.h>
+#include <zmk/sensors.h>
+#include <zmk/split/transport.h>
+#include <zmk/split/wired/link.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+#include <zmk/events/sensor_event.h>
+
+/*
+ * Everything received from the peripheral is handled on the system work queue, one message at a
+ * time.
+ */
+
+#define PERIPHERAL_SOURCE 0
+
+static struct zmk_split_wired_link link;
+
+// the peripheral's positions, as last raised here
+static uint32_t position_state[ceiling_fraction(ZMK_KEYMAP_LEN, 32)];
+// sequence number of the next position event expected from the peripheral
+static uint8_t next_sequence;
+// whether position_state follows the peripheral's, so its events can be applied
+static bool synced;
+
+static uint32_t behavior_ids[CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX];
+static uint8_t behavior_count;
+static bool behaviors_read;
+
+// behaviors run before the peripheral's behaviors are read, sent in order once they are
+struct pending_run {
+    uint32_t behavior_id;
+    struct zmk_split_run_behavior_payload payload;
+};
+
+static struct pending_run pending_runs[CONFIG_ZMK_SPLIT_WIRED_CENTRAL_RUN_QUEUE_SIZE];
+static uint8_t pending_run_count;
+
+static void request(uint8_t type) {
+    int err = zmk_split_wired_send(&link, type, NULL, 0);
+    if (err) {
+        LOG_ERR("Failed to send split message %d (err %d)", type, err);
+    }
+}
+
+static void retry_work_handler(struct k_work *work);
+
+K_DELAYED_WORK_DEFINE(retry_work, retry_work_handler);
+
+// Asks for whatever has not been read yet. A request or its reply may be lost, so it is asked
+// again until the reply arrives.
+static void request_outstanding() {
+    if (!synced) {
+        request(ZMK_SPLIT_WIRED_MSG_READ_POSITION_STATE);
+    }
+    if (!behaviors_read) {
+        request(ZMK_SPLIT_WIRED_MSG_READ_BEHAVIORS);
+    }
+
+    if (!synced || !behaviors_read) {
+        k_delayed_work_submit(&retry_work, K_MSEC(CONFIG_ZMK_SPLIT_WIRED_RETRY_MS));
+    }
+}
+
+static void retry_work_handler(struct k_work *work) { request_outstanding(); }
+
+static void resync() {
+    synced = false;
+    request_outstanding();
+}
+
+static void raise_position_event(uint16_t position, bool pressed) {
+    // the link is fast enough that the arrival time stands in for the time of the key press
+    struct zmk_position_state_changed ev = {.source = PERIPHERAL_SOURCE,
+                                            .position = position,
+                                            .state = pressed,
+                                            .timestamp = k_uptime_get()};
+
+    WRITE_BIT(position_state[position / 32], position % 32, pressed);
+
+    LOG_DBG("Peripheral position %d %s", position, pressed ? "pressed" : "released");
+    ZMK_EVENT_RAISE(new_zmk_position_state_changed(ev));
+}
+
+static void release_all_positions() {
+    for (int word = 0; word < ARRAY_SIZE(position_state); word++) {
+        while (position_state[word]) {
+            raise_position_event(word * 32 + __builtin_ctz(position_state[word]), false);
+        }
+    }
+}
+
+static void heartbeat_timeout_work_handler(struct k_work *work);
+
+K_DELAYED_WORK_DEFINE(heartbeat_timeout_work, heartbeat_timeout_work_handler);
+
+// Nothing was heard from the peripheral, e.g. the cable was unplugged. Its keys are released so
+// none stay stuck, and its state is read again once it is back.
+static void heartbeat_timeout_work_handler(struct k_work *work) {
+    LOG_WRN("Lost the peripheral's heartbeat, releasing its positions");
+    release_all_positions();
+    resync();
+}
+
+static void receive_position_events(const uint8_t *payload, size_t len) {
+    const struct zmk_split_position_events *packet = (const void *)payload;
+    if (len < sizeof(*packet) ||
+        len < sizeof(*packet) + packet->count * sizeof(struct zmk_split_position_event)) {
+        LOG_ERR("Malformed position events message of %d bytes", len);
+        return;
+    }
+
+    if (packet->version != ZMK_SPLIT_POSITION_PROTOCOL_VERSION) {
+        LOG_ERR("Peripheral uses split protocol version %d, expected %d", packet->version,
+                ZMK_SPLIT_POSITION_PROTOCOL_VERSION);
+        return;
+    }
+
+    // a state read is already requested and retried, its answer includes this event
+    if (!synced) {
+        return;
+    }
+
+    int8_t missed = packet->sequence - next_sequence;
+    if (missed > 0) {
+        LOG_WRN("Missed %d position events from the peripheral, resynchronizing", missed);
+        resync();
+        return;
+    }
+
+    for (int i = 0; i < packet->count; i++) {
+        const struct zmk_split_position_event *event = &packet->events[i];
+        uint8_t sequence = packet->sequence + i;
+
+        // events from before the last resynchronization are already in position_state
+        if ((int8_t)(sequence - next_sequence) < 0) {
+            continue;
+        }
+        next_sequence = sequence + 1;
+
+        const uint16_t position = event->position & ZMK_SPLIT_POSITION_MAX;
+        if (position >= ZMK_KEYMAP_LEN) {
+            LOG_ERR("Peripheral position %d out of range", position);
+            continue;
+        }
+
+        raise_position_event(position, (event->position & ZMK_SPLIT_POSITION_PRESSED) != 0);
+    }
+}
+
+static void receive_heartbeat(const uint8_t *payload, size_t len) {
+    struct zmk_split_wired_heartbeat heartbeat;
+    if (len != sizeof(heartbeat)) {
+        LOG_ERR("Heartbeat message of %d bytes, expected %d", len, sizeof(heartbeat));
+        return;
+    }
+
+    memcpy(&heartbeat, payload, sizeof(heartbeat));
+    if (heartbeat.version != ZMK_SPLIT_POSITION_PROTOCOL_VERSION || !synced) {
+        return;
+    }
+
+    // the last events before the heartbeat never arrived
+    int8_t missed = heartbeat.sequence - next_sequence;
+    if (missed > 0) {
+        LOG_WRN("Missed the last %d position events from the peripheral, resynchronizing",
+                missed);
+        resync();
+    }
+}
+
+// Raises an event for every position which differs from the peripheral's state.
+static void receive_position_state(const uint8_t *payload, size_t len) {
+    const struct zmk_split_position_state *state = (const void *)payload;
+    if (len < sizeof(*state) + ceiling_fraction(ZMK_KEYMAP_LEN, 8)) {
+        LOG_ERR("Peripheral position state of %d bytes is too short", len);
+        return;
+    }
+
+    if (state->version != ZMK_SPLIT_POSITION_PROTOCOL_VERSION) {
+        LOG_ERR("Peripheral uses split protocol version %d, expected %d", state->version,
+                ZMK_SPLIT_POSITION_PROTOCOL_VERSION);
+        return;
+    }
+
+    LOG_DBG("Resynchronized at position event %d", state->sequence);
+
+    const uint16_t state_len = ceiling_fraction(ZMK_KEYMAP_LEN, 8);
+    for (int word = 0; word < ARRAY_SIZE(position_state); word++) {
+        uint32_t peripheral_word = 0;
+        for (int byte = 0; byte < 4 && word * 4 + byte < state_len; byte++) {
+            peripheral_word |= (uint32_t)state->state[word * 4 + byte] << (byte * 8);
+        }
+
+        uint32_t changed = peripheral_word ^ position_state[word];
+        while (changed) {
+            const int bit = __builtin_ctz(changed);
+            changed &= changed - 1;
+            raise_position_event(word * 32 + bit, (peripheral_word & BIT(bit)) != 0);
+        }
+    }
+
+    next_sequence = state->sequence;
+    synced = true;
+}
+
+static int send_run(uint32_t behavior_id, struct zmk_split_run_behavior_payload payload) {
+    int index = zmk_split_behavior_index(behavior_ids, behavior_count, behavior_id);
+    if (index < 0) {
+        LOG_ERR("Peripheral has no behavior with ID 0x%08x", behavior_id);
+        return index;
+    }
+    payload.behavior = index;
+
+    return zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_RUN_BEHAVIOR, &payload,
+                                sizeof(payload));
+}
+
+static void send_pending_runs() {
+    for (int i = 0; i < pending_run_count; i++) {
+        int err = send_run(pending_runs[i].behavior_id, pending_runs[i].payload);
+        if (err) {
+            LOG_ERR("Failed to run a held behavior on the peripheral (err %d)", err);
+        }
+    }
+    pending_run_count = 0;
+}
+
+static void receive_behaviors(const uint8_t *payload, size_t len) {
+    const struct zmk_split_wired_behaviors *frame = (const void *)payload;
+    if (len < sizeof(*frame) || (len - sizeof(*frame)) % sizeof(uint32_t) != 0) {
+        LOG_ERR("Malformed behaviors message of %d bytes", len);
+        return;
+    }
+
+    // a late reply to a repeated request
+    if (behaviors_read) {
+        return;
+    }
+
+    // a reply to a repeated request starts the list again
+    if (frame->first == 0) {
+        behavior_count = 0;
+    }
+
+    const uint8_t frame_count = (len - sizeof(*frame)) / sizeof(uint32_t);
+    if (frame->first != behavior_count || frame->first + frame_count > frame->total) {
+        LOG_ERR("Unexpected behaviors %d to %d", frame->first, frame->first + frame_count);
+        return;
+    }
+
+    if (frame->total > ARRAY_SIZE(behavior_ids)) {
+        LOG_ERR("Peripheral has %d behaviors, increase CONFIG_ZMK_SPLIT_PERIPHERAL_BEHAVIORS_MAX",
+                frame->total);
+        return;
+    }
+
+    memcpy(&behavior_ids[behavior_count], frame->ids, frame_count * sizeof(uint32_t));
+    behavior_count += frame_count;
+
+    if (behavior_count == frame->total) {
+        LOG_DBG("Read %d peripheral behaviors", behavior_count);
+        behaviors_read = true;
+        send_pending_runs();
+    }
+}
+
+#if ZMK_KEYMAP_HAS_SENSORS
+static void receive_sensor_event(const uint8_t *payload, size_t len) {
+    struct zmk_split_sensor_event sensor_event;
+    if (len != sizeof(sensor_event)) {
+        LOG_ERR("Sensor event message of %d bytes, expected %d", len, sizeof(sensor_event));
+        return;
+    }
+
+    memcpy(&sensor_event, payload, sizeof(sensor_event));
+    ZMK_EVENT_RAISE(new_zmk_sensor_event((struct zmk_sensor_event){
+        .sensor_number = sensor_event.sensor_number,
+        .value = sensor_event.value,
+        .timestamp = k_uptime_get()}));
+}
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+
+static void read_peripheral() {
+    synced = false;
+    behavior_count = 0;
+    behaviors_read = false;
+
+    request_outstanding();
+}
+
+static void central_receive(uint8_t type, const uint8_t *payload, size_t len) {
+    // any message shows the peripheral is still there
+    k_delayed_work_submit(&heartbeat_timeout_work,
+                          K_MSEC(CONFIG_ZMK_SPLIT_WIRED_HEARTBEAT_TIMEOUT_MS));
+
+    switch (type) {
+    case ZMK_SPLIT_WIRED_MSG_HELLO:
+        LOG_INF("Split peripheral connected");
+        read_peripheral();
+        break;
+    case ZMK_SPLIT_WIRED_MSG_POSITION_EVENTS:
+        receive_position_events(payload, len);
+        break;
+    case ZMK_SPLIT_WIRED_MSG_POSITION_STATE:
+        receive_position_state(payload, len);
+        break;
+    case ZMK_SPLIT_WIRED_MSG_BEHAVIORS:
+        receive_behaviors(payload, len);
+        break;
+    case ZMK_SPLIT_WIRED_MSG_HEARTBEAT:
+        receive_heartbeat(payload, len);
+        break;
+#if ZMK_KEYMAP_HAS_SENSORS
+    case ZMK_SPLIT_WIRED_MSG_SENSOR_EVENT:
+        receive_sensor_event(payload, len);
+        break;
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+    default:
+        LOG_WRN("Unexpected split message type %d", type);
+        break;
+    }
+}
+
+int zmk_split_invoke_behavior(uint8_t source, struct zmk_behavior_binding *binding,
+                              struct zmk_behavior_binding_event event, bool state) {
+    const uint32_t behavior_id = zmk_split_behavior_id(binding->behavior_dev);
+    struct zmk_split_run_behavior_payload payload = {
+        .param1 = binding->param1,
+        .param2 = binding->param2,
+        .position = event.position,
+        .state = state ? 1 : 0,
+    };
+
+    if (behaviors_read) {
+        return send_run(behavior_id, payload);
+    }
+
+    if (pending_run_count == ARRAY_SIZE(pending_runs)) {
+        LOG_ERR("Peripheral behaviors not read yet and %d runs held, increase "
+                "CONFIG_ZMK_SPLIT_WIRED_CENTRAL_RUN_QUEUE_SIZE", pending_run_count);
+        return -ENOMEM;
+    }
+
+    pending_runs[pending_run_count++] =
+        (struct pending_run){.behavior_id = behavior_id, .payload = payload};
+
+    return 0;
+}
+
+static int split_wired_central_init(const struct device *_arg) {
+    int err = zmk_split_wired_link_init(&link, central_receive);
+    if (err) {
+        LOG_ERR("Failed to open the split link (err %d)", err);
+        return err;
+    }
+
+    // a peripheral which started first has already said hello
+    read_peripheral();
+
+    return 0;
+}
+
+SYS_INIT(split_wired_central_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
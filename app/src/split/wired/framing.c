@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <errno.h>
+#include <sys/byteorder.h>
+#include <sys/crc.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/split/wired/framing.h>
+
+#define CRC_SEED 0xFFFF
+#define COBS_BLOCK_MAX 0xFF
+
+struct cobs_encoder {
+    uint8_t *buf;
+    size_t len;
+    // where the length code of the block being written goes
+    size_t code_index;
+    uint8_t code;
+};
+
+static void cobs_finish_block(struct cobs_encoder *enc) {
+    enc->buf[enc->code_index] = enc->code;
+    enc->code_index = enc->len++;
+    enc->code = 1;
+}
+
+static void cobs_put(struct cobs_encoder *enc, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == 0) {
+            cobs_finish_block(enc);
+            continue;
+        }
+
+        enc->buf[enc->len++] = data[i];
+        if (++enc->code == COBS_BLOCK_MAX) {
+            cobs_finish_block(enc);
+        }
+    }
+}
+
+int zmk_split_wired_frame_encode(uint8_t type, const void *payload, size_t len, uint8_t *buf) {
+    if (len > ZMK_SPLIT_WIRED_PAYLOAD_MAX) {
+        return -EMSGSIZE;
+    }
+
+    struct cobs_encoder enc = {.buf = buf, .len = 1, .code_index = 0, .code = 1};
+    uint8_t crc[2];
+
+    sys_put_le16(crc16_ccitt(crc16_ccitt(CRC_SEED, &type, 1), payload, len), crc);
+
+    cobs_put(&enc, &type, 1);
+    cobs_put(&enc, payload, len);
+    cobs_put(&enc, crc, sizeof(crc));
+    enc.buf[enc.code_index] = enc.code;
+    enc.buf[enc.len++] = 0;
+
+    return enc.len;
+}
+
+// Decodes in place, the decoded frame is never longer than the encoded one.
+static int cobs_decode(uint8_t *buf, size_t len) {
+    size_t read = 0;
+    size_t write = 0;
+
+    while (read < len) {
+        const uint8_t code = buf[read++];
+        if (read + code - 1 > len) {
+            return -EINVAL;
+        }
+
+        for (int i = 1; i < code; i++) {
+            buf[write++] = buf[read++];
+        }
+        if (code < COBS_BLOCK_MAX && read < len) {
+            buf[write++] = 0;
+        }
+    }
+
+    return write;
+}
+
+static void decode_frame(struct zmk_split_wired_decoder *decoder,
+                         zmk_split_wired_receive_t receive) {
+    int len = cobs_decode(decoder->buf, decoder->len);
+    if (len < 3) {
+        LOG_WRN("Dropping malformed split frame");
+        decoder->dropped++;
+        return;
+    }
+
+    if (crc16_ccitt(CRC_SEED, decoder->buf, len - 2) != sys_get_le16(&decoder->buf[len - 2])) {
+        LOG_WRN("Dropping split frame with a bad CRC");
+        decoder->dropped++;
+        return;
+    }
+
+    receive(decoder->buf[0], &decoder->buf[1], len - 3);
+}
+
+void zmk_split_wired_decode(struct zmk_split_wired_decoder *decoder, const uint8_t *data,
+                            size_t len, zmk_split_wired_receive_t receive) {
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != 0) {
+            if (decoder->len < sizeof(decoder->buf)) {
+                decoder->buf[decoder->len++] = data[i];
+            } else {
+                decoder->overflow = true;
+            }
+            continue;
+        }
+
+        if (decoder->overflow) {
+            LOG_WRN("Dropping split frame longer than %d bytes", sizeof(decoder->buf));
+            decoder->dropped++;
+        } else if (decoder->len > 0) {
+            decode_frame(decoder, receive);
+        }
+
+        decoder->len = 0;
+        decoder->overflow = false;
+    }
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <kernel.h>
+#include <device.h>
+#include <drivers/uart.h>
+#include <sys/ring_buffer.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/split/wired/link.h>
+
+static void link_rx_work_handler(struct k_work *work) {
+    struct zmk_split_wired_link *link = CONTAINER_OF(work, struct zmk_split_wired_link, rx_work);
+    uint8_t chunk[32];
+    uint32_t len;
+
+    while ((len = ring_buf_get(&link->rx_ring, chunk, sizeof(chunk))) > 0) {
+        zmk_split_wired_decode(&link->decoder, chunk, len, link->receive);
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_WIRED_LOOPBACK)
+
+// the first end opened waits here for the second
+static struct zmk_split_wired_link *loopback_peer;
+static struct k_spinlock loopback_lock;
+
+static int link_open(struct zmk_split_wired_link *link) {
+    k_spinlock_key_t key = k_spin_lock(&loopback_lock);
+    if (loopback_peer == NULL) {
+        loopback_peer = link;
+    } else {
+        link->peer = loopback_peer;
+        loopback_peer->peer = link;
+    }
+    k_spin_unlock(&loopback_lock, key);
+
+    return 0;
+}
+
+static int link_write(struct zmk_split_wired_link *link, const uint8_t *data, size_t len) {
+    int err = 0;
+    k_spinlock_key_t key = k_spin_lock(&loopback_lock);
+    struct zmk_split_wired_link *peer = link->peer;
+
+    if (peer == NULL) {
+        err = -ENOTCONN;
+    } else if (ring_buf_space_get(&peer->rx_ring) < len) {
+        err = -ENOMEM;
+    } else {
+        ring_buf_put(&peer->rx_ring, data, len);
+    }
+    k_spin_unlock(&loopback_lock, key);
+
+    if (err == 0) {
+        k_work_submit(&peer->rx_work);
+    }
+
+    return err;
+}
+
+/*
+ * Faults of a real wire, so tests can check that the central recovers from them. Returns true if
+ * the frame is lost.
+ */
+static bool loopback_fault(uint8_t type, uint8_t *frame) {
+    static uint32_t position_events_sent;
+    static uint32_t position_states_sent;
+
+    if (CONFIG_ZMK_SPLIT_WIRED_LOOPBACK_CUT_AFTER_MS > 0 &&
+        k_uptime_get() >= CONFIG_ZMK_SPLIT_WIRED_LOOPBACK_CUT_AFTER_MS) {
+        return true;
+    }
+
+    switch (type) {
+    case ZMK_SPLIT_WIRED_MSG_POSITION_EVENTS:
+        if (++position_events_sent == CONFIG_ZMK_SPLIT_WIRED_LOOPBACK_CORRUPT_POSITION_EVENTS) {
+            LOG_WRN("Corrupting position events frame %d", position_events_sent);
+            // the type byte follows the COBS code, flipping its low bit keeps it non-zero
+            frame[1] ^= 0x01;
+        }
+        return false;
+    case ZMK_SPLIT_WIRED_MSG_POSITION_STATE:
+        if (++position_states_sent == CONFIG_ZMK_SPLIT_WIRED_LOOPBACK_DROP_POSITION_STATE) {
+            LOG_WRN("Dropping position state frame %d", position_states_sent);
+            return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+#else
+
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_split_uart),
+             "CONFIG_ZMK_SPLIT_WIRED is enabled but no zmk,split-uart chosen node found");
+
+static const struct device *const split_uart = DEVICE_DT_GET(DT_CHOSEN(zmk_split_uart));
+
+static void link_uart_isr(const struct device *uart, void *user_data) {
+    struct zmk_split_wired_link *link = user_data;
+
+    while (uart_irq_update(uart) && uart_irq_is_pending(uart)) {
+        if (uart_irq_rx_ready(uart)) {
+            uint8_t *data;
+            uint32_t space = ring_buf_put_claim(&link->rx_ring, &data, sizeof(link->rx_buf));
+            if (space == 0) {
+                // the frame is lost, the decoder picks up again at the next delimiter
+                uint8_t discard;
+                uart_fifo_read(uart, &discard, 1);
+            } else {
+                ring_buf_put_finish(&link->rx_ring, uart_fifo_read(uart, data, space));
+            }
+            k_work_submit(&link->rx_work);
+        }
+
+        if (uart_irq_tx_ready(uart)) {
+            uint8_t *data;
+            uint32_t len = ring_buf_get_claim(&link->tx_ring, &data, sizeof(link->tx_buf));
+            if (len == 0) {
+                uart_irq_tx_disable(uart);
+            } else {
+                ring_buf_get_finish(&link->tx_ring, uart_fifo_fill(uart, data, len));
+            }
+        }
+    }
+}
+
+static int link_open(struct zmk_split_wired_link *link) {
+    if (!device_is_ready(split_uart)) {
+        LOG_ERR("Split UART \"%s\" is not ready", split_uart->name);
+        return -ENODEV;
+    }
+
+    link->uart = split_uart;
+    ring_buf_init(&link->tx_ring, sizeof(link->tx_buf), link->tx_buf);
+
+    uart_irq_callback_user_data_set(link->uart, link_uart_isr, link);
+    uart_irq_rx_enable(link->uart);
+
+    return 0;
+}
+
+static int link_write(struct zmk_split_wired_link *link, const uint8_t *data, size_t len) {
+    int err = 0;
+    k_spinlock_key_t key = k_spin_lock(&link->tx_lock);
+
+    // a frame is queued whole or not at all, so a full buffer never sends half of one
+    if (ring_buf_space_get(&link->tx_ring) < len) {
+        err = -ENOMEM;
+    } else {
+        ring_buf_put(&link->tx_ring, data, len);
+    }
+    k_spin_unlock(&link->tx_lock, key);
+
+    if (err == 0) {
+        uart_irq_tx_enable(link->uart);
+    }
+
+    return err;
+}
+
+#endif
+
+int zmk_split_wired_link_init(struct zmk_split_wired_link *link,
+                              zmk_split_wired_receive_t receive) {
+    link->receive = receive;
+    ring_buf_init(&link->rx_ring, sizeof(link->rx_buf), link->rx_buf);
+    k_work_init(&link->rx_work, link_rx_work_handler);
+
+    return link_open(link);
+}
+
+int zmk_split_wired_send(struct zmk_split_wired_link *link, uint8_t type, const void *payload,
+                         size_t len) {
+    uint8_t frame[ZMK_SPLIT_WIRED_ENCODED_MAX];
+    int frame_len = zmk_split_wired_frame_encode(type, payload, len, frame);
+    if (frame_len < 0) {
+        return frame_len;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_WIRED_LOOPBACK)
+    // the sender of a frame lost on the wire can't tell either
+    if (loopback_fault(type, frame)) {
+        return 0;
+    }
+#endif
+
+    return link_write(link, frame, frame_len);
+}
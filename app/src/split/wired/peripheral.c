@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2022 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <device.h>
+#include <init.h>
+#include <string.h>
+#include <sys/util.h>
+
+#include <logging/log.h>
+
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#include <zmk/matrix.h>
+#include <zmk/sensors.h>
+#include <zmk/split/transport.h>
+#include <zmk/split/peripheral_behaviors.h>
+#include <zmk/split/wired/link.h>
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_WIRED_LOOPBACK)
+#include <zmk/event_manager.h>
+#include <zmk/events/position_state_changed.h>
+#endif
+
+#define POS_STATE_LEN ceiling_fraction(ZMK_KEYMAP_LEN, 8)
+
+BUILD_ASSERT(ZMK_KEYMAP_LEN <= ZMK_SPLIT_POSITION_MAX + 1,
+             "Too many key positions for the split protocol");
+
+static struct zmk_split_wired_link link;
+
+static uint8_t position_state[POS_STATE_LEN];
+// sequence number of the next position event
+static uint8_t position_sequence;
+// Held while a position event or the state is sent, so the central receives them in the order of
+// their sequence numbers.
+static struct k_spinlock position_lock;
+
+static int send_position_state(uint32_t position, bool state, int64_t timestamp) {
+    if (position >= ZMK_KEYMAP_LEN) {
+        LOG_ERR("Position %d is outside the keymap", position);
+        return -EINVAL;
+    }
+
+    struct {
+        struct zmk_split_position_events header;
+        struct zmk_split_position_event event;
+    } __packed message = {
+        .header = {.version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION,
+                   .count = 1,
+                   .timestamp = (uint32_t)timestamp},
+        .event = {.position = position | (state ? ZMK_SPLIT_POSITION_PRESSED : 0)},
+    };
+
+    k_spinlock_key_t key = k_spin_lock(&position_lock);
+    WRITE_BIT(position_state[position / 8], position % 8, state);
+    message.header.sequence = position_sequence++;
+    int err = zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_POSITION_EVENTS, &message,
+                                   sizeof(message));
+    k_spin_unlock(&position_lock, key);
+
+    // the central notices the gap in sequence numbers and reads the whole state
+    if (err) {
+        LOG_WRN("Failed to send position event %d (err %d)", message.header.sequence, err);
+    }
+
+    return err;
+}
+
+int zmk_split_position_pressed(uint32_t position, int64_t timestamp) {
+    return send_position_state(position, true, timestamp);
+}
+
+int zmk_split_position_released(uint32_t position, int64_t timestamp) {
+    return send_position_state(position, false, timestamp);
+}
+
+#if ZMK_KEYMAP_HAS_SENSORS
+int zmk_split_sensor_triggered(uint8_t sensor_number, struct sensor_value value) {
+    struct zmk_split_sensor_event event = {.sensor_number = sensor_number, .value = value};
+
+    int err = zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_SENSOR_EVENT, &event, sizeof(event));
+    if (err) {
+        LOG_WRN("Failed to send sensor event (err %d)", err);
+    }
+
+    return err;
+}
+#endif /* ZMK_KEYMAP_HAS_SENSORS */
+
+static void send_position_snapshot() {
+    struct {
+        struct zmk_split_position_state header;
+        uint8_t state[POS_STATE_LEN];
+    } __packed snapshot = {.header = {.version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION}};
+
+    k_spinlock_key_t key = k_spin_lock(&position_lock);
+    snapshot.header.sequence = position_sequence;
+    memcpy(snapshot.state, position_state, sizeof(snapshot.state));
+    int err = zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_POSITION_STATE, &snapshot,
+                                   sizeof(snapshot));
+    k_spin_unlock(&position_lock, key);
+
+    if (err) {
+        LOG_ERR("Failed to send the position state (err %d)", err);
+    }
+}
+
+static void heartbeat_work_handler(struct k_work *work);
+
+K_DELAYED_WORK_DEFINE(heartbeat_work, heartbeat_work_handler);
+
+static void heartbeat_work_handler(struct k_work *work) {
+    struct zmk_split_wired_heartbeat heartbeat = {.version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION};
+
+    k_spinlock_key_t key = k_spin_lock(&position_lock);
+    heartbeat.sequence = position_sequence;
+    zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_HEARTBEAT, &heartbeat, sizeof(heartbeat));
+    k_spin_unlock(&position_lock, key);
+
+    k_delayed_work_submit(&heartbeat_work, K_MSEC(CONFIG_ZMK_SPLIT_WIRED_HEARTBEAT_MS));
+}
+
+static void send_behaviors() {
+    const uint32_t *ids;
+    const uint8_t count = zmk_split_peripheral_behavior_ids(&ids);
+    uint8_t first = 0;
+
+    // an empty list still takes one frame, so the central knows it is complete
+    do {
+        struct {
+            struct zmk_split_wired_behaviors header;
+            uint32_t ids[ZMK_SPLIT_WIRED_BEHAVIORS_PER_FRAME];
+        } __packed frame = {.header = {.first = first, .total = count}};
+        const uint8_t frame_count = MIN(count - first, ZMK_SPLIT_WIRED_BEHAVIORS_PER_FRAME);
+
+        memcpy(frame.ids, &ids[first], frame_count * sizeof(ids[0]));
+
+        int err = zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_BEHAVIORS, &frame,
+                                       sizeof(frame.header) + frame_count * sizeof(ids[0]));
+        if (err) {
+            LOG_ERR("Failed to send the behavior list (err %d)", err);
+            return;
+        }
+
+        first += frame_count;
+    } while (first < count);
+}
+
+static void peripheral_receive(uint8_t type, const uint8_t *payload, size_t len) {
+    switch (type) {
+    case ZMK_SPLIT_WIRED_MSG_READ_POSITION_STATE:
+        send_position_snapshot();
+        break;
+    case ZMK_SPLIT_WIRED_MSG_READ_BEHAVIORS:
+        send_behaviors();
+        break;
+    case ZMK_SPLIT_WIRED_MSG_RUN_BEHAVIOR: {
+        struct zmk_split_run_behavior_payload run;
+        if (len != sizeof(run)) {
+            LOG_ERR("Run behavior message of %d bytes, expected %d", len, sizeof(run));
+            break;
+        }
+
+        memcpy(&run, payload, sizeof(run));
+        zmk_split_peripheral_run_behavior(&run);
+        break;
+    }
+    default:
+        LOG_WRN("Unexpected split message type %d", type);
+        break;
+    }
+}
+
+#if IS_ENABLED(CONFIG_ZMK_SPLIT_WIRED_LOOPBACK)
+/*
+ * With the loopback link, the central's own keys stand in for the peripheral's. They are sent
+ * through the link and come back from the central side as peripheral events.
+ */
+static int split_wired_loopback_listener(const zmk_event_t *eh) {
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
+    if (ev == NULL || ev->source != ZMK_POSITION_STATE_CHANGE_SOURCE_LOCAL) {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    int err = ev->state ? zmk_split_position_pressed(ev->position, ev->timestamp)
+                        : zmk_split_position_released(ev->position, ev->timestamp);
+    if (err) {
+        return err;
+    }
+
+    return ZMK_EV_EVENT_HANDLED;
+}
+
+ZMK_LISTENER(split_wired_loopback, split_wired_loopback_listener);
+ZMK_SUBSCRIPTION(split_wired_loopback, zmk_position_state_changed);
+#endif
+
+static int split_wired_peripheral_init(const struct device *_arg) {
+    int err = zmk_split_wired_link_init(&link, peripheral_receive);
+    if (err) {
+        LOG_ERR("Failed to open the split link (err %d)", err);
+        return err;
+    }
+
+    // a central which is already running reads the state again, this half may have restarted
+    const uint8_t version = ZMK_SPLIT_POSITION_PROTOCOL_VERSION;
+    zmk_split_wired_send(&link, ZMK_SPLIT_WIRED_MSG_HELLO, &version, sizeof(version));
+
+    k_delayed_work_submit(&heartbeat_work, K_MSEC(CONFIG_ZMK_SPLIT_WIRED_HEARTBEAT_MS));
+
+    return 0;
+}
+
+SYS_INIT(split_wired_peripheral_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
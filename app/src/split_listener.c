@@ -9,7 +9,7 @@
 #include <power/reboot.h>
 #include <logging/log.h>
 
-#include <zmk/split/bluetooth/service.h>
+#include <zmk/split/transport.h>
 
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
@@ -26,9 +26,9 @@ int split_listener(const zmk_event_t *eh) {
     if ((pos_ev = as_zmk_position_state_changed(eh)) != NULL) {
         if (pos_ev != NULL) {
             if (pos_ev->state) {
-                return zmk_split_bt_position_pressed(pos_ev->position);
+                return zmk_split_position_pressed(pos_ev->position, pos_ev->timestamp);
             } else {
-                return zmk_split_bt_position_released(pos_ev->position);
+                return zmk_split_position_released(pos_ev->position, pos_ev->timestamp);
             }
         }
     }
@@ -37,7 +37,7 @@ int split_listener(const zmk_event_t *eh) {
     const struct zmk_sensor_event *sensor_ev;
     if ((sensor_ev = as_zmk_sensor_event(eh)) != NULL) {
         if (sensor_ev != NULL) {
-            return zmk_split_bt_sensor_triggered(sensor_ev->sensor_number, sensor_ev->value);
+            return zmk_split_sensor_triggered(sensor_ev->sensor_number, sensor_ev->value);
         }
     }
 #endif /* ZMK_KEYMAP_HAS_SENSORS */
@@ -12,6 +12,7 @@
 
 #include <zmk/hid.h>
 #include <zmk/keymap.h>
+#include <zmk/endpoints.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/usb_conn_state_changed.h>
 
@@ -32,7 +33,10 @@ static const struct device *hid_dev;
 
 static K_SEM_DEFINE(hid_sem, 1, 1);
 
-static void in_ready_cb(const struct device *dev) { k_sem_give(&hid_sem); }
+static void in_ready_cb(const struct device *dev) {
+    k_sem_give(&hid_sem);
+    zmk_endpoints_report_sent();
+}
 
 static const struct hid_ops ops = {
     .int_in_ready = in_ready_cb,
@@ -40,8 +44,14 @@ static const struct hid_ops ops = {
 
 int zmk_usb_hid_send_report(const uint8_t *report, size_t len) {
     switch (usb_status) {
-    case USB_DC_SUSPEND:
-        return usb_wakeup_request();
+    case USB_DC_SUSPEND: {
+        // the report is dropped and no in_ready_cb follows
+        int err = usb_wakeup_request();
+        if (!err) {
+            zmk_endpoints_report_sent();
+        }
+        return err;
+    }
     case USB_DC_ERROR:
     case USB_DC_RESET:
     case USB_DC_DISCONNECTED:
@@ -11,6 +11,7 @@ module.exports = {
     Features: [
       "features/keymaps",
       "features/combos",
+      "features/chords",
       "features/conditional-layers",
       "features/debouncing",
       "features/displays",
@@ -30,6 +31,7 @@ module.exports = {
       "behaviors/sticky-key",
       "behaviors/sticky-layer",
       "behaviors/tap-dance",
+      "behaviors/leader-key",
       "behaviors/caps-word",
       "behaviors/key-repeat",
       "behaviors/reset",